@@ -0,0 +1,391 @@
+/*
+ * AES-256-CTR and GHASH, see aes.h
+ * The S-box circuit is Boyar and Peralta's, as used in BearSSL's aes_ct.
+ * The PCLMULQDQ multiply follows Intel's carry-less multiplication white
+ * paper (Gueron and Kounavis).
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "aes.h"
+#if (AES_HW)
+#include <immintrin.h>
+#endif
+
+#define GH_KEYED 0x47484B59             /* "GHKY" */
+
+static uint32_t Load32(const uint8_t *p) {      // big-endian
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+         | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void Store32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;  p[1] = v >> 16;  p[2] = v >> 8;  p[3] = v;
+}
+
+static uint64_t Load64(const uint8_t *p) {
+    return ((uint64_t)Load32(p) << 32) | Load32(&p[4]);
+}
+
+static void Store64(uint8_t *p, uint64_t v) {
+    Store32(p, (uint32_t)(v >> 32));
+    Store32(&p[4], (uint32_t)v);
+}
+
+// ---------------------------------------------------------------------------
+// Software AES
+
+// S-box on bit planes: bit j of q[i] is bit i of byte j
+static void Sbox(uint32_t *q) {
+    uint32_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint32_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+    uint32_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+    uint32_t y20, y21;
+    uint32_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+    uint32_t z10, z11, z12, z13, z14, z15, z16, z17;
+    uint32_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    uint32_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    uint32_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    uint32_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    uint32_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    uint32_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    uint32_t t60, t61, t62, t63, t64, t65, t66, t67;
+    uint32_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];  x1 = q[6];  x2 = q[5];  x3 = q[4];
+    x4 = q[3];  x5 = q[2];  x6 = q[1];  x7 = q[0];
+
+    // top linear transformation
+    y14 = x3 ^ x5;     y13 = x0 ^ x6;     y9 = x0 ^ x3;
+    y8 = x0 ^ x5;      t0 = x1 ^ x2;      y1 = t0 ^ x7;
+    y4 = y1 ^ x3;      y12 = y13 ^ y14;   y2 = y1 ^ x0;
+    y5 = y1 ^ x6;      y3 = y5 ^ y8;      t1 = x4 ^ y12;
+    y15 = t1 ^ x5;     y20 = t1 ^ x1;     y6 = y15 ^ x7;
+    y10 = y15 ^ t0;    y11 = y20 ^ y9;    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;   y19 = y10 ^ y8;    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;   y18 = x0 ^ y16;
+
+    // non-linear section
+    t2 = y12 & y15;    t3 = y3 & y6;      t4 = t3 ^ t2;
+    t5 = y4 & x7;      t6 = t5 ^ t2;      t7 = y13 & y16;
+    t8 = y5 & y1;      t9 = t8 ^ t7;      t10 = y2 & y7;
+    t11 = t10 ^ t7;    t12 = y9 & y11;    t13 = y14 & y17;
+    t14 = t13 ^ t12;   t15 = y8 & y10;    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;    t18 = t6 ^ t16;    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;   t21 = t17 ^ y20;   t22 = t18 ^ y19;
+    t23 = t19 ^ y21;   t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;   t26 = t21 & t23;   t27 = t24 ^ t26;
+    t28 = t25 & t27;   t29 = t28 ^ t22;   t30 = t23 ^ t24;
+    t31 = t22 ^ t26;   t32 = t31 & t30;   t33 = t32 ^ t24;
+    t34 = t23 ^ t33;   t35 = t27 ^ t33;   t36 = t24 & t35;
+    t37 = t36 ^ t34;   t38 = t27 ^ t36;   t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;   t42 = t29 ^ t33;   t43 = t29 ^ t40;
+    t44 = t33 ^ t37;   t45 = t42 ^ t41;
+    z0 = t44 & y15;    z1 = t37 & y6;     z2 = t33 & x7;
+    z3 = t43 & y16;    z4 = t40 & y1;     z5 = t29 & y7;
+    z6 = t42 & y11;    z7 = t45 & y17;    z8 = t41 & y10;
+    z9 = t44 & y12;    z10 = t37 & y3;    z11 = t33 & y4;
+    z12 = t43 & y13;   z13 = t40 & y5;    z14 = t29 & y2;
+    z15 = t42 & y9;    z16 = t45 & y14;   z17 = t41 & y8;
+
+    // bottom linear transformation
+    t46 = z15 ^ z16;   t47 = z10 ^ z11;   t48 = z5 ^ z13;
+    t49 = z9 ^ z10;    t50 = z2 ^ z12;    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;     t53 = z0 ^ z3;     t54 = z6 ^ z7;
+    t55 = z16 ^ z17;   t56 = z12 ^ t48;   t57 = t50 ^ t53;
+    t58 = z4 ^ t46;    t59 = z3 ^ t54;    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;   t62 = t52 ^ t58;   t63 = t49 ^ t58;
+    t64 = z4 ^ t59;    t65 = t61 ^ t62;   t66 = z1 ^ t63;
+    s0 = t59 ^ t63;    s6 = t56 ^ ~t62;   s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;   s3 = t53 ^ t66;    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;    s1 = t64 ^ ~s3;    s2 = t55 ^ ~t67;
+
+    q[7] = s0;  q[6] = s1;  q[5] = s2;  q[4] = s3;
+    q[3] = s4;  q[2] = s5;  q[1] = s6;  q[0] = s7;
+}
+
+static void SubBytes(uint8_t *s, int n) {       // n <= 32
+    uint32_t q[8];
+    for (int i = 0; i < 8; i++) {
+        uint32_t plane = 0;
+        for (int j = 0; j < n; j++) plane |= (uint32_t)((s[j] >> i) & 1) << j;
+        q[i] = plane;
+    }
+    Sbox(q);
+    for (int j = 0; j < n; j++) {
+        uint8_t b = 0;
+        for (int i = 0; i < 8; i++) b |= ((q[i] >> j) & 1) << i;
+        s[j] = b;
+    }
+}
+
+static uint8_t xtime(uint8_t x) {
+    return (x << 1) ^ (0x1B & -(x >> 7));
+}
+
+static void EncryptSW(const aes_ctx *ctx, const uint8_t *in, uint8_t *out) {
+    uint8_t s[16], t[16];
+    for (int i = 0; i < 16; i++) s[i] = in[i] ^ ctx->rk[0][i];
+    for (int r = 1; r <= AES_ROUNDS; r++) {
+        SubBytes(s, 16);
+        for (int c = 0; c < 4; c++) {   // ShiftRows
+            for (int row = 0; row < 4; row++) {
+                t[row + 4 * c] = s[row + 4 * ((c + row) & 3)];
+            }
+        }
+        if (r < AES_ROUNDS) {           // MixColumns
+            for (int c = 0; c < 16; c += 4) {
+                uint8_t a0 = t[c], a1 = t[c + 1], a2 = t[c + 2], a3 = t[c + 3];
+                uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                t[c]     = a0 ^ all ^ xtime(a0 ^ a1);
+                t[c + 1] = a1 ^ all ^ xtime(a1 ^ a2);
+                t[c + 2] = a2 ^ all ^ xtime(a2 ^ a3);
+                t[c + 3] = a3 ^ all ^ xtime(a3 ^ a0);
+            }
+        }
+        for (int i = 0; i < 16; i++) s[i] = t[i] ^ ctx->rk[r][i];
+    }
+    memcpy(out, s, 16);
+}
+
+// GF(2^128) multiply, bits in GCM order: y = y * h
+static void GhashSW(uint8_t *y, const uint8_t *h) {
+    uint64_t vh = Load64(h), vl = Load64(&h[8]);
+    uint64_t xh = Load64(y), xl = Load64(&y[8]);
+    uint64_t zh = 0, zl = 0;
+    for (int i = 0; i < 128; i++) {
+        uint64_t bit = (i < 64) ? (xh >> (63 - i)) : (xl >> (127 - i));
+        uint64_t m = -(bit & 1);
+        zh ^= vh & m;
+        zl ^= vl & m;
+        m = -(vl & 1);
+        vl = (vl >> 1) | (vh << 63);
+        vh = (vh >> 1) ^ (0xE100000000000000ULL & m);
+    }
+    Store64(y, zh);
+    Store64(&y[8], zl);
+}
+
+// ---------------------------------------------------------------------------
+// AES-NI and PCLMULQDQ
+
+#if (AES_HW)
+__attribute__((target("aes,sse2")))
+static void EncryptHW(const aes_ctx *ctx, const uint8_t *in, uint8_t *out) {
+    __m128i x = _mm_loadu_si128((const __m128i *)in);
+    x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)ctx->rk[0]));
+    for (int r = 1; r < AES_ROUNDS; r++) {
+        x = _mm_aesenc_si128(x, _mm_loadu_si128((const __m128i *)ctx->rk[r]));
+    }
+    x = _mm_aesenclast_si128(x, _mm_loadu_si128((const __m128i *)ctx->rk[AES_ROUNDS]));
+    _mm_storeu_si128((__m128i *)out, x);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static void GhashHW(uint8_t *y, const uint8_t *h) {
+    const __m128i rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                     8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)y), rev);
+    __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)h), rev);
+    __m128i t2, t3, t4, t5, t6, t7, t8, t9;
+    t3 = _mm_clmulepi64_si128(a, b, 0x00);      // 256-bit product
+    t4 = _mm_clmulepi64_si128(a, b, 0x10);
+    t5 = _mm_clmulepi64_si128(a, b, 0x01);
+    t6 = _mm_clmulepi64_si128(a, b, 0x11);
+    t4 = _mm_xor_si128(t4, t5);
+    t5 = _mm_slli_si128(t4, 8);
+    t4 = _mm_srli_si128(t4, 8);
+    t3 = _mm_xor_si128(t3, t5);
+    t6 = _mm_xor_si128(t6, t4);
+    t7 = _mm_srli_epi32(t3, 31);                // shift left by 1 for the
+    t8 = _mm_srli_epi32(t6, 31);                // reflected bit order
+    t3 = _mm_slli_epi32(t3, 1);
+    t6 = _mm_slli_epi32(t6, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    t3 = _mm_or_si128(t3, t7);
+    t6 = _mm_or_si128(t6, t8);
+    t6 = _mm_or_si128(t6, t9);
+    t7 = _mm_slli_epi32(t3, 31);                // reduce modulo
+    t8 = _mm_slli_epi32(t3, 30);                // x^128 + x^7 + x^2 + x + 1
+    t9 = _mm_slli_epi32(t3, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    t3 = _mm_xor_si128(t3, t7);
+    t2 = _mm_srli_epi32(t3, 1);
+    t4 = _mm_srli_epi32(t3, 2);
+    t5 = _mm_srli_epi32(t3, 7);
+    t2 = _mm_xor_si128(t2, t4);
+    t2 = _mm_xor_si128(t2, t5);
+    t2 = _mm_xor_si128(t2, t8);
+    t3 = _mm_xor_si128(t3, t2);
+    t6 = _mm_xor_si128(t6, t3);
+    _mm_storeu_si128((__m128i *)y, _mm_shuffle_epi8(t6, rev));
+}
+
+static int hw = -1;                     // not known yet
+
+int aes_hw(int enable) {
+    hw = 0;
+    if (enable) {
+        __builtin_cpu_init();
+        hw = __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul");
+    }
+    return hw;
+}
+
+#define HW ((hw < 0) ? aes_hw(1) : hw)
+#else
+int aes_hw(int enable) {
+    return 0;
+}
+
+#define HW 0
+#endif
+
+void aes_encrypt(const aes_ctx *ctx, const uint8_t *in, uint8_t *out) {
+#if (AES_HW)
+    if (HW) {
+        EncryptHW(ctx, in, out);
+        return;
+    }
+#endif
+    EncryptSW(ctx, in, out);
+}
+
+void ghash_block(ghash_ctx *ctx, const uint8_t *x) {
+    for (int i = 0; i < 16; i++) ctx->y[i] ^= x[i];
+#if (AES_HW)
+    if (HW) {
+        GhashHW(ctx->y, ctx->h);
+        return;
+    }
+#endif
+    GhashSW(ctx->y, ctx->h);
+}
+
+void aes_init(aes_ctx *ctx, const uint8_t *key) {
+    uint8_t *w = ctx->rk[0];            // 60 words of 4 bytes
+    uint8_t rcon = 1;
+    memcpy(w, key, AES_KEYBYTES);
+    for (int i = 8; i < 4 * (AES_ROUNDS + 1); i++) {
+        uint8_t t[4];
+        memcpy(t, &w[4 * (i - 1)], 4);
+        if ((i & 7) == 0) {             // RotWord, SubWord, Rcon
+            uint8_t t0 = t[0];
+            t[0] = t[1];  t[1] = t[2];  t[2] = t[3];  t[3] = t0;
+            SubBytes(t, 4);
+            t[0] ^= rcon;
+            rcon = xtime(rcon);
+        } else if ((i & 7) == 4) {
+            SubBytes(t, 4);
+        }
+        for (int j = 0; j < 4; j++) w[4 * i + j] = w[4 * (i - 8) + j] ^ t[j];
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void aes_crypt_init(aes_ctx *ctx, const uint8_t *key, const uint8_t *iv, int mode) {
+    aes_init(ctx, key);
+    memcpy(ctx->iv, iv, 16);
+    ctx->block = 0;
+}
+void aes_crypt_init_g(size_t *ctx, const uint8_t *key, const uint8_t *iv, int mode) {
+    aes_crypt_init((void *)ctx, key, iv, mode);
+}
+
+void aes_crypt_block(aes_ctx *ctx, const uint8_t *in, uint8_t *out, int mode) {
+    uint8_t k[16];
+    memcpy(k, ctx->iv, 16);
+    Store32(&k[12], Load32(&k[12]) + ctx->block++);
+    aes_encrypt(ctx, k, k);
+    for (int i = 0; i < 16; i++) out[i] = in[i] ^ k[i];
+}
+void aes_crypt_block_g(size_t *ctx, const uint8_t *in, uint8_t *out, int mode) {
+    aes_crypt_block((void *)ctx, in, out, mode);
+}
+
+void aes_crypt_seek(aes_ctx *ctx, uint32_t block) {
+    ctx->block = block;
+}
+void aes_crypt_seek_g(size_t *ctx, uint32_t block) {
+    aes_crypt_seek((void *)ctx, block);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// Mask for counter 0, from the first block (zero padded if short)
+static void Deferred(ghash_ctx *ctx) {
+    uint8_t n[16];
+    for (int i = 1; i < 16; i++) n[i - 1] = (i < ctx->len) ? ctx->buf[i] : 0;
+    n[15] = 1;                          // apart from counter nonces
+    aes_encrypt(&ctx->aes, n, ctx->mask);
+    ctx->deferred = 0;
+}
+
+int gh_hmac_init(ghash_ctx *ctx, const uint8_t *key, int hsize, uint64_t ctr) {
+    uint8_t n[16];
+    if ((hsize < 1) || (hsize > AES_BLOCKBYTES)) return 0;
+    // mole's KDF uses the context as a BLAKE2s state, which clears keyed
+    if ((ctx->keyed != GH_KEYED) || memcmp(ctx->key, key, AES_KEYBYTES)) {
+        memcpy(ctx->key, key, AES_KEYBYTES);
+        aes_init(&ctx->aes, key);
+        memset(n, 0, 16);
+        aes_encrypt(&ctx->aes, n, ctx->h);
+        ctx->keyed = GH_KEYED;
+    }
+    memset(ctx->y, 0, 16);
+    ctx->bytes = 0;
+    ctx->len = 0;
+    ctx->hsize = hsize;
+    ctx->deferred = (ctr == 0);
+    if (!ctx->deferred) {
+        memset(n, 0, 16);
+        for (int i = 0; i < 8; i++) n[i] = (uint8_t)(ctr >> (8 * i));
+        aes_encrypt(&ctx->aes, n, ctx->mask);
+    }
+    return hsize;
+}
+int gh_hmac_init_g(size_t *ctx, const uint8_t *key, int hsize, uint64_t ctr) {
+    return gh_hmac_init((void *)ctx, key, hsize, ctr);
+}
+
+void gh_hmac_putc(ghash_ctx *ctx, uint8_t c) {
+    ctx->buf[ctx->len++] = c;
+    ctx->bytes++;
+    if (ctx->len == 16) {
+        if (ctx->deferred) Deferred(ctx);
+        ghash_block(ctx, ctx->buf);
+        ctx->len = 0;
+    }
+}
+void gh_hmac_putc_g(size_t *ctx, uint8_t c) {
+    gh_hmac_putc((void *)ctx, c);
+}
+
+int gh_hmac_final(ghash_ctx *ctx, uint8_t *out) {
+    uint8_t b[16];
+    if (ctx->deferred) Deferred(ctx);
+    if (ctx->len) {                     // zero padded last block
+        memset(&ctx->buf[ctx->len], 0, 16 - ctx->len);
+        ghash_block(ctx, ctx->buf);
+    }
+    Store64(b, (uint64_t)ctx->bytes << 3);      // length in bits
+    memset(&b[8], 0, 8);
+    ghash_block(ctx, b);
+    for (int i = 0; i < ctx->hsize; i++) out[i] = ctx->y[i] ^ ctx->mask[i];
+    memset(ctx->y, 0, 16);
+    memset(ctx->mask, 0, 16);
+    memset(ctx->buf, 0, 16);
+    return ctx->hsize;
+}
+int gh_hmac_final_g(size_t *ctx, uint8_t *out) {
+    return gh_hmac_final((void *)ctx, out);
+}
@@ -0,0 +1,135 @@
+/*
+ * AES-256 in counter mode and a GHASH MAC, with the mole cipher and HMAC
+ * function-pointer contract (crypt_initFn ..., hmac_initFn ...).
+ * On x86 the AES-NI and PCLMULQDQ instructions are used when CPUID reports
+ * them. Otherwise a constant-time software version is used: the S-box is a
+ * Boolean circuit evaluated on bit planes and the GF(2^128) multiply uses
+ * masks instead of branches, so there are no secret-dependent table lookups.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _AES_H_
+#define _AES_H_
+
+#define AES_KEYBYTES    32              /* AES-256 */
+#define AES_ROUNDS      14
+#define AES_BLOCKBYTES  16
+
+// x86 hardware support, compiled in where the compiler has the intrinsics
+#ifndef AES_HW
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AES_HW          1
+#else
+#define AES_HW          0
+#endif
+#endif
+
+typedef struct
+{   uint8_t rk[AES_ROUNDS + 1][16];     // round keys
+    uint8_t iv[16];         // counter block of block 0
+    uint32_t block;         // next block
+} aes_ctx;
+
+typedef struct
+{   uint32_t keyed;         // GH_KEYED once key, aes and h are set
+    uint8_t key[32];        // MAC key
+    aes_ctx aes;            // keyed with key
+    uint8_t h[16];          // hash key E(0)
+    uint8_t y[16];          // accumulator
+    uint8_t mask[16];       // E(nonce), added to the tag
+    uint8_t buf[16];        // partial block
+    uint32_t bytes;         // message length
+    uint8_t len;            // bytes in buf
+    uint8_t hsize;          // tag bytes output by gh_hmac_final
+    uint8_t deferred;       // mask waits for the first block, see gh_hmac_init
+} ghash_ctx;
+
+/** Select the implementation
+ * @param enable  0 for software, 1 for AES-NI and PCLMULQDQ if the CPU has them
+ * @return        1 if the hardware is used
+ */
+int aes_hw(int enable);
+
+/** Expand an AES-256 key
+ * @param ctx   AES context
+ * @param key   Key, 32 bytes
+ */
+void aes_init(aes_ctx *ctx, const uint8_t *key);
+
+/** Encrypt one block
+ * @param ctx   AES context
+ * @param in    Plaintext, 16 bytes
+ * @param out   Ciphertext, 16 bytes, may be in
+ */
+void aes_encrypt(const aes_ctx *ctx, const uint8_t *in, uint8_t *out);
+
+/** GHASH step y = (y ^ x) * h in GF(2^128)
+ * @param ctx   GHASH context, h and y are used
+ * @param x     Block, 16 bytes
+ */
+void ghash_block(ghash_ctx *ctx, const uint8_t *x);
+
+/* ------------------------------------------------------------------------- */
+// mole cipher contract: CTR mode, the counter block is the IV with its last
+// 4 bytes, big-endian, advanced by the block number.
+
+/** Encryption/decryption initialization
+ * @param ctx   AES context
+ * @param key   Key, 32 bytes
+ * @param iv    Initialization vector, 16 bytes
+ * @param mode  1 for encryption, 0 for decryption (the same in CTR mode)
+ */
+void aes_crypt_init(aes_ctx *ctx, const uint8_t *key, const uint8_t *iv, int mode);
+void aes_crypt_init_g   (size_t *ctx, const uint8_t *key, const uint8_t *iv, int mode);
+
+/** Encrypt or decrypt a 16-byte block
+ * @param ctx   AES context
+ * @param in    Input block
+ * @param out   Output block, may be in
+ * @param mode  1 for encryption, 0 for decryption
+ */
+void aes_crypt_block(aes_ctx *ctx, const uint8_t *in, uint8_t *out, int mode);
+void aes_crypt_block_g   (size_t *ctx, const uint8_t *in, uint8_t *out, int mode);
+
+/** Seek to a block in the keystream
+ * @param ctx   AES context
+ * @param block Block number
+ */
+void aes_crypt_seek(aes_ctx *ctx, uint32_t block);
+void aes_crypt_seek_g   (size_t *ctx, uint32_t block);
+
+/* ------------------------------------------------------------------------- */
+// mole HMAC contract: tag = GHASH(message, padded, then its bit length)
+// ^ E(nonce), with h = E(0) under the MAC key. The nonce is the counter.
+// Counter 0 is used by every IV_A frame, so there the mask waits for the
+// first 16 bytes of the message and the nonce is bytes 1 to 15 | 1,
+// bytes 1 to 15 being the random IV. The expanded key and h are kept while
+// the key stays the same.
+
+/** MAC initialization
+ * @param ctx   GHASH context
+ * @param key   Key, 32 bytes
+ * @param hsize Expected tag length in bytes, up to 16
+ * @param ctr   Message counter
+ * @return      Actual tag length in bytes (0 if bogus)
+ */
+int gh_hmac_init(ghash_ctx *ctx, const uint8_t *key, int hsize, uint64_t ctr);
+int gh_hmac_init_g    (size_t *ctx, const uint8_t *key, int hsize, uint64_t ctr);
+
+/** MAC append byte
+ * @param ctx   GHASH context
+ * @param c     Byte to add to MAC
+ */
+void gh_hmac_putc(ghash_ctx *ctx, uint8_t c);
+void gh_hmac_putc_g    (size_t *ctx, uint8_t c);
+
+/** MAC finalization
+ * @param ctx   GHASH context
+ * @param out   Output tag, hsize bytes
+ * @return      Tag length in bytes
+ */
+int gh_hmac_final(ghash_ctx *ctx, uint8_t *out);
+int gh_hmac_final_g    (size_t *ctx, uint8_t *out);
+
+#endif /* _AES_H_ */
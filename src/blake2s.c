@@ -222,3 +222,36 @@ int b2s_hmac_init(blake2s_state *S, const uint8_t *key, int hsize, uint64_t ctr)
 int b2s_hmac_init_g(size_t *S, const uint8_t *key, int hsize, uint64_t ctr) {
   return b2s_hmac_init((void *)S, key, hsize, ctr);
 }
+
+#define B2S_KEYED 0x42324B59
+
+int b2s_keyed_init(blake2s_keyed *K, const uint8_t *key, int hsize, uint64_t ctr)
+{
+  blake2s_state *S = &K->S;
+  if ( ( !hsize ) || ( hsize > BLAKE2S_OUTBYTES ) ) return 0;
+
+  // mole's KDF uses the context as a BLAKE2s state, which leaves keyed alone
+  if ( ( K->keyed != B2S_KEYED ) || ( K->hsize != hsize )
+    || memcmp( K->key, key, BLAKE2S_KEYBYTES ) ) {
+    b2s_hmac_init( S, key, hsize, 0 );
+    blake2s_increment_counter( S, BLAKE2S_BLOCKBYTES );
+    blake2s_compress( S, S->buf );        /* the key block */
+    secure_zero_memory( S->buf, BLAKE2S_BLOCKBYTES );
+    memcpy( K->h, S->h, sizeof( K->h ) );
+    memcpy( K->key, key, BLAKE2S_KEYBYTES );
+    K->hsize = (uint8_t)hsize;
+    K->keyed = B2S_KEYED;
+  }
+  memcpy( S->h, K->h, sizeof( S->h ) );
+  S->t[0] = BLAKE2S_BLOCKBYTES;
+  S->t[1] = 0;
+  S->f[0] = S->f[1] = 0;
+  S->outlen = hsize;
+  S->last_node = 0;
+  for( int i = 0; i < 8; ++i ) S->buf[i] = (uint8_t)( ctr >> ( 8 * i ) );
+  S->buflen = 8;
+  return hsize;
+}
+int b2s_keyed_init_g(size_t *K, const uint8_t *key, int hsize, uint64_t ctr) {
+  return b2s_keyed_init((void *)K, key, hsize, ctr);
+}
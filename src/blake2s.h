@@ -100,6 +100,28 @@ int b2s_hmac_final_g     (size_t *S, uint8_t *out);
 // b2s_hmac_putc for byte array
 int b2s_hmac_puts( blake2s_state *S, const uint8_t *pin, int inlen );
 
+  /* Keyed BLAKE2s of the counter (8 bytes, little-endian) followed by the
+     message. The state after the key block is kept while the key stays the
+     same, so starting a message is a copy instead of a compression. */
+  typedef struct blake2s_keyed__
+  {
+    blake2s_state S;    /* first: b2s_hmac_putc and b2s_hmac_final work on it */
+    uint32_t keyed;     /* B2S_KEYED once h and key are set */
+    uint32_t h[8];      /* chaining value after the key block */
+    uint8_t  key[BLAKE2S_KEYBYTES];
+    uint8_t  hsize;
+  } blake2s_keyed;
+
+/** HMAC initialization from the keyed midstate
+ * @param ctx   HMAC context
+ * @param key   Key, 32 bytes
+ * @param hsize Expected hash length in bytes
+ * @param ctr   Message counter
+ * @return      Actual hash length in bytes (0 if bogus)
+ */
+int b2s_keyed_init(blake2s_keyed *K, const uint8_t *key, int hsize, uint64_t ctr);
+int b2s_keyed_init_g     (size_t *K, const uint8_t *key, int hsize, uint64_t ctr);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -0,0 +1,260 @@
+/*
+ * BLAKE3, see blake3.h
+ * The chunk and tree logic follows reference_impl.rs (public domain): a
+ * finished chunk is added to the tree only when more input arrives, so the
+ * last chunk is always in the state when b3_final makes the root.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "blake3.h"
+
+#define CHUNK_START     1
+#define CHUNK_END       2
+#define PARENT          4
+#define ROOT            8
+#define KEYED_HASH     16
+
+static const uint32_t IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+// Message word order of each round: the permutation applied r times
+static const uint8_t schedule[7][16] = {
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    { 2,  6,  3, 10,  7,  0,  4, 13,  1, 11, 12,  5,  9, 14, 15,  8},
+    { 3,  4, 10, 12, 13,  2,  7, 14,  6,  5,  9,  0, 11, 15,  8,  1},
+    {10,  7, 12,  9, 14,  3, 13, 15,  4,  0, 11,  2,  5,  8,  1,  6},
+    {12, 13,  9, 11, 15, 10, 14,  8,  7,  2,  5,  3,  0,  1,  6,  4},
+    { 9, 14, 11,  5,  8, 12, 15,  1, 13,  3,  0, 10,  2,  6,  4,  7},
+    {11, 15,  5,  0,  1,  9,  8,  6, 14, 10,  2, 12,  3,  4,  7, 13},
+};
+
+static uint32_t u8tou32(const uint8_t *p) {
+    return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8)
+         | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void u32tou8(uint8_t *p, uint32_t v) {
+    p[0] = v;  p[1] = v >> 8;  p[2] = v >> 16;  p[3] = v >> 24;
+}
+
+// The same for 32-bit words and for vectors of them
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define G(a, b, c, d, x, y) {                                   \
+    v[a] += v[b] + (x);  v[d] = ROTR(v[d] ^ v[a], 16);          \
+    v[c] += v[d];        v[b] = ROTR(v[b] ^ v[c], 12);          \
+    v[a] += v[b] + (y);  v[d] = ROTR(v[d] ^ v[a], 8);           \
+    v[c] += v[d];        v[b] = ROTR(v[b] ^ v[c], 7);  }
+#define ROUNDS(m) for (int r = 0; r < 7; r++) {                 \
+    const uint8_t *s = schedule[r];                             \
+    G(0, 4,  8, 12, m[s[ 0]], m[s[ 1]]);                        \
+    G(1, 5,  9, 13, m[s[ 2]], m[s[ 3]]);                        \
+    G(2, 6, 10, 14, m[s[ 4]], m[s[ 5]]);                        \
+    G(3, 7, 11, 15, m[s[ 6]], m[s[ 7]]);                        \
+    G(0, 5, 10, 15, m[s[ 8]], m[s[ 9]]);                        \
+    G(1, 6, 11, 12, m[s[10]], m[s[11]]);                        \
+    G(2, 7,  8, 13, m[s[12]], m[s[13]]);                        \
+    G(3, 4,  9, 14, m[s[14]], m[s[15]]);  }
+
+// Compress one block, out gets 16 words (8 if only the chaining value is used)
+static void Compress(const uint32_t cv[8], const uint8_t *block, uint64_t counter,
+                     uint32_t len, uint32_t flags, uint32_t out[16]) {
+    uint32_t m[16], v[16];
+    for (int i = 0; i < 16; i++) m[i] = u8tou32(&block[4 * i]);
+    for (int i = 0; i < 8; i++) v[i] = cv[i];
+    for (int i = 0; i < 4; i++) v[8 + i] = IV[i];
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = len;
+    v[15] = flags;
+    ROUNDS(m)
+    for (int i = 0; i < 8; i++) {
+        out[i + 8] = v[i + 8] ^ cv[i];
+        out[i] = v[i] ^ v[i + 8];
+    }
+}
+
+static uint32_t StartFlag(const blake3_state *S) {
+    return S->blocks ? 0 : CHUNK_START;
+}
+
+// Add the chaining value of a finished chunk to the tree, merging the
+// subtrees it completes (one per trailing zero bit of the chunk count)
+static void AddChunk(blake3_state *S, const uint32_t cv[8]) {
+    uint32_t x[16];
+    uint8_t block[B3_BLOCKBYTES];
+    memcpy(x, cv, 32);
+    uint64_t total = ++S->chunk;
+    while (!(total & 1)) {
+        S->depth--;
+        for (int i = 0; i < 8; i++) {
+            u32tou8(&block[4 * i], S->stack[S->depth][i]);
+            u32tou8(&block[32 + 4 * i], x[i]);
+        }
+        Compress(S->key, block, 0, B3_BLOCKBYTES, S->flags | PARENT, x);
+        total >>= 1;
+    }
+    if (S->depth < B3_MAX_DEPTH) {      // beyond that the hash is wrong
+        memcpy(S->stack[S->depth++], x, 32);
+    }
+}
+
+// Compress the full block now that more input follows
+static void Flush(blake3_state *S) {
+    uint32_t out[16];
+    if (S->blocks == (B3_CHUNKBYTES / B3_BLOCKBYTES - 1)) {
+        Compress(S->cv, S->block, S->chunk, B3_BLOCKBYTES,
+                 S->flags | CHUNK_END, out);
+        AddChunk(S, out);
+        memcpy(S->cv, S->key, 32);
+        S->blocks = 0;
+    } else {
+        Compress(S->cv, S->block, S->chunk, B3_BLOCKBYTES,
+                 S->flags | StartFlag(S), out);
+        memcpy(S->cv, out, 32);
+        S->blocks++;
+    }
+    S->blockLen = 0;
+}
+
+#if (B3_LANES > 1)
+typedef uint32_t lanes_t __attribute__((vector_size(4 * B3_LANES)));
+
+// Hash B3_LANES whole chunks side by side, lane l gets chunk l
+static void Chunks(blake3_state *S, const uint8_t *in) {
+    lanes_t h[8], m[16], v[16];
+    uint32_t cv[8];
+    for (int i = 0; i < 8; i++) {
+        for (int l = 0; l < B3_LANES; l++) h[i][l] = S->key[i];
+    }
+    for (int b = 0; b < (B3_CHUNKBYTES / B3_BLOCKBYTES); b++) {
+        uint32_t flags = S->flags;
+        if (b == 0) flags |= CHUNK_START;
+        if (b == (B3_CHUNKBYTES / B3_BLOCKBYTES - 1)) flags |= CHUNK_END;
+        for (int l = 0; l < B3_LANES; l++) {
+            const uint8_t *p = &in[l * B3_CHUNKBYTES + b * B3_BLOCKBYTES];
+            for (int i = 0; i < 16; i++) m[i][l] = u8tou32(&p[4 * i]);
+            uint64_t counter = S->chunk + l;
+            v[12][l] = (uint32_t)counter;
+            v[13][l] = (uint32_t)(counter >> 32);
+            v[14][l] = B3_BLOCKBYTES;
+            v[15][l] = flags;
+        }
+        for (int i = 0; i < 8; i++) v[i] = h[i];
+        for (int i = 0; i < 4; i++) {
+            for (int l = 0; l < B3_LANES; l++) v[8 + i][l] = IV[i];
+        }
+        ROUNDS(m)
+        for (int i = 0; i < 8; i++) h[i] = v[i] ^ v[i + 8];
+    }
+    for (int l = 0; l < B3_LANES; l++) {
+        for (int i = 0; i < 8; i++) cv[i] = h[i][l];
+        AddChunk(S, cv);
+    }
+}
+#endif
+
+static void Init(blake3_state *S, const uint32_t key[8], uint8_t flags) {
+    memset(S, 0, sizeof(blake3_state));
+    memcpy(S->key, key, 32);
+    memcpy(S->cv, key, 32);
+    S->flags = flags;
+    S->hsize = B3_OUTBYTES;
+}
+
+void b3_init(blake3_state *S) {
+    Init(S, IV, 0);
+}
+
+void b3_init_keyed(blake3_state *S, const uint8_t *key) {
+    uint32_t k[8];
+    for (int i = 0; i < 8; i++) k[i] = u8tou32(&key[4 * i]);
+    Init(S, k, KEYED_HASH);
+    memset(k, 0, sizeof(k));
+}
+
+void b3_putc(blake3_state *S, uint8_t c) {
+    if (S->blockLen == B3_BLOCKBYTES) Flush(S);
+    S->block[S->blockLen++] = c;
+}
+
+void b3_puts(blake3_state *S, const uint8_t *in, size_t len) {
+    while (len) {
+        if (S->blockLen == B3_BLOCKBYTES) Flush(S);
+#if (B3_LANES > 1)
+        if (!S->blocks && !S->blockLen && (len > B3_LANES * B3_CHUNKBYTES)) {
+            Chunks(S, in);              // the last chunk stays in the state
+            in += B3_LANES * B3_CHUNKBYTES;
+            len -= B3_LANES * B3_CHUNKBYTES;
+            continue;
+        }
+#endif
+        size_t n = B3_BLOCKBYTES - S->blockLen;
+        if (n > len) n = len;
+        memcpy(&S->block[S->blockLen], in, n);
+        S->blockLen += n;
+        in += n;
+        len -= n;
+    }
+}
+
+void b3_final(const blake3_state *S, uint8_t *out, int len) {
+    uint32_t x[16];
+    uint8_t block[B3_BLOCKBYTES];
+    int depth = S->depth;
+    memset(block, 0, sizeof(block));
+    memcpy(block, S->block, S->blockLen);
+    uint32_t flags = S->flags | StartFlag(S) | CHUNK_END;
+    if (!depth) flags |= ROOT;
+    Compress(S->cv, block, S->chunk, S->blockLen, flags, x);
+    while (depth--) {
+        for (int i = 0; i < 8; i++) {
+            u32tou8(&block[4 * i], S->stack[depth][i]);
+            u32tou8(&block[32 + 4 * i], x[i]);
+        }
+        flags = S->flags | PARENT;
+        if (!depth) flags |= ROOT;
+        Compress(S->key, block, 0, B3_BLOCKBYTES, flags, x);
+    }
+    for (int i = 0; i < len; i++) out[i] = (uint8_t)(x[i / 4] >> (8 * (i & 3)));
+    memset(x, 0, sizeof(x));
+}
+
+/* ------------------------------------------------------------------------- */
+
+int b3_hmac_init(blake3_state *S, const uint8_t *key, int hsize, uint64_t ctr) {
+    if ((hsize < 1) || (hsize > B3_OUTBYTES)) return 0;
+    b3_init_keyed(S, key);
+    S->hsize = hsize;
+    for (int i = 0; i < 8; i++) b3_putc(S, (uint8_t)(ctr >> (8 * i)));
+    return hsize;
+}
+int b3_hmac_init_g(size_t *S, const uint8_t *key, int hsize, uint64_t ctr) {
+    return b3_hmac_init((void *)S, key, hsize, ctr);
+}
+
+void b3_hmac_putc(blake3_state *S, uint8_t c) {
+    b3_putc(S, c);
+}
+void b3_hmac_putc_g(size_t *S, uint8_t c) {
+    b3_putc((void *)S, c);
+}
+
+void b3_hmac_puts(blake3_state *S, const uint8_t *in, int len) {
+    b3_puts(S, in, (size_t)len);
+}
+void b3_hmac_puts_g(size_t *S, const uint8_t *in, int len) {
+    b3_puts((void *)S, in, (size_t)len);
+}
+
+int b3_hmac_final(blake3_state *S, uint8_t *out) {
+    int hsize = S->hsize;
+    b3_final(S, out, hsize);
+    memset(S, 0, sizeof(blake3_state));
+    return hsize;
+}
+int b3_hmac_final_g(size_t *S, uint8_t *out) {
+    return b3_hmac_final((void *)S, out);
+}
@@ -0,0 +1,116 @@
+/*
+ * BLAKE3 hash and keyed hash, after the BLAKE3 reference implementation
+ * (public domain, Jack O'Connor et al.), with the mole HMAC contract.
+ * Input is split into 1 KB chunks that are hashed independently and
+ * combined in a binary tree. b3_puts hashes runs of whole chunks
+ * B3_LANES at a time, one chunk per SIMD lane.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _BLAKE3_H_
+#define _BLAKE3_H_
+
+#define B3_KEYBYTES     32
+#define B3_OUTBYTES     32
+#define B3_BLOCKBYTES   64
+#define B3_CHUNKBYTES 1024
+
+// Chaining values kept for the tree: the input may be up to 2^B3_MAX_DEPTH
+// chunks long. Each level costs 32 bytes of context.
+#ifndef B3_MAX_DEPTH
+#define B3_MAX_DEPTH    20              /* 1 GB */
+#endif
+
+// Chunks compressed side by side by b3_puts, using GCC vector extensions
+// (SSE2 or NEON). 1 compresses one chunk at a time.
+#ifndef B3_LANES
+#if defined(__GNUC__)
+#define B3_LANES        4
+#else
+#define B3_LANES        1
+#endif
+#endif
+
+typedef struct
+{   uint32_t key[8];        // key words, or the IV
+    uint32_t cv[8];         // chaining value of the current chunk
+    uint64_t chunk;         // chunk counter
+    uint8_t block[B3_BLOCKBYTES];
+    uint8_t blockLen;       // bytes in block
+    uint8_t blocks;         // blocks compressed in the current chunk
+    uint8_t flags;          // KEYED_HASH or 0
+    uint8_t depth;          // chaining values in stack
+    uint8_t hsize;          // output bytes
+    uint32_t stack[B3_MAX_DEPTH][8];
+} blake3_state;
+
+/** Start an unkeyed hash
+ * @param S     BLAKE3 state
+ */
+void b3_init(blake3_state *S);
+
+/** Start a keyed hash
+ * @param S     BLAKE3 state
+ * @param key   Key, 32 bytes
+ */
+void b3_init_keyed(blake3_state *S, const uint8_t *key);
+
+/** Add a byte
+ * @param S     BLAKE3 state
+ * @param c     Byte
+ */
+void b3_putc(blake3_state *S, uint8_t c);
+
+/** Add bytes, whole chunks are hashed B3_LANES at a time
+ * @param S     BLAKE3 state
+ * @param in    Bytes
+ * @param len   Length in bytes
+ */
+void b3_puts(blake3_state *S, const uint8_t *in, size_t len);
+
+/** Output the hash, the state is not changed
+ * @param S     BLAKE3 state
+ * @param out   Output
+ * @param len   Output length in bytes, up to 64
+ */
+void b3_final(const blake3_state *S, uint8_t *out, int len);
+
+/* ------------------------------------------------------------------------- */
+// mole HMAC contract: keyed BLAKE3 of the counter (8 bytes, little-endian)
+// followed by the message.
+
+/** HMAC initialization
+ * @param S     BLAKE3 state
+ * @param key   Key, 32 bytes
+ * @param hsize Expected hash length in bytes, up to 32
+ * @param ctr   Message counter
+ * @return      Actual hash length in bytes (0 if bogus)
+ */
+int b3_hmac_init(blake3_state *S, const uint8_t *key, int hsize, uint64_t ctr);
+int b3_hmac_init_g     (size_t *S, const uint8_t *key, int hsize, uint64_t ctr);
+
+/** HMAC append byte
+ * @param S     BLAKE3 state
+ * @param c     Byte to add to HMAC
+ */
+void b3_hmac_putc(blake3_state *S, uint8_t c);
+void b3_hmac_putc_g     (size_t *S, uint8_t c);
+
+/** HMAC append bytes, through b3_puts
+ * @param S     BLAKE3 state
+ * @param in    Bytes to add to HMAC
+ * @param len   Length in bytes
+ */
+void b3_hmac_puts(blake3_state *S, const uint8_t *in, int len);
+void b3_hmac_puts_g     (size_t *S, const uint8_t *in, int len);
+
+/** HMAC finalization
+ * @param S     BLAKE3 state
+ * @param out   Output hash, hsize bytes
+ * @return      Hash length in bytes
+ */
+int b3_hmac_final(blake3_state *S, uint8_t *out);
+int b3_hmac_final_g     (size_t *S, uint8_t *out);
+
+#endif /* _BLAKE3_H_ */
@@ -0,0 +1,80 @@
+/*
+ * Lock-free SPSC byte FIFO, see fifo.h
+ * A producer stores the data before it moves head, a consumer reads it before
+ * it moves tail. BARRIER keeps those in order: a compiler barrier is enough
+ * on a single-core MCU, a multi-core host also needs a memory fence.
+ */
+#include <stdint.h>
+#include "fifo.h"
+
+#if defined(__GNUC__)
+#define BARRIER() __sync_synchronize()
+#else
+#define BARRIER() do { } while (0)      /* volatile head and tail */
+#endif
+
+int fifo_init(fifo_ctx *f, uint8_t *buf, int size) {
+    if ((size < 1) || (size > FIFO_MAX_SIZE) || (size & (size - 1))) return -1;
+    f->buf = buf;
+    f->mask = size - 1;
+    f->head = 0;
+    f->tail = 0;
+    return 0;
+}
+
+int fifo_used(const fifo_ctx *f) {
+    return (uint16_t)(f->head - f->tail);
+}
+
+int fifo_room(const fifo_ctx *f) {
+    return f->mask + 1 - fifo_used(f);
+}
+
+int fifo_put(fifo_ctx *f, uint8_t c) {
+    uint16_t head = f->head;
+    if ((uint16_t)(head - f->tail) > f->mask) return -1;
+    f->buf[head & f->mask] = c;
+    BARRIER();
+    f->head = head + 1;
+    return 0;
+}
+
+int fifo_get(fifo_ctx *f) {
+    uint16_t tail = f->tail;
+    if (tail == f->head) return -1;
+    BARRIER();
+    uint8_t c = f->buf[tail & f->mask];
+    BARRIER();
+    f->tail = tail + 1;
+    return c;
+}
+
+int fifo_reserve(fifo_ctx *f, uint8_t **p) {
+    uint16_t head = f->head;
+    int i = head & f->mask;
+    int n = fifo_room(f);
+    if (n > (f->mask + 1 - i)) n = f->mask + 1 - i; // up to the end of buf
+    BARRIER();
+    *p = &f->buf[i];
+    return n;
+}
+
+void fifo_commit(fifo_ctx *f, int n) {
+    BARRIER();
+    f->head += n;
+}
+
+int fifo_peek(fifo_ctx *f, const uint8_t **p) {
+    uint16_t tail = f->tail;
+    int i = tail & f->mask;
+    int n = fifo_used(f);
+    if (n > (f->mask + 1 - i)) n = f->mask + 1 - i;
+    BARRIER();
+    *p = &f->buf[i];
+    return n;
+}
+
+void fifo_drop(fifo_ctx *f, int n) {
+    BARRIER();
+    f->tail += n;
+}
@@ -0,0 +1,84 @@
+/*
+ * Lock-free single-producer, single-consumer byte FIFO
+ * The size is a power of 2. head and tail count bytes in and out and wrap
+ * at 2^16, so the FIFO holds up to size bytes. Only the producer writes
+ * head and only the consumer writes tail, so an ISR can be either end
+ * without disabling interrupts. 16-bit loads and stores must be atomic,
+ * as they are on 16- and 32-bit MCUs.
+ */
+#include <stdint.h>
+
+#ifndef _FIFO_H_
+#define _FIFO_H_
+
+#define FIFO_MAX_SIZE 32768
+
+typedef struct {
+    uint8_t *buf;
+    uint16_t mask;                  // size - 1
+    volatile uint16_t head;         // bytes put, written by the producer
+    volatile uint16_t tail;         // bytes got, written by the consumer
+} fifo_ctx;
+
+/** Initialize an empty FIFO
+ * @param f      FIFO
+ * @param buf    Storage, size bytes
+ * @param size   Power of 2, up to FIFO_MAX_SIZE
+ * @return       0 if okay, -1 if size is bad
+ */
+int fifo_init(fifo_ctx *f, uint8_t *buf, int size);
+
+/** Bytes in the FIFO, for the consumer
+ * @param f      FIFO
+ * @return       Bytes that fifo_get can get
+ */
+int fifo_used(const fifo_ctx *f);
+
+/** Free space, for the producer
+ * @param f      FIFO
+ * @return       Bytes that fifo_put can put
+ */
+int fifo_room(const fifo_ctx *f);
+
+/** Put a byte (producer)
+ * @param f      FIFO
+ * @param c      Byte
+ * @return       0 if okay, -1 if full
+ */
+int fifo_put(fifo_ctx *f, uint8_t c);
+
+/** Get a byte (consumer)
+ * @param f      FIFO
+ * @return       Byte, -1 if empty
+ */
+int fifo_get(fifo_ctx *f);
+
+/** Bulk input without a copy (producer): get the free space up to the end
+ *  of buf, write to it, then fifo_commit what was written.
+ * @param f      FIFO
+ * @param p      Set to where the free space starts
+ * @return       Contiguous free bytes
+ */
+int fifo_reserve(fifo_ctx *f, uint8_t **p);
+
+/** Add bytes written after fifo_reserve (producer)
+ * @param f      FIFO
+ * @param n      Bytes, up to what fifo_reserve returned
+ */
+void fifo_commit(fifo_ctx *f, int n);
+
+/** Bulk output without a copy (consumer): get the bytes up to the end of
+ *  buf, use them, then fifo_drop what was used.
+ * @param f      FIFO
+ * @param p      Set to the oldest byte
+ * @return       Contiguous bytes
+ */
+int fifo_peek(fifo_ctx *f, const uint8_t **p);
+
+/** Remove bytes used after fifo_peek (consumer)
+ * @param f      FIFO
+ * @param n      Bytes, up to what fifo_peek returned
+ */
+void fifo_drop(fifo_ctx *f, int n);
+
+#endif /* _FIFO_H_ */
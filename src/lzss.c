@@ -0,0 +1,139 @@
+/*
+ * LZSS compression for small targets, see lzss.h for the format
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "lzss.h"
+
+void lz_enc_init(lz_enc *enc) {
+    enc->group[0] = 0;
+    enc->n = 1;
+    enc->tokens = 0;
+}
+
+static int Token(lz_enc *enc, lz_putFn out, void *arg) {
+    int n = 0;
+    if (++enc->tokens == 8) n = lz_flush(enc, 0, out, arg);
+    return n;
+}
+
+int lz_flush(lz_enc *enc, int end, lz_putFn out, void *arg) {
+    int n;
+    if (end) {                          // a match with dist 0
+        enc->group[0] |= 1 << enc->tokens;
+        enc->group[enc->n++] = 0;
+        enc->group[enc->n++] = 0;
+        enc->tokens++;
+    }
+    if (!enc->tokens) return 0;
+    n = enc->n;
+    if (out != NULL) for (int i = 0; i < n; i++) out(arg, enc->group[i]);
+    lz_enc_init(enc);
+    return n;
+}
+
+int lz_encode(lz_enc *enc, const uint8_t *src, int len, int history,
+              int window, lz_putFn out, void *arg) {
+    int total = 0, i = 0;
+    uint8_t *g = enc->group;
+    if (window > LZ_MAX_WINDOW) window = LZ_MAX_WINDOW;
+    while (i < len) {
+        int best = 0, dist = 0;
+        int lo = ((i + history) > window) ? (i - window) : -history;
+        int most = len - i;
+        if (most > LZ_MAX_MATCH) most = LZ_MAX_MATCH;
+        if (most >= LZ_MIN_MATCH) {
+            for (int j = i - 1; j >= lo; j--) { // nearest first
+                if ((src[j] != src[i]) || (src[j + best] != src[i + best])) {
+                    continue;
+                }
+                int k = 1;
+                while ((k < most) && (src[j + k] == src[i + k])) k++;
+                if (k > best) {
+                    best = k;
+                    dist = i - j;
+                    if (k == most) break;
+                }
+            }
+        }
+        if (best >= LZ_MIN_MATCH) {
+            int code = best - LZ_MIN_MATCH;
+            g[0] |= 1 << enc->tokens;
+            g[enc->n++] = (uint8_t)(dist >> 4);
+            g[enc->n++] = (uint8_t)((dist << 4) | ((code < 15) ? code : 15));
+            if (code >= 15) g[enc->n++] = (uint8_t)(code - 15);
+            i += best;
+        } else {
+            g[enc->n++] = src[i++];
+        }
+        total += Token(enc, out, arg);
+    }
+    return total;
+}
+
+void lz_dec_init(lz_dec *dec, uint8_t *hist, int size, lz_outFn out) {
+    dec->hist = hist;
+    dec->size = size;
+    dec->pos = 0;
+    dec->count = 0;
+    dec->out = out;
+    dec->state = LZ_FLAGS;
+}
+
+static void Emit(lz_dec *dec, uint8_t c) {
+    dec->hist[dec->pos] = c;
+    if (++dec->pos == dec->size) dec->pos = 0;
+    dec->count++;
+    if (dec->out != NULL) dec->out(c);
+}
+
+static void Copy(lz_dec *dec, int len) {
+    int s = dec->pos - dec->dist;
+    if (s < 0) s += dec->size;
+    while (len--) {
+        Emit(dec, dec->hist[s]);
+        if (++s == dec->size) s = 0;
+    }
+}
+
+int lz_dec_putc(lz_dec *dec, uint8_t c) {
+    switch (dec->state) {
+    case LZ_FLAGS:
+        dec->flags = c;
+        dec->tokens = 8;
+        dec->state = LZ_TOKEN;
+        return 0;
+    case LZ_TOKEN:
+        if (dec->flags & 1) {
+            dec->b0 = c;
+            dec->state = LZ_DIST;
+            return 0;
+        }
+        Emit(dec, c);
+        break;
+    case LZ_DIST:
+        dec->dist = (dec->b0 << 4) | (c >> 4);
+        if (dec->dist == 0) {
+            dec->state = LZ_DONE;
+            return 1;
+        }
+        if ((dec->dist > dec->size) || (dec->dist > dec->count)) {
+            dec->state = LZ_DONE;
+            return -1;
+        }
+        if ((c & 0x0F) == 15) {
+            dec->state = LZ_EXT;
+            return 0;
+        }
+        Copy(dec, (c & 0x0F) + LZ_MIN_MATCH);
+        break;
+    case LZ_EXT:
+        Copy(dec, c + 15 + LZ_MIN_MATCH);
+        break;
+    default:
+        return 1;
+    }
+    dec->flags >>= 1;
+    dec->state = (--dec->tokens) ? LZ_TOKEN : LZ_FLAGS;
+    return 0;
+}
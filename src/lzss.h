@@ -0,0 +1,97 @@
+/*
+ * LZSS compression for small targets
+ * Byte-aligned tokens in groups of eight, each group led by a flag byte:
+ * bit i (LSB first) set means token i is a match, otherwise a literal byte.
+ * Match: dist[12] len[4], big-endian, len 3..17, len 15 adds a byte (18..273).
+ * A match with dist 0 ends the stream.
+ * The encoder searches the source buffer itself and needs no RAM. The decoder
+ * keeps a history buffer at least as large as the encoder's window.
+ */
+#include <stdint.h>
+
+#ifndef _LZSS_H_
+#define _LZSS_H_
+
+#define LZ_MIN_MATCH    3
+#define LZ_MAX_MATCH  273
+#define LZ_MAX_WINDOW 4095
+
+typedef void (*lz_outFn)(uint8_t c);              // decoded byte
+typedef void (*lz_putFn)(void *arg, uint8_t c);   // compressed byte
+
+enum lzStates {
+  LZ_FLAGS = 0,
+  LZ_TOKEN,
+  LZ_DIST,
+  LZ_EXT,
+  LZ_DONE
+};
+
+/** lz_enc holds the group of tokens being built
+ */
+typedef struct {
+    uint8_t group[1 + 8 * 3];       // flags, up to 8 three-byte tokens
+    uint8_t n;                      // bytes in group
+    uint8_t tokens;                 // tokens in group
+} lz_enc;
+
+/** lz_dec holds the state of a streaming decoder
+ */
+typedef struct {
+    uint8_t *hist;                  // history, also the output if not wrapped
+    uint16_t size;                  // history size in bytes
+    uint16_t pos;                   // next position in hist
+    uint32_t count;                 // bytes decoded
+    lz_outFn out;                   // decoded byte output, NULL if none
+    uint16_t dist;                  // match distance
+    uint8_t flags;                  // token flags of the group
+    uint8_t tokens;                 // tokens left in the group
+    uint8_t b0;                     // first byte of a match
+    enum lzStates state;
+} lz_dec;
+
+/** Initialize an encoder
+ * @param enc    Encoder context
+ */
+void lz_enc_init(lz_enc *enc);
+
+/** Compress a buffer. The output continues the stream, the last group is
+ *  held for lz_flush.
+ * @param enc     Encoder context
+ * @param src     Input data
+ * @param len     Input length
+ * @param history Bytes before src, already compressed, that may be matched
+ * @param window  Search window, up to LZ_MAX_WINDOW. Speed is O(len*window).
+ * @param out     Output function, NULL to only count bytes
+ * @param arg     Passed to out, such as the port the output goes to
+ * @return Bytes output
+ */
+int lz_encode(lz_enc *enc, const uint8_t *src, int len, int history,
+              int window, lz_putFn out, void *arg);
+
+/** Output the last group, with an end-of-stream marker if asked.
+ *  The marker is needed if the stream length is not known to the decoder.
+ * @param enc    Encoder context
+ * @param end    Nonzero to add the marker
+ * @param out    Output function, NULL to only count bytes
+ * @param arg    Passed to out
+ * @return Bytes output
+ */
+int lz_flush(lz_enc *enc, int end, lz_putFn out, void *arg);
+
+/** Initialize a decoder
+ * @param dec    Decoder context
+ * @param hist   History buffer
+ * @param size   History size, at least the encoder's window
+ * @param out    Decoded byte output, NULL if only hist is used
+ */
+void lz_dec_init(lz_dec *dec, uint8_t *hist, int size, lz_outFn out);
+
+/** Decode one byte of compressed data
+ * @param dec    Decoder context
+ * @param c      Compressed byte
+ * @return 0 if okay, 1 after the end marker, -1 if the data is bad
+ */
+int lz_dec_putc(lz_dec *dec, uint8_t c);
+
+#endif /* _LZSS_H_ */
@@ -7,42 +7,106 @@ AEAD-secured ports (for UARTs, etc.)
 #include <string.h>
 #include "xchacha.h"
 #include "blake2s.h"
+#include "poly1305.h"
+#include "aes.h"
+#include "blake3.h"
 #include "mole.h"
 #include "moleconfig.h"
 
 #define ALLOC_HEADROOM (MOLE_ALLOC_MEM_UINT32S - allocated_uint32s)
 
-#ifndef MOLE_TRACE
-#define MOLE_TRACE 0
-#endif
+// Tracing writes binary records to the port's ring, see moletrace.h.
+// TRACE events are level 1, TRACE2 events and DUMP data are level 2.
 
 #if (MOLE_TRACE)
-#include <stdio.h>
-static void DUMP(const uint8_t *src, uint8_t len) {
-    if (MOLE_TRACE > 1) {
-        for (uint8_t i = 0; i < len; i++) {
-            if ((i % 32) == 0) printf("\n___");
-            printf("%02X ", src[i]);
-        }
-        printf("<- ");
+#include "moletrace.h"
+static uint8_t portCount;               // ports added, to number them
+
+static void Trace(port_ctx *ctx, uint8_t event, uint32_t a, uint32_t b) {
+    mole_trace *t = &ctx->trace;
+    mole_trace_rec *rec = &t->rec[t->head & (MOLE_TRACE_RECORDS - 1)];
+    rec->event = event;
+    rec->port = t->port;
+    rec->counter = (uint16_t)ctx->counter;
+    rec->arg[0] = a;
+    rec->arg[1] = b;
+    t->head++;                          // publish after the record is written
+}
+
+static void Dump(port_ctx *ctx, const uint8_t *src, int len) {
+    if (MOLE_TRACE > 1) for (int i = 0; i < len; i += 8) {
+        uint32_t a[2] = {0, 0};
+        memcpy(a, &src[i], ((len - i) < 8) ? (len - i) : 8);
+        Trace(ctx, MOLE_TR_DATA, a[0], a[1]);
     }
 }
-#define PRINTF  if (MOLE_TRACE > 1) printf
-#define PRINTf  printf
+#define TRACE(ev, a, b)  Trace(ctx, ev, a, b)
+#define TRACE2(ev, a, b) do {if (MOLE_TRACE > 1) Trace(ctx, ev, a, b);} while (0)
+#define DUMP(src, len)   Dump(ctx, (const uint8_t *)(src), len)
 #else
-static void DUMP(const uint8_t *src, uint8_t len) {}
-#define PRINTF(...) do { } while (0)
-#define PRINTf PRINTF
+#define TRACE(ev, a, b)  do { } while (0)
+#define TRACE2(ev, a, b) do { } while (0)
+#define DUMP(src, len)   do { } while (0)
+#endif
+
+#if (MOLE_TIMING)
+static void Timed(port_ctx *ctx, int stage, uint32_t ticks) {
+    int b = 0;
+    while (ticks) {
+        b++;
+        ticks >>= 1;
+    }
+    if (b >= MOLE_HIST_BUCKETS) b = MOLE_HIST_BUCKETS - 1;
+    ctx->timing.hist[stage][b]++;
+}
+#define STAMP(t)             uint32_t t = moleClock()
+#define TIMED(stage, t)      Timed(ctx, stage, moleClock() - (t))
+#define FRAME_START          ctx->timing.frame = moleClock()
+#else
+#define STAMP(t)             do { } while (0)
+#define TIMED(stage, t)      do { } while (0)
+#define FRAME_START          do { } while (0)
 #endif
 
 #define BLOCK_SHIFT 6
 #define CTX (void *)&*ctx
+#define TX(c) SendWire(ctx, c)
 #define BeginHash ctx->hInitFn
 #define EndHash ctx->hFinalFn
 #define Hash ctx->hputcFn
 #define BeginCipher ctx->cInitFn
-#define TX ctx->ciphrFn
 #define BlockCipher ctx->cBlockFn
+#define SeekCipher ctx->cSeekFn
+#define FillCipher ctx->cFillFn
+#define RESYNC (ctx->caps & ctx->peerCaps & MOLE_CAP_RESYNC)
+#define ARQ    (ctx->caps & ctx->peerCaps & MOLE_CAP_ARQ)
+#define FEC    (ctx->caps & ctx->peerCaps & MOLE_CAP_FEC)
+#define LZ     (ctx->caps & ctx->peerCaps & MOLE_CAP_LZ)
+#define BATCH  (ctx->caps & ctx->peerCaps & MOLE_CAP_BATCH)
+
+// Hash a run of bytes, in bulk if the protocol can (BLAKE3 hashes whole
+// chunks in SIMD lanes), otherwise a byte at a time.
+static void HashN(port_ctx *ctx, void *S, const uint8_t *src, int n) {
+    if (ctx->hputsFn != NULL) ctx->hputsFn(S, src, n);
+    else while (n--) ctx->hputcFn(S, *src++);
+}
+
+// HMAC contexts started ahead by molePrecompute, see ctx->primed
+#define PRIMED_TX   1                   /* thCtx started for primeTX */
+#define PRIMED_RX   2                   /* rhCtx started for primeRX */
+#define PRIME_HOLD  4                   /* a file is being sent, hands off */
+
+// Heavy work queued for molePoll in cooperative mode, see ctx->work
+#define WORK_FRAME  1                   /* handle the frame in rxbuf */
+#define WORK_IV_A   2                   /* answer a RESET with an IV */
+#define WORK_IV_B   4                   /* answer an IV with an IV */
+#define WORK_KEYS   8                   /* derive keys from ctx->workKey */
+#define WORK_PAIR  16                   /* answer an embedded reset */
+
+// Message being sent by moleSendPump, see ctx->sendState
+#define SEND_IDLE   0
+#define SEND_QUEUED 1                   /* nothing on the wire yet */
+#define SEND_BODY   2                   /* the frame has started */
 
 // ---------------------------------------------------------------------------
 // Stack for contexts whose size is unknown until run time
@@ -66,21 +130,167 @@ static int testHMAC(port_ctx *ctx, const uint8_t *buf) {
     return 0;
 }
 
+// Keysets and key derivation use BLAKE2s whatever the protocol
 static int testKey(port_ctx *ctx, const uint8_t *key) {
-    BeginHash(CTX->rhCtx, KDFhashKey, MOLE_HMAC_LENGTH, 0);
+    ctx->primed &= ~PRIMED_RX;
+    b2s_hmac_init(ctx->rhCtx, KDFhashKey, MOLE_HMAC_LENGTH, 0);
         DUMP(&key[0], MOLE_PASSCODE_HMAC);
-        PRINTF("keyset data\n");
-    for (int i=0; i < MOLE_PASSCODE_HMAC; i++) {
-        Hash(CTX->rhCtx, key[i]);
-    }
-    EndHash(CTX->rhCtx, ctx->hmac);
+        TRACE2(MOLE_TR_KEYSET, 0, 0);
+    b2s_hmac_puts(ctx->rhCtx, key, MOLE_PASSCODE_HMAC);
+    b2s_hmac_final(ctx->rhCtx, ctx->hmac);
         DUMP(ctx->hmac, MOLE_HMAC_LENGTH);
-        PRINTF("expected key hmac");
+        TRACE2(MOLE_TR_KEY_EXPECTED, 0, 0);
         DUMP(&key[MOLE_PASSCODE_HMAC], MOLE_HMAC_LENGTH);
-        PRINTF("actual key hmac\n");
+        TRACE2(MOLE_TR_KEY_ACTUAL, 0, 0);
     return testHMAC(ctx, &key[MOLE_PASSCODE_HMAC]);
 }
 
+// Derive various keys from the system token. If KDFhashKey is not really
+// secret, an attecker can get the keys from the token. However, the system
+// token cannot be obtained from the keys. Hash is one-way.
+
+#define KDF_HMAC    55                  /* iterations per key */
+#define KDF_CRYPT   55
+#define KDF_ADMIN   34
+#define KDF_STEPS   (KDF_HMAC + KDF_CRYPT + KDF_ADMIN)
+
+static void KDF (port_ctx *ctx, uint8_t *key, int length, int iterations) {
+    ctx->primed &= ~PRIMED_RX;
+    while (iterations--) {              // hash the key multiple times
+        b2s_hmac_init(ctx->rhCtx, KDFhashKey, length, 0);
+        b2s_hmac_puts(ctx->rhCtx, key, length);
+        b2s_hmac_final(ctx->rhCtx, key);
+    }
+}
+
+// Derive the keys from the keyset at ctx->workKey, in slices of up to steps
+// iterations. Return the iterations left.
+static int Derive(port_ctx *ctx, int steps) {
+    STAMP(t0);
+    while (steps && (ctx->kdfDone < KDF_STEPS)) {
+        const uint8_t *src = ctx->workKey;
+        uint8_t *dest = ctx->hmackey;
+        int length = MOLE_HMAC_KEY_LENGTH;
+        int start = 0;
+        int end = KDF_HMAC;
+        if (ctx->kdfDone >= (KDF_HMAC + KDF_CRYPT)) {
+            dest = ctx->adminpasscode;
+            src = &src[32];
+            length = MOLE_ADMINPASS_LENGTH;
+            start = KDF_HMAC + KDF_CRYPT;
+            end = KDF_STEPS;
+        } else if (ctx->kdfDone >= KDF_HMAC) {
+            dest = ctx->cryptokey;
+            length = MOLE_ENCR_KEY_LENGTH;
+            start = KDF_HMAC;
+            end = KDF_HMAC + KDF_CRYPT;
+        }
+        if (ctx->kdfDone == start) {    // the key starts as the token
+            if (!start) ctx->primed &= PRIME_HOLD; // for the old hmackey
+            for (int i = 0; i < length; i++) {
+                if (start == KDF_HMAC) dest[i] = src[length + (~i)]; // reversed
+                else                   dest[i] = src[i];
+            }
+        }
+        int n = end - ctx->kdfDone;
+        if (n > steps) n = steps;
+        KDF(ctx, dest, length, n);      // iterated in place
+        ctx->kdfDone += n;
+        steps -= n;
+        if (ctx->kdfDone == end) {
+                DUMP(dest, length); TRACE2(MOLE_TR_KDF, 0, 0);
+        }
+    }
+    TIMED(MOLE_STAGE_KDF, t0);
+    return KDF_STEPS - ctx->kdfDone;
+}
+
+// ---------------------------------------------------------------------------
+// Forward error correction sits between the escaped stream and the wire.
+// Only encrypted frames are coded, so pairing works before FEC is agreed on.
+
+#define FecTag(c) (((c) == MOLE_TAG_MESSAGE) || ((c) == MOLE_TAG_SEQMSG) \
+                || ((c) == MOLE_TAG_ADMIN))
+
+// With a TX FIFO, bytes are written straight into space reserved in it and
+// committed a chunk at a time: at the end of a frame, when the space runs
+// out and after each moleSendPump step. When the FIFO is full, Wire waits for
+// the ISR to make room, as a blocking ciphrFn would wait for the UART. Frames
+// are never cut short; moleSendPump checks for room first so it never waits.
+
+static void TxCommit(port_ctx *ctx) {
+    if (ctx->txUsed) fifo_commit(ctx->txFifo, ctx->txUsed);
+    ctx->txUsed = ctx->txRoom = 0;
+}
+
+static void Wire(port_ctx *ctx, uint8_t c) {
+    if (ctx->txFifo == NULL) {
+        ctx->stats.bytesOut++;
+        ctx->ciphrFn(c);
+        return;
+    }
+    if (ctx->txUsed == ctx->txRoom) {   // chunk is full, reserve the next
+        TxCommit(ctx);
+        ctx->txRoom = fifo_reserve(ctx->txFifo, &ctx->txChunk);
+        if (!ctx->txRoom) {
+            ctx->stats.txFull++;
+            do ctx->txRoom = fifo_reserve(ctx->txFifo, &ctx->txChunk);
+            while (!ctx->txRoom);
+        }
+    }
+    ctx->stats.bytesOut++;
+    ctx->txChunk[ctx->txUsed++] = c;
+    if (c == MOLE_TAG_END) TxCommit(ctx);
+}
+
+static void SendParity(port_ctx *ctx) {
+    mole_fec *f = ctx->fec;
+    for (int i = 0; i < f->tx.nparity; i++) {
+        uint8_t c = f->tx.reg[i];
+        if ((c & 0xFE) == MOLE_TAG_END) {
+            Wire(ctx, MOLE_ESCAPE);
+            c &= 1;
+        }
+        Wire(ctx, c);
+    }
+    rs_clear(&f->tx);
+    f->txCount = 0;
+}
+
+static void SendWire(port_ctx *ctx, uint8_t c) {
+    mole_fec *f = ctx->fec;
+    if (f == NULL) {
+        Wire(ctx, c);
+        return;
+    }
+    switch (f->txState) {
+    case FEC_TAG:
+        if (c == MOLE_TAG_END) break;
+        f->txState = (FEC && FecTag(c)) ? FEC_DATA : FEC_OFF;
+        if (f->txState == FEC_OFF) break;
+        rs_clear(&f->tx);
+        f->txCount = 0;
+        // fall through
+    case FEC_DATA:
+        if (c == MOLE_TAG_END) {
+            if (f->txCount) {           // mark a short codeword
+                Wire(ctx, MOLE_ESCAPE);
+                Wire(ctx, MOLE_FEC_TRIGGER);
+                SendParity(ctx);
+            }
+            f->txState = FEC_TAG;
+            break;
+        }
+        Wire(ctx, c);
+        rs_putc(&f->tx, c);
+        if (++f->txCount == f->txData) SendParity(ctx);
+        return;
+    default:
+        if (c == MOLE_TAG_END) f->txState = FEC_TAG;
+    }
+    Wire(ctx, c);
+}
+
 // Send raw binary out to the stream. Certain bytes are replaced by escape
 // sequences so MOLE_TAG_END is not streamed out by accident.
 
@@ -89,6 +299,7 @@ static void SendByteU(port_ctx *ctx, uint8_t c) {
         TX(MOLE_ESCAPE);
         TX(c & 1);
         ctx->counter++;
+        ctx->stats.escapes++;
     } else {
         TX(c);
     }
@@ -102,8 +313,9 @@ static void SendByte(port_ctx *ctx, uint8_t c) {
 
 static void SendN(port_ctx *ctx, const uint8_t *src, int length) {
     for (int i = 0; i < length; i++) {
-        SendByte(ctx, src[i]);
+        SendByteU(ctx, src[i]);
     }
+    HashN(ctx, CTX->thCtx, src, length); // add to HMAC
 }
 
 static void Send2(port_ctx *ctx, int x) {
@@ -120,8 +332,21 @@ static void SendEnd(port_ctx *ctx) {    // send END tag
     TX(MOLE_TAG_END);
 }
 
+// A frame started by moleSendPump is finished before another frame starts.
+// When the session restarts under it, it is cut off and sent again later.
+
+static void SendRest(port_ctx *ctx, uint8_t state);
+
+static void Requeue(port_ctx *ctx) {
+    if (ctx->sendState != SEND_BODY) return;
+    SendEnd(ctx);                       // the peer drops the partial frame
+    ctx->sendState = SEND_QUEUED;
+    ctx->sendPos = 0;
+}
+
 static void SendBoiler(port_ctx *ctx) { // send boilerplate packet
     uint8_t len = ctx->boilerplate[0];
+    SendRest(ctx, SEND_BODY);
     SendByteU(ctx, MOLE_TAG_BOILERPLATE);
     for (int i = 0; i <= len; i++) SendByteU(ctx, ctx->boilerplate[i]);
     SendByteU(ctx, 0);                  // zero-terminate to stringify
@@ -130,27 +355,42 @@ static void SendBoiler(port_ctx *ctx) { // send boilerplate packet
 
 // Encryption
 
-static const uint8_t BISThmac[16] = {
-    0xF2, 0x27, 0xE9, 0x62, 0x94, 0x7A, 0xAB, 0xE5,
-    0xA7, 0x05, 0x88, 0x2A, 0xCF, 0xB3, 0x04, 0x82};
-
-static const uint8_t BISTdecode[16] = {
-    0xBC, 0xD0, 0x2A, 0x18, 0xBF, 0x3F, 0x01, 0xD1,
-    0x92, 0x92, 0xDE, 0x30, 0xA7, 0xA8, 0xFD, 0xAC};
+static const uint8_t BISThmac[MOLE_PROTOCOLS][16] = {
+   {0xF2, 0x27, 0xE9, 0x62, 0x94, 0x7A, 0xAB, 0xE5,     // BLAKE2s
+    0xA7, 0x05, 0x88, 0x2A, 0xCF, 0xB3, 0x04, 0x82},
+   {0x81, 0xFC, 0x02, 0xAE, 0xA8, 0x13, 0x23, 0xE9,     // Poly1305
+    0x3F, 0x73, 0xA4, 0x7D, 0x36, 0x9F, 0x11, 0xB7},
+   {0x9B, 0xCE, 0x2C, 0x66, 0x8F, 0xD2, 0xF1, 0x32,     // GHASH
+    0x69, 0x5E, 0xBF, 0x3B, 0x4B, 0x07, 0xA2, 0x23},
+   {0x83, 0x8B, 0x5F, 0x11, 0xE8, 0x95, 0x91, 0x72,     // BLAKE3
+    0xE7, 0x7B, 0xC9, 0x00, 0x7E, 0x5A, 0x2C, 0xD3},
+   {0x75, 0xE8, 0x11, 0xC2, 0xD3, 0xBB, 0x21, 0x35,     // BLAKE2s midstate
+    0xAF, 0x42, 0x33, 0x7E, 0xE9, 0xA3, 0xBB, 0x07}};
+
+static const uint8_t BISTdecode[MOLE_PROTOCOLS][16] = {
+   {0xBC, 0xD0, 0x2A, 0x18, 0xBF, 0x3F, 0x01, 0xD1,     // XChaCha20
+    0x92, 0x92, 0xDE, 0x30, 0xA7, 0xA8, 0xFD, 0xAC},
+   {0xBC, 0xD0, 0x2A, 0x18, 0xBF, 0x3F, 0x01, 0xD1,
+    0x92, 0x92, 0xDE, 0x30, 0xA7, 0xA8, 0xFD, 0xAC},
+   {0xDC, 0x95, 0xC0, 0x78, 0xA2, 0x40, 0x89, 0x89,     // AES-256-CTR
+    0xAD, 0x48, 0xA2, 0x14, 0x92, 0x84, 0x20, 0x87},
+   {0xBC, 0xD0, 0x2A, 0x18, 0xBF, 0x3F, 0x01, 0xD1,
+    0x92, 0x92, 0xDE, 0x30, 0xA7, 0xA8, 0xFD, 0xAC},
+   {0xBC, 0xD0, 0x2A, 0x18, 0xBF, 0x3F, 0x01, 0xD1,
+    0x92, 0x92, 0xDE, 0x30, 0xA7, 0xA8, 0xFD, 0xAC}};
 
 // Test with with keys and rxbuf = 0
 static int BIST(port_ctx *ctx, int protocol) {
+    ctx->primed = 0;
     BeginHash  (CTX->rhCtx, ctx->hmackey, MOLE_HMAC_LENGTH, 0);
     BeginCipher(CTX->rcCtx, ctx->cryptokey, ctx->rxbuf, 0);
     BlockCipher(CTX->rcCtx, ctx->rxbuf, ctx->rxbuf, 0);
-    if (memcmp(BISTdecode, ctx->rxbuf, MOLE_BLOCKSIZE)) {
+    if (memcmp(BISTdecode[protocol], ctx->rxbuf, MOLE_BLOCKSIZE)) {
         return MOLE_ERROR_BAD_BIST;
     }
-    for (int i = 0; i < MOLE_BLOCKSIZE; i++) {
-        Hash(CTX->rhCtx, ctx->rxbuf[i]);
-    }
+    HashN(ctx, CTX->rhCtx, ctx->rxbuf, MOLE_BLOCKSIZE);
     EndHash(CTX->rhCtx, ctx->rxbuf);
-    if (memcmp(BISThmac, ctx->rxbuf, MOLE_HMAC_LENGTH)) {
+    if (memcmp(BISThmac[protocol], ctx->rxbuf, MOLE_HMAC_LENGTH)) {
         return MOLE_ERROR_BAD_BIST;
     }
     return 0;
@@ -158,12 +398,33 @@ static int BIST(port_ctx *ctx, int protocol) {
 
 static void SendTxBuf(port_ctx *ctx) {
     BlockCipher(CTX->tcCtx, ctx->txbuf, ctx->txbuf, 0);
+    ctx->tPos++;
     SendBlock(ctx, ctx->txbuf);
 }
 
+// A primed HMAC context was started for a counter under the current hmackey.
+// The next frame in its direction uses it if the counter still matches.
+
+static void BeginTX(port_ctx *ctx) {
+    if (!(ctx->primed & PRIMED_TX) || (ctx->primeTX != ctx->hashCounterTX)) {
+        BeginHash(CTX->thCtx, ctx->hmackey, MOLE_HMAC_LENGTH,
+                  ctx->hashCounterTX);
+    }
+    ctx->primed &= ~PRIMED_TX;
+}
+
+static void BeginRX(port_ctx *ctx, uint64_t counter) {
+    if (!(ctx->primed & PRIMED_RX) || (ctx->primeRX != counter)) {
+        BeginHash(CTX->rhCtx, ctx->hmackey, MOLE_HMAC_LENGTH, counter);
+    }
+    ctx->primed &= ~PRIMED_RX;
+}
+
 static void SendHeader(port_ctx *ctx, int tag) {
+    SendRest(ctx, SEND_BODY);
+    if (ctx->work & WORK_KEYS) Derive(ctx, KDF_STEPS); // no half-made keys
     SendEnd(ctx);                       // reset state in case of oops
-    BeginHash(CTX->thCtx, ctx->hmackey, MOLE_HMAC_LENGTH, ctx->hashCounterTX);
+    BeginTX(ctx);
     SendByte(ctx, tag);                 // Header consists of a TAG byte,
 }
 
@@ -178,9 +439,10 @@ static void SendAsHash(port_ctx *ctx, uint8_t *src) {
 static void SendTxHash(port_ctx *ctx, int pad){
     uint8_t hash[MOLE_HMAC_LENGTH];
         DUMP((uint8_t*)&ctx->hashCounterTX, 8);
-        PRINTF("%s is sending HMAC with hashCounterTX, ", ctx->name);
+        TRACE2(MOLE_TR_TX_HMAC, 0, 0);
     EndHash(CTX->thCtx, hash);
     ctx->hashCounterTX++;
+    ctx->stats.framesOut++;
     TX(MOLE_ESCAPE);                    // HMAC marker (in plaintext)
     TX(MOLE_HMAC_TRIGGER);
     ctx->counter += ivADlength;
@@ -194,16 +456,82 @@ static void SendTxHash(port_ctx *ctx, int pad){
     SendEnd(ctx);
 }
 
+// A new session renumbers the unacknowledged messages from 0 and resends
+// them. The slots stay put because txShift absorbs the renumbering.
+
+#define ARQ_LOST 0xFF                   /* age of a message to resend now */
+#define TxSlot(q, seq) ((uint8_t)((seq) + (q)->txShift) & ((q)->slots - 1))
+#define RxSlot(q, seq) ((seq) & ((q)->slots - 1))
+
+static void ArqRestart(mole_arq *q) {   // transmitter starts a session
+    q->txShift += q->txBase;
+    q->txNext -= q->txBase;
+    q->txBase = 0;
+    memset(q->age, ARQ_LOST, sizeof(q->age));
+}
+
+static void ArqReset(mole_arq *q, uint8_t peerSlots) { // receiver does too
+    q->rxBase = 0;
+    q->rxMap = 0;
+    q->ackDue = 0;
+    q->ackAge = 0;
+    q->window = (peerSlots < q->slots) ? peerSlots : q->slots;
+}
+
+// ---------------------------------------------------------------------------
+// IVs come from a fast-key-erasure DRBG: XChaCha20 keyed by drbgKey makes
+// a new key, which replaces the old one, followed by the output.
+// moleTRNG is mixed into the key every MOLE_DRBG_RESEED outputs.
+// The state is shared by all ports, see moleReseed in mole.h.
+
+#if (MOLE_DRBG_RESEED)
+static uint8_t drbgKey[MOLE_ENCR_KEY_LENGTH];
+static uint16_t drbgLeft;               // outputs until the next reseed
+
+static int Random(uint8_t *dest, int length) {
+    static const uint8_t nonce[MOLE_IV_LENGTH];
+    uint8_t seed[MOLE_ENCR_KEY_LENGTH];
+    xChaCha_ctx c;
+    if (drbgLeft == 0) {
+        if (moleTRNG(seed, sizeof(seed))) return MOLE_ERROR_TRNG_FAILURE;
+        for (int i = 0; i < (int)sizeof(seed); i++) drbgKey[i] ^= seed[i];
+        memset(seed, 0, sizeof(seed));
+        drbgLeft = MOLE_DRBG_RESEED;
+    }
+    drbgLeft--;
+    xc_crypt_init(&c, drbgKey, nonce, 1);
+    memset(drbgKey, 0, sizeof(drbgKey)); // the old key is gone, the first
+    xchacha_encrypt_bytes(&c, drbgKey, drbgKey, sizeof(drbgKey)); // 32 bytes
+    memset(dest, 0, length);
+    xchacha_encrypt_bytes(&c, dest, dest, length);
+    memset(&c, 0, sizeof(c));           // burn stack
+    return 0;
+}
+#else
+#define Random moleTRNG
+#endif
+
+void moleReseed(void) {
+#if (MOLE_DRBG_RESEED)
+    drbgLeft = 0;
+#endif
+}
+
 // IV for cIV ---v      v--- encrypted random IV
-// Send: Tag[1], mIV[], cIV[], RXbufsize[2], HMAC[]
+// Send: Tag[1], mIV[], cIV[], RXbufsize[2], {caps[1]}, {slots[1]},
+//       {data[1], parity[1]}, HMAC[]
+// The caps byte is only sent if there are capabilities to advertise,
+// the slots byte only if they include MOLE_CAP_ARQ and the code rate
+// only if they include MOLE_CAP_FEC.
 #define cIV &IV[MOLE_IV_LENGTH] /* the secret part */
-static int SendIV(port_ctx *ctx, int tag) {
+static int SendIV(port_ctx *ctx, int tag, uint8_t caps) {
     uint8_t IV[2 * MOLE_IV_LENGTH];
-    if (moleTRNG(IV, 2 * MOLE_IV_LENGTH)) {
+    STAMP(t0);
+    if (Random(IV, 2 * MOLE_IV_LENGTH)) {
         return MOLE_ERROR_TRNG_FAILURE;
     }
     memcpy(&ctx->hashCounterRX, cIV, 8);
-        PRINTf("\n%s sending IV, tag=%d, ", ctx->name, tag);
+        TRACE(MOLE_TR_TX_IV, tag, 0);
     SendHeader(ctx, tag);
 #if (MOLE_IV_LENGTH == MOLE_BLOCKSIZE)
     SendBlock(ctx, IV);
@@ -211,27 +539,38 @@ static int SendIV(port_ctx *ctx, int tag) {
     SendN(ctx, IV, MOLE_IV_LENGTH);
 #endif
         DUMP((uint8_t*)&ctx->hashCounterRX, 8);
-        PRINTF("New %s.hashCounterRX",ctx->name);
+        TRACE2(MOLE_TR_NEW_RX_CTR, 0, 0);
         DUMP((uint8_t*)&ctx->hashCounterTX, 8);
-        PRINTF("Current %s.hashCounterTX",ctx->name);
+        TRACE2(MOLE_TR_CUR_TX_CTR, 0, 0);
         DUMP((uint8_t*)IV, MOLE_IV_LENGTH);
-        PRINTF("mIV used by %s to encrypt cIV",ctx->name);
+        TRACE2(MOLE_TR_MIV, 0, 0);
         DUMP((uint8_t*)cIV, MOLE_IV_LENGTH);
-        PRINTF("IV (not output)");
+        TRACE2(MOLE_TR_IV, 0, 0);
     BeginCipher(CTX->tcCtx, ctx->cryptokey, IV, 1);
     BlockCipher(CTX->tcCtx, cIV, IV, 1);
         DUMP((uint8_t*)IV, MOLE_IV_LENGTH);
-        PRINTF("cIV output as encrypted IV\n");
+        TRACE2(MOLE_TR_CIV, 0, 0);
 #if (MOLE_IV_LENGTH == MOLE_BLOCKSIZE)
     SendBlock(ctx, IV);
 #else
     SendN(ctx, IV, MOLE_IV_LENGTH);
 #endif
     Send2(ctx, ctx->rBlocks);
+    if (caps) SendByte(ctx, caps);
+    if (caps & MOLE_CAP_ARQ) {
+        SendByte(ctx, ctx->arq->slots);
+        ArqRestart(ctx->arq);
+    }
+    if (caps & MOLE_CAP_FEC) {
+        SendByte(ctx, ctx->fec->txData);
+        SendByte(ctx, ctx->fec->tx.nparity);
+    }
     SendTxHash(ctx, MOLE_END_UNPADDED);
     BeginCipher(CTX->tcCtx, ctx->cryptokey, cIV, 1);
+    ctx->tPos = 0;
     memset(IV, 0, sizeof(IV)); // burn stack
     ctx->tReady = 1;
+    TIMED(MOLE_STAGE_IV, t0);
     return 0;
 }
 #undef cIV
@@ -241,7 +580,8 @@ static int SendIV(port_ctx *ctx, int tag) {
 // This scheme assumes a host PC with a large rxbuf, so it will get the data.
 // Otherwise, the HMAC is dropped.
 
-static int NewStream(port_ctx *ctx, uint32_t headspace) {
+static int NewStream(port_ctx *ctx, uint32_t headspace, uint8_t caps) {
+    SendRest(ctx, SEND_QUEUED);         // a file reuses lz->txbuf
     ctx->counter = 0;
     ctx->prevblock = 0;
     ctx->rReady = 0;
@@ -251,16 +591,28 @@ static int NewStream(port_ctx *ctx, uint32_t headspace) {
     while (ctx->counter < headspace) {  // reserve room for control block
         SendByteU(ctx, 0xFF);
     }
-    int r = SendIV(ctx, MOLE_TAG_IV_A); // and an encrypted IV
+    int r = SendIV(ctx, MOLE_TAG_IV_A, caps); // and an encrypted IV
     return r;
 }
 
 int moleTxInit(port_ctx *ctx) {         // use if not paired
-    return NewStream(ctx, 0);
+    return NewStream(ctx, 0, ctx->caps);
 }
 
+// A sequenced message carries the low bits of its counter and keystream
+// position as associated data so the receiver can skip over lost messages.
+// Send: Tag[1], seq[1], position[2], ciphertext[], HMAC[]
+
+#define SEQ_AD_LENGTH 3
+
 static void moleSendInit(port_ctx *ctx, uint8_t type) {
-    SendHeader(ctx, MOLE_TAG_MESSAGE);
+    if (RESYNC) {
+        SendHeader(ctx, MOLE_TAG_SEQMSG);
+        SendByte(ctx, (uint8_t)ctx->hashCounterTX);
+        Send2(ctx, ctx->tPos);
+    } else {
+        SendHeader(ctx, MOLE_TAG_MESSAGE);
+    }
     ctx->txbuf[0] = type;
     ctx->txidx = 1;
 }
@@ -273,6 +625,22 @@ static void moleSendChar(port_ctx *ctx, uint8_t c) {
     if (!i) SendTxBuf(ctx);
 }
 
+// Whole blocks are encrypted straight from src, the rest goes through txbuf
+static void moleSendBytes(port_ctx *ctx, const uint8_t *src, int len) {
+    while (len && ctx->txidx) {
+        moleSendChar(ctx, *src++);
+        len--;
+    }
+    while (len >= MOLE_BLOCKSIZE) {
+        BlockCipher(CTX->tcCtx, src, ctx->txbuf, 0);
+        ctx->tPos++;
+        SendBlock(ctx, ctx->txbuf);
+        src += MOLE_BLOCKSIZE;
+        len -= MOLE_BLOCKSIZE;
+    }
+    while (len--) moleSendChar(ctx, *src++);
+}
+
 static void moleSendFinal(port_ctx *ctx) {
     ctx->txbuf[15] = ctx->txidx;
     SendTxBuf(ctx);
@@ -281,7 +649,7 @@ static void moleSendFinal(port_ctx *ctx) {
 
 static void moleSendMsg(port_ctx *ctx, const uint8_t *src, int len, int type){
     moleSendInit(ctx, type);
-    while (len--) moleSendChar(ctx, *src++);
+    moleSendBytes(ctx, src, len);
     moleSendFinal(ctx);
 }
 
@@ -293,33 +661,11 @@ static int moleReKeyRequest(port_ctx *ctx, const uint8_t *key, int tag){
     return 0;
 }
 
-// Derive various keys from the system token. If KDFhashKey is not really
-// secret, an attecker can get the keys from the token. However, the system
-// token cannot be obtained from the keys. Hash is one-way.
-
-static int KDF (port_ctx *ctx, uint8_t *dest, const uint8_t *src, int length,
-                int iterations, int reverse) {
-    uint8_t KDFbuffer[MOLE_ENCR_KEY_LENGTH];
-    if (length > MOLE_ENCR_KEY_LENGTH) return MOLE_ERROR_KDFBUF_TOO_SMALL;
-    for (int i = 0; i < length; i++) {
-        if (reverse) KDFbuffer[i] = src[length + (~i)];
-        else         KDFbuffer[i] = src[i];
-    }
-    while (iterations--) {              // hash the KDFbuffer multiple times
-        BeginHash(CTX->rhCtx, KDFhashKey, length, 0);
-        for (int i = 0; i < length; i++) {
-            Hash(CTX->rhCtx, KDFbuffer[i]);
-        }
-        EndHash(CTX->rhCtx, KDFbuffer);
-    }
-    memcpy(dest, KDFbuffer, length);
-        DUMP(KDFbuffer, length); PRINTF("KDF output ");
-    return 0;
-}
-
 #define PREAMBLE_SIZE 2
-#define MAX_RX_LENGTH ((ctx->rBlocks << BLOCK_SHIFT) \
+#define MAX_RX_LENGTH ((ctx->sBlocks << BLOCK_SHIFT) \
                     - (MOLE_HMAC_LENGTH + PREAMBLE_SIZE))
+#define RX_SIZE (((ctx->rxbuf == ctx->rxstage) ? ctx->sBlocks : ctx->rBlocks) \
+                 << BLOCK_SHIFT)        /* the frame's buffer */
 
 // ---------------------------------------------------------------------------
 // Public functions
@@ -327,16 +673,24 @@ static int KDF (port_ctx *ctx, uint8_t *dest, const uint8_t *src, int length,
 int moleNewKeys(port_ctx *ctx, const uint8_t *key) {
     int r = testKey(ctx, key);
     if (r) return r;
-    r |= KDF(ctx, ctx->hmackey,       key, MOLE_HMAC_KEY_LENGTH, 55, 0);
-    r |= KDF(ctx, ctx->cryptokey,     key, MOLE_ENCR_KEY_LENGTH, 55, 1);
-    r |= KDF(ctx, ctx->adminpasscode, &key[32], MOLE_ADMINPASS_LENGTH, 34, 0);
-    return r;
+    ctx->work &= ~WORK_KEYS;            // these keys replace a re-key
+    ctx->workKey = key;
+    ctx->kdfDone = 0;
+    Derive(ctx, KDF_STEPS);
+    return 0;
 }
 
 // Call this before setting up any mole ports and when closing app.
 void moleNoPorts(void) {
 	memset(context_memory, 0, sizeof(context_memory));
 	allocated_uint32s = 0;
+#if (MOLE_TRACE)
+	portCount = 0;
+#endif
+#if (MOLE_DRBG_RESEED)
+	memset(drbgKey, 0, sizeof(drbgKey));
+	drbgLeft = 0;
+#endif
 }
 
 // Add a secure port
@@ -345,28 +699,66 @@ int moleAddPort(port_ctx *ctx, const uint8_t *boilerplate, int protocol,
                 mole_plainFn plain, mole_ciphrFn ciphr, mole_WrKeyFn WrKeyFn){
     memset(ctx, 0, sizeof(port_ctx));
     ctx->plainFn = plain;               // plaintext output handler
-    TX = ciphr;                         // ciphertext output handler
+    ctx->ciphrFn = ciphr;               // ciphertext output handler
     ctx->boilrFn = boiler;              // boilerplate output handler
     ctx->boilerplate = boilerplate;     // counted string
     ctx->name = name;                   // Zstring name for debugging
     ctx->WrKeyFn = WrKeyFn;
     ctx->rBlocks = rxBlocks;            // block size (1<<BLOCK_SHIFT) bytes
+    ctx->sBlocks = rxBlocks;
+#if (MOLE_TRACE)
+    ctx->trace.port = portCount++;
+#endif
     ctx->rxbuf = Allocate(rxBlocks << BLOCK_SHIFT);
     if (rxBlocks < 2) return MOLE_ERROR_BUF_TOO_SMALL;
+    if ((protocol < 0) || (protocol >= MOLE_PROTOCOLS)) protocol = 0;
+    int cSize = sizeof(xChaCha_ctx);
+    int hSize = sizeof(blake2s_state);  // at least this, KDF uses rhCtx
+    BeginCipher = xc_crypt_init_g;
+    BlockCipher = xc_crypt_block_g;
+    SeekCipher  = xc_crypt_seek_g;
+    FillCipher  = xc_crypt_fill_g;
     switch (protocol) {
-    default: // 0
-        ctx->rcCtx = Allocate(sizeof(xChaCha_ctx));
-        ctx->tcCtx = Allocate(sizeof(xChaCha_ctx));
-        ctx->rhCtx = Allocate(sizeof(blake2s_state));
-        ctx->thCtx = Allocate(sizeof(blake2s_state));
-        if (allocated_uint32s >= MOLE_ALLOC_MEM_UINT32S) {
-            return MOLE_ERROR_OUT_OF_MEMORY;
-        }
+    case MOLE_PROTOCOL_POLY1305:        // one-time keys from HChaCha20
+        BeginHash   = p1305_hmac_init_g;
+        Hash        = p1305_hmac_putc_g;
+        EndHash     = p1305_hmac_final_g;
+        break;
+    case MOLE_PROTOCOL_AES:             // AES-NI and PCLMULQDQ if available
+        cSize = sizeof(aes_ctx);
+        if (hSize < (int)sizeof(ghash_ctx)) hSize = sizeof(ghash_ctx);
+        BeginCipher = aes_crypt_init_g;
+        BlockCipher = aes_crypt_block_g;
+        SeekCipher  = aes_crypt_seek_g;
+        FillCipher  = NULL;
+        BeginHash   = gh_hmac_init_g;
+        Hash        = gh_hmac_putc_g;
+        EndHash     = gh_hmac_final_g;
+        break;
+    case MOLE_PROTOCOL_BLAKE3:          // b3_puts is faster for bulk hashing
+        if (hSize < (int)sizeof(blake3_state)) hSize = sizeof(blake3_state);
+        BeginHash   = b3_hmac_init_g;
+        Hash        = b3_hmac_putc_g;
+        ctx->hputsFn = b3_hmac_puts_g;
+        EndHash     = b3_hmac_final_g;
+        break;
+    case MOLE_PROTOCOL_BLAKE2S_MID:     // no key block per message
+        hSize = sizeof(blake2s_keyed);
+        BeginHash   = b2s_keyed_init_g;
+        Hash        = b2s_hmac_putc_g;
+        EndHash     = b2s_hmac_final_g;
+        break;
+    default: // MOLE_PROTOCOL_BLAKE2S
         BeginHash   = b2s_hmac_init_g;
         Hash        = b2s_hmac_putc_g;
         EndHash     = b2s_hmac_final_g;
-        BeginCipher = xc_crypt_init_g;
-        BlockCipher = xc_crypt_block_g;
+    }
+    ctx->rcCtx = Allocate(cSize);
+    ctx->tcCtx = Allocate(cSize);
+    ctx->rhCtx = Allocate(hSize);
+    ctx->thCtx = Allocate(hSize);
+    if (allocated_uint32s >= MOLE_ALLOC_MEM_UINT32S) {
+        return MOLE_ERROR_OUT_OF_MEMORY;
     }
     return BIST(ctx, protocol);
 }
@@ -384,20 +776,145 @@ int moleReKey(port_ctx *ctx, const uint8_t *key){
     return moleReKeyRequest(ctx, key, MOLE_MSG_NEW_KEY);
 }
 
+void moleSetCaps(port_ctx *ctx, uint8_t caps) {
+    if (ctx->arq == NULL) caps &= ~MOLE_CAP_ARQ;
+    if (ctx->fec == NULL) caps &= ~MOLE_CAP_FEC;
+    if (ctx->lz == NULL) caps &= ~MOLE_CAP_LZ;
+    if (ctx->batch == NULL) caps &= ~MOLE_CAP_BATCH;
+    ctx->caps = caps;
+}
+
+int moleBatchInit(port_ctx *ctx, uint16_t size, uint8_t delay) {
+    mole_batch *b = Allocate(sizeof(mole_batch));
+    uint8_t *buf = Allocate(size);
+    if (allocated_uint32s >= MOLE_ALLOC_MEM_UINT32S) {
+        return MOLE_ERROR_OUT_OF_MEMORY;
+    }
+    memset(b, 0, sizeof(mole_batch));
+    b->buf = buf;
+    b->size = size;
+    b->delay = delay;
+    ctx->batch = b;
+    ctx->caps |= MOLE_CAP_BATCH;
+    return 0;
+}
+
+int moleLzInit(port_ctx *ctx) {
+    uint16_t size = ctx->rBlocks << BLOCK_SHIFT;
+    if (size < MOLE_LZ_WINDOW) size = MOLE_LZ_WINDOW;
+    mole_lz *z = Allocate(sizeof(mole_lz));
+    uint8_t *rxbuf = Allocate(size);
+    uint8_t *txbuf = Allocate(2 * MOLE_LZ_WINDOW);
+    if (allocated_uint32s >= MOLE_ALLOC_MEM_UINT32S) {
+        return MOLE_ERROR_OUT_OF_MEMORY;
+    }
+    memset(z, 0, sizeof(mole_lz));
+    z->rxbuf = rxbuf;
+    z->txbuf = txbuf;
+    z->rxsize = size;
+    ctx->lz = z;
+    ctx->caps |= MOLE_CAP_LZ;
+    return 0;
+}
+
+int moleRxRing(port_ctx *ctx, uint8_t buffers) {
+    uint16_t size = ctx->rBlocks << BLOCK_SHIFT;
+    if (ctx->rxFn != NULL) return MOLE_ERROR_INVALID_STATE;
+    if ((buffers == 0) || (buffers > MOLE_RX_RING_MAX)) {
+        return MOLE_ERROR_INVALID_LENGTH;
+    }
+    uint8_t *buf[MOLE_RX_RING_MAX];
+    mole_ring *g = Allocate(sizeof(mole_ring));
+    for (int k = 0; k < buffers; k++) buf[k] = Allocate(size);
+    if (allocated_uint32s >= MOLE_ALLOC_MEM_UINT32S) {
+        return MOLE_ERROR_OUT_OF_MEMORY;
+    }
+    memset(g, 0, sizeof(mole_ring));
+    memcpy(g->buf, buf, buffers * sizeof(uint8_t *));
+    g->count = buffers;
+    ctx->ring = g;
+    return 0;
+}
+
+int moleRelease(port_ctx *ctx, const uint8_t *src) {
+    mole_ring *g = ctx->ring;
+    if (g == NULL) return 0;
+    for (int k = 0; k < g->count; k++) {
+        if ((src == &g->buf[k][1]) && (g->held & (1 << k))) {
+            memset(&g->buf[k][1], 0, g->len[k]);    // burn after reading
+            g->held &= ~(1 << k);
+            return 0;
+        }
+    }
+    return MOLE_ERROR_INVALID_STATE;
+}
+
+int moleRxInto(port_ctx *ctx, mole_bufFn rxFn, uint16_t blocks) {
+    if (blocks < 2) return MOLE_ERROR_BUF_TOO_SMALL;
+    if ((rxFn == NULL) || ctx->ring || ctx->arq || ctx->lz) {
+        return MOLE_ERROR_INVALID_STATE;
+    }
+    ctx->rxFn = rxFn;
+    ctx->rxstage = ctx->rxbuf;
+    ctx->rxapp = NULL;
+    ctx->rBlocks = blocks;              // advertised at the next pairing
+    return 0;
+}
+
+int moleFecInit(port_ctx *ctx, uint8_t data, uint8_t parity) {
+    mole_fec *f = Allocate(sizeof(mole_fec));
+    if (allocated_uint32s >= MOLE_ALLOC_MEM_UINT32S) {
+        return MOLE_ERROR_OUT_OF_MEMORY;
+    }
+    memset(f, 0, sizeof(mole_fec));
+    if ((data == 0) || (data > (255 - parity)) || rs_init(&f->tx, parity)) {
+        return MOLE_ERROR_INVALID_LENGTH;
+    }
+    f->txData = data;
+    ctx->fec = f;
+    ctx->caps |= MOLE_CAP_FEC;
+    return 0;
+}
+
+int moleArqInit(port_ctx *ctx, uint8_t slots) {
+    if ((slots == 0) || (slots > MOLE_ARQ_MAX_SLOTS) || (slots & (slots - 1))) {
+        return MOLE_ERROR_INVALID_LENGTH;
+    }
+    uint16_t size = ctx->rBlocks << BLOCK_SHIFT;
+    mole_arq *q = Allocate(sizeof(mole_arq));
+    uint8_t *txq = Allocate(slots * size);
+    uint8_t *rxq = Allocate(slots * size);
+    if (allocated_uint32s >= MOLE_ALLOC_MEM_UINT32S) {
+        return MOLE_ERROR_OUT_OF_MEMORY;
+    }
+    memset(q, 0, sizeof(mole_arq));
+    q->txq = txq;
+    q->rxq = rxq;
+    q->size = size;
+    q->slots = slots;
+    ctx->arq = q;
+    ctx->caps |= MOLE_CAP_ARQ;
+    return 0;
+}
+
 // molePair and moleBoilerReq assume that the FSMs are not seeing traffic
 
 void molePair(port_ctx *ctx) {
-    PRINTf("\n%s sending Pairing request, ", ctx->name);
+    TRACE(MOLE_TR_PAIR, 0, 0);
+    ctx->stats.pairings++;
+    Requeue(ctx);
     ctx->rReady = 0;
     ctx->tReady = 0;
     ctx->state = IDLE;                  // reset local FSM
+    ctx->escaped = 0;                   // and a stray escape before it
     SendHeader(ctx, MOLE_TAG_RESET);
     SendEnd(ctx);
 }
 
 void moleBoilerReq(port_ctx *ctx) {
-    PRINTf("\n%s sending Boilerplate request, ", ctx->name);
+    TRACE(MOLE_TR_BOILER_REQ, 0, 0);
     ctx->state = IDLE;                  // reset local FSM
+    ctx->escaped = 0;
     SendHeader(ctx, MOLE_TAG_GET_BOILER);
     SendEnd(ctx);
 }
@@ -405,9 +922,10 @@ void moleBoilerReq(port_ctx *ctx) {
 // Send: Tag[1], password[16], HMAC[]
 void moleAdmin(port_ctx *ctx) {
     uint8_t m[MOLE_ADMINPASS_LENGTH];
-    PRINTf("\n%s sending Admin token, ", ctx->name);
+    TRACE(MOLE_TR_ADMIN, 0, 0);
     SendHeader(ctx, MOLE_TAG_ADMIN);
     BlockCipher(CTX->tcCtx, ctx->adminpasscode, m, 0);
+    ctx->tPos++;
     SendBlock(ctx, m);
     SendTxHash(ctx, MOLE_END_UNPADDED);
 }
@@ -419,28 +937,577 @@ uint32_t moleAvail(port_ctx *ctx){
     return (ctx->avail << BLOCK_SHIFT) - (MOLE_HMAC_LENGTH + PREAMBLE_SIZE);
 }
 
+int molePrecompute(port_ctx *ctx, int budget) {
+    int steps = 0;
+    if ((ctx->primed & PRIME_HOLD) || ctx->work) return 0;
+    if (ctx->tReady && (steps < budget) && (ctx->sendState != SEND_BODY)
+     && (!(ctx->primed & PRIMED_TX) || (ctx->primeTX != ctx->hashCounterTX))) {
+        BeginHash(CTX->thCtx, ctx->hmackey, MOLE_HMAC_LENGTH,
+                  ctx->hashCounterTX);
+        ctx->primeTX = ctx->hashCounterTX;
+        ctx->primed |= PRIMED_TX;
+        steps++;
+    }
+    if (ctx->rReady && (ctx->state == IDLE) && (steps < budget)
+     && (!(ctx->primed & PRIMED_RX) || (ctx->primeRX != ctx->hashCounterRX))) {
+        BeginHash(CTX->rhCtx, ctx->hmackey, MOLE_HMAC_LENGTH,
+                  ctx->hashCounterRX);
+        ctx->primeRX = ctx->hashCounterRX;
+        ctx->primed |= PRIMED_RX;
+        steps++;
+    }
+    if (FillCipher == NULL) return steps;
+    while (steps < budget) {            // keystream, alternating directions
+        int n = ctx->tReady ? FillCipher(CTX->tcCtx, 1) : 0;
+        if (ctx->rReady && ((steps + n) < budget)) {
+            n += FillCipher(CTX->rcCtx, 1);
+        }
+        if (!n) break;
+        steps += n;
+    }
+    return steps;
+}
+
+// Lend the message to the app in a free ring buffer, NULL if there is none
+static const uint8_t *Lend(port_ctx *ctx, const uint8_t *src, int len) {
+    mole_ring *g = ctx->ring;
+    int k = 0;
+    while ((k < g->count) && (g->held & (1 << k))) k++;
+    if ((k == g->count) || (len >= (ctx->rBlocks << BLOCK_SHIFT))) {
+        ctx->stats.overruns++;
+        return NULL;
+    }
+    uint8_t *b = g->buf[k];
+    if (src == &ctx->rxbuf[1]) {        // swap, the FSM gets the free one
+        g->buf[k] = ctx->rxbuf;
+        ctx->rxbuf = b;
+    } else {
+        memcpy(&b[1], src, len);
+    }
+    g->held |= 1 << k;
+    g->len[k] = len;
+    return &g->buf[k][1];
+}
+
+// App receive buffers, see moleRxInto: a message frame goes to rxapp if
+// there is one. When it is delivered, the app has it and rxapp is cleared.
+
+static void ToApp(port_ctx *ctx) {
+    if (ctx->rxFn == NULL) return;
+    if (ctx->rxapp == NULL) ctx->rxapp = ctx->rxFn(ctx->rBlocks << BLOCK_SHIFT);
+    if (ctx->rxapp != NULL) ctx->rxbuf = ctx->rxapp;
+}
+
+static int Handed(port_ctx *ctx) {      // the app has the frame's buffer
+    return ctx->rxFn && (ctx->rxbuf != ctx->rxstage)
+        && (ctx->rxbuf != ctx->rxapp);
+}
+
+static void Restage(port_ctx *ctx) {    // back to the port's own rxbuf
+    if (ctx->rxbuf == ctx->rxapp) {     // not delivered, keep it for the next
+        memset(ctx->rxapp, 0, ctx->ridx);
+    }
+    ctx->rxbuf = ctx->rxstage;
+}
+
+static int Deliver(port_ctx *ctx, const uint8_t *src, int len) {
+    STAMP(t0);
+    if (ctx->ring != NULL) {
+        src = Lend(ctx, src, len);
+        if (src == NULL) return MOLE_ERROR_OVERRUN;
+    } else if ((ctx->rxapp != NULL) && (src == &ctx->rxapp[1])) {
+        memset(&ctx->rxapp[len + 1], 0, ctx->ridx - len - 1); // padding, HMAC
+        ctx->rxapp = NULL;
+    }
+    ctx->plainFn(src, len);
+    TIMED(MOLE_STAGE_DELIVER, t0);
+    return 0;
+}
+
 // ---------------------------------------------------------------------------
+// Resynchronization: A bad sequenced message is dropped without re-pairing.
+// The next good one tells the receiver how many messages and keystream blocks
+// to skip. Lost messages are reported back to the sender.
+
+static void SeekRX(port_ctx *ctx, uint32_t pos) {
+    if (ctx->rPos != pos) {             // only seek if out of step
+        SeekCipher(CTX->rcCtx, pos);
+        ctx->rPos = pos;
+    }
+}
+
+static void Rollback(port_ctx *ctx) {   // forget a bad sequenced frame
+    ctx->hashCounterRX -= ctx->rGap + ctx->MACed;
+    ctx->rGap = 0;
+}
+
+// Return 0 if the message should be delivered, else an error code
+static int Resync(port_ctx *ctx, int r, int blocks) {
+    uint32_t skip = ctx->rPos - ctx->rPosOK - blocks;
+    if (r) {
+        Rollback(ctx);
+        TRACE(MOLE_TR_DROPPED, ctx->rBad, 0);
+        if (++ctx->rBad < MOLE_RESYNC_WINDOW) return r;
+    } else if ((ctx->rGap < MOLE_RESYNC_WINDOW) && (skip <= MOLE_RESYNC_BLOCKS)) {
+        ctx->rBad = 0;
+        ctx->rPosOK = ctx->rPos;
+        return 0;
+    }
+    molePair(ctx);                      // synchronization is really lost
+    return MOLE_ERROR_OUT_OF_SYNC;
+}
+
+// Sent after the message is handled, the reply may re-enter molePutc
+static void ReportLost(port_ctx *ctx, uint64_t first, uint8_t count) {
+    uint8_t m[9];
+    if (moleAvail(ctx) < sizeof(m)) return;
+    memcpy(m, &first, 8);
+    m[8] = count;
+    TRACE(MOLE_TR_LOST, count, 0);
+    moleSendMsg(ctx, m, sizeof(m), MOLE_MSG_LOST);
+}
+
+// ---------------------------------------------------------------------------
+// Selective repeat: MOLE_MSG_ARQ messages are numbered and held until the
+// receiver acknowledges them. An ACK carries the next sequence number the
+// receiver expects and a bitmap of the ones after it that it is holding.
+// The link delivers in order, so a hole below a held message is a loss.
+
+static void ArqSend(port_ctx *ctx, uint8_t seq) {
+    mole_arq *q = ctx->arq;
+    int slot = TxSlot(q, seq);
+    const uint8_t *src = &q->txq[slot * q->size];
+    q->age[slot] = 0;
+    moleSendInit(ctx, MOLE_MSG_ARQ);
+    moleSendChar(ctx, seq);
+    for (int i = 0; i < q->txlen[slot]; i++) moleSendChar(ctx, src[i]);
+    moleSendFinal(ctx);
+}
+
+// On a timeout, only the oldest message is resent. If the ACK was what got
+// lost, the receiver answers the repeat with an ACK that accounts for the rest.
+
+static void ArqFlush(port_ctx *ctx) {   // resend lost or timed-out messages
+    mole_arq *q = ctx->arq;
+    for (uint8_t seq = q->txBase; seq != q->txNext; seq++) {
+        if (!moleAvail(ctx)) return;
+        if ((uint8_t)(seq - q->txBase) >= (uint8_t)(q->txNext - q->txBase)) {
+            continue;                   // acknowledged in the meantime
+        }
+        uint8_t age = q->age[TxSlot(q, seq)];
+        if ((age == ARQ_LOST)
+         || ((seq == q->txBase) && (age >= MOLE_ARQ_TIMEOUT))) {
+            ArqSend(ctx, seq);
+            q->resent++;
+        }
+    }
+}
+
+static void ArqAck(port_ctx *ctx) {     // next seq[1], received bitmap[2]
+    mole_arq *q = ctx->arq;
+    uint8_t m[3];
+    uint16_t map = 0;
+    if (moleAvail(ctx) < sizeof(m)) return; // still due, try again later
+    for (int i = 0; i < (q->slots - 1); i++) {
+        if (q->rxMap & (1 << RxSlot(q, q->rxBase + 1 + i))) map |= 1 << i;
+    }
+    m[0] = q->rxBase;
+    m[1] = (uint8_t)map;
+    m[2] = (uint8_t)(map >> 8);
+    q->ackDue = 0;
+    q->ackAge = 0;
+    moleSendMsg(ctx, m, sizeof(m), MOLE_MSG_ACK);
+}
+
+static void ArqAcked(port_ctx *ctx, const uint8_t *src) {
+    mole_arq *q = ctx->arq;
+    uint8_t pending = q->txNext - q->txBase;
+    if ((uint8_t)(src[0] - q->txBase) > pending) return; // stale ACK
+    q->txBase = src[0];
+    pending = q->txNext - q->txBase;
+    uint32_t got = (src[1] | (src[2] << 8)) << 1; // bit 0 is txBase
+    for (uint8_t i = 0; got && (i < pending); i++, got >>= 1) {
+        if (!(got & 1)) {               // a later message got through
+            q->age[TxSlot(q, q->txBase + i)] = ARQ_LOST;
+        }
+    }
+}
+
+static int ArqReceive(port_ctx *ctx, const uint8_t *src, int len) {
+    mole_arq *q = ctx->arq;
+    uint8_t seq = *src++;
+    uint8_t ahead = seq - q->rxBase;
+    int slot = RxSlot(q, seq);
+    len--;
+    if (ahead >= q->slots) {            // a repeat, its ACK was lost
+        ArqAck(ctx);
+        return 0;
+    }
+    if (ahead) {                        // early, hold it until the gap fills
+        if (q->rxMap & (1 << slot)) return 0;
+        memcpy(&q->rxq[slot * q->size], src, len);
+        q->rxlen[slot] = len;
+        q->rxMap |= 1 << slot;
+        if ((ahead == 1) || !(q->rxMap & (1 << RxSlot(q, seq - 1)))) {
+            ArqAck(ctx);                // NAK a new gap
+        }
+        return 0;
+    }
+    if (q->rxMap & (1 << slot)) {       // held since an overrun
+        q->rxMap &= ~(1 << slot);
+        memset(&q->rxq[slot * q->size], 0, q->rxlen[slot]);
+    }
+    int r = Deliver(ctx, src, len);
+    if (r) return r;                    // not acknowledged, it comes again
+    int held = q->rxMap;
+    while (1) {
+        q->rxBase++;
+        q->ackDue++;
+        slot = RxSlot(q, q->rxBase);
+        if (!(q->rxMap & (1 << slot))) break;
+        uint8_t *m = &q->rxq[slot * q->size];
+        r = Deliver(ctx, m, q->rxlen[slot]);
+        if (r) break;                   // held until it comes again
+        q->rxMap &= ~(1 << slot);
+        memset(m, 0, q->rxlen[slot]);   // burn after reading
+    }
+    if (held || (q->ackDue >= (q->slots - (q->slots >> 2)))) ArqAck(ctx);
+    return r;
+}
+
+// ---------------------------------------------------------------------------
+// Compression: messages are compressed on their own, so a lost message
+// does not affect the others. Decompressed data is limited to lz->rxsize.
+
+static void LzChar(void *port, uint8_t c) {
+    port_ctx *ctx = port;
+    ctx->lz->packed++;
+    moleSendChar(ctx, c);
+}
+
+static void LzBuf(void *port, uint8_t c) { // to lz->txbuf for moleSendPump
+    mole_lz *z = ((port_ctx *)port)->lz;
+    z->packed++;
+    z->txbuf[z->txfill++] = c;
+}
+
+// Compressed length, 0 if compression does not help
+static int Packed(port_ctx *ctx, const uint8_t *src, int len) {
+    mole_lz *z = ctx->lz;
+    if (!LZ || (len > (int)moleAvail(ctx))) return 0;
+    lz_enc_init(&z->enc);
+    int n = lz_encode(&z->enc, src, len, 0, MOLE_LZ_WINDOW, NULL, NULL);
+    n += lz_flush(&z->enc, 0, NULL, NULL);
+    return (n < len) ? n : 0;
+}
+
+static int Compress(port_ctx *ctx, const uint8_t *src, int len) {
+    mole_lz *z = ctx->lz;
+    if (!Packed(ctx, src, len)) return 0;
+    z->plain += len;
+    moleSendInit(ctx, MOLE_MSG_LZ);
+    lz_enc_init(&z->enc);
+    lz_encode(&z->enc, src, len, 0, MOLE_LZ_WINDOW, LzChar, ctx);
+    lz_flush(&z->enc, 0, LzChar, ctx);
+    moleSendFinal(ctx);
+    return 1;
+}
+
+static int Decompress(port_ctx *ctx, const uint8_t *src, int len) {
+    mole_lz *z = ctx->lz;
+    int r = 0;
+    lz_dec_init(&z->dec, z->rxbuf, z->rxsize, NULL);
+    while (len-- && !r) r = lz_dec_putc(&z->dec, *src++);
+    if (r || (z->dec.count > z->rxsize)) return MOLE_ERROR_INVALID_LENGTH;
+    r = Deliver(ctx, z->rxbuf, z->dec.count);
+    memset(z->rxbuf, 0, z->rxsize);     // burn after reading
+    return r;
+}
+
+// ---------------------------------------------------------------------------
+// Coalescing: small messages wait in a batch of length[1], data[] records,
+// which is sent as one MOLE_MSG_BATCH. The receiver delivers them one by one.
+
+// Add a small message to the batch, sending the batch first if it is too
+// full. Returns 0 if the message is not coalesced.
+static int Coalesce(port_ctx *ctx, const uint8_t *src, int len) {
+    mole_batch *b = ctx->batch;
+    if (!BATCH || (len > MOLE_BATCH_RECORD)) return 0;
+    int limit = moleAvail(ctx) - 1;
+    if (limit > b->size) limit = b->size;
+    if ((b->fill + 1 + len) > limit) moleFlush(ctx);
+    if ((1 + len) > limit) return 0;
+    if (!b->fill) b->age = 0;
+    b->buf[b->fill++] = (uint8_t)len;
+    memcpy(&b->buf[b->fill], src, len);
+    b->fill += len;
+    if ((b->fill + 1) >= limit) moleFlush(ctx); // full
+    return 1;
+}
+
+static int Unbatch(port_ctx *ctx, const uint8_t *src, int len) {
+    int i = 0;
+    while (i < len) i += src[i] + 1;    // all of the records must be there
+    if (i != len) return MOLE_ERROR_INVALID_LENGTH;
+    for (i = 0; i < len; i += src[i] + 1) {
+        int r = Deliver(ctx, &src[i + 1], src[i]);
+        if (r) return r;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Cooperative mode: molePutc leaves the heavy work (handling a frame, sending
+// an IV, pairing, deriving keys) to molePoll, which does it in slices. A frame
+// that starts before the work is done is dropped, so molePutc stays bounded.
+
+static int Job(port_ctx *ctx, uint8_t work, int steps) {
+    switch (work) {
+    case WORK_IV_A:
+        Requeue(ctx);
+        ctx->hashCounterTX = 0;
+        return SendIV(ctx, MOLE_TAG_IV_A, ctx->caps);
+    case WORK_IV_B:
+        return SendIV(ctx, MOLE_TAG_IV_B, ctx->caps);
+    case WORK_PAIR:
+        molePair(ctx);
+        return 0;
+    default:                            // WORK_KEYS
+        if (Derive(ctx, steps)) {
+            ctx->work |= WORK_KEYS;     // not done yet
+            return 0;
+        }
+        ctx->stats.rekeys++;
+        TRACE(MOLE_TR_REKEYED, 0, 0);
+        return MOLE_ERROR_REKEYED;
+    }
+}
+
+static int Work(port_ctx *ctx, uint8_t work) {
+    if (!ctx->defer) return Job(ctx, work, KDF_STEPS);
+    ctx->work |= work;
+    return 0;
+}
+
+// Handle a received frame, authenticated or not. In cooperative mode this is
+// molePoll's work, so that molePutc returns quickly at the end of a frame.
+static int Frame(port_ctx *ctx) {
+    int i;
+    int temp = ctx->ridx - MOLE_HMAC_LENGTH;
+    uint8_t c = ctx->rxbuf[0];          // message type
+    uint8_t *k;
+    uint8_t lost = 0;                   // messages to report lost
+    uint64_t first = 0;
+    int r = testHMAC(ctx, &ctx->rxbuf[temp]); // 0 if okay, else bad HMAC
+    TRACE2(MOLE_TR_RECEIVED, temp, ctx->tag);
+    TRACE2(MOLE_TR_MSG_TYPE, c, 0);
+    if (r) {
+        TRACE(MOLE_TR_BAD_HMAC, 0, 0);
+        ctx->stats.badHMAC++;
+        ctx->stats.rejected++;
+    } else {
+        ctx->stats.framesIn++;
+    }
+    TIMED(MOLE_STAGE_FRAME, ctx->timing.frame);
+    switch (ctx->tag) {
+    case MOLE_TAG_IV_A:
+    case MOLE_TAG_IV_B:
+        if (r && RESYNC) {              // keep the session, it may be noise
+            Rollback(ctx);
+            break;
+        }
+        Requeue(ctx);                   // the TX counter is about to change
+        if (ctx->tag == MOLE_TAG_IV_A) {
+            ctx->tReady = 0;
+            ctx->hashCounterTX = 0;
+        }
+        ctx->rReady = 0;
+        if (r) break;
+        k = &ctx->rxbuf[2 * MOLE_IV_LENGTH + ivADlength];
+        i = 0;                          // caps, slots, data, parity
+        ctx->peerCaps = 0;
+        if (temp > (2 * MOLE_IV_LENGTH + ivADlength)) {
+            ctx->peerCaps = k[i++];
+            if (ctx->peerCaps & MOLE_CAP_ARQ) i++;
+            if (ctx->peerCaps & MOLE_CAP_FEC) i += 2;
+        }
+        if (temp != (2 * MOLE_IV_LENGTH + ivADlength + i)) {
+            TRACE(MOLE_TR_IV_FUNNY, 0, 0);
+            ctx->peerCaps = 0;
+            r = MOLE_ERROR_INVALID_LENGTH;
+            break;
+        }
+        i = 1;
+        if (ctx->arq) ArqReset(ctx->arq, ARQ ? k[i] : 0);
+        if (ctx->peerCaps & MOLE_CAP_ARQ) i++;
+        if (FEC && ((k[i] > (255 - k[i + 1])) || !k[i]
+                 || rs_init(&ctx->fec->rx, k[i + 1]))) {
+            ctx->peerCaps &= ~MOLE_CAP_FEC;     // unusable code rate
+        }
+        if (FEC) ctx->fec->rxData = k[i];
+        TRACE(MOLE_TR_TEMP_IV, 0, 0);
+        BeginCipher(CTX->rcCtx, ctx->cryptokey, ctx->rxbuf, 0);
+        BlockCipher(CTX->rcCtx, &ctx->rxbuf[MOLE_IV_LENGTH],
+                    &ctx->rxbuf[MOLE_IV_LENGTH], 1);
+        BeginCipher(CTX->rcCtx, ctx->cryptokey,
+                    &ctx->rxbuf[MOLE_IV_LENGTH], 0);
+        ctx->rPos = 0;
+        ctx->rPosOK = 0;
+        ctx->rBad = 0;
+        memcpy(&ctx->hashCounterTX, &ctx->rxbuf[MOLE_IV_LENGTH], 8);
+        memcpy(&ctx->avail, &ctx->rxbuf[2 * MOLE_IV_LENGTH], 2);
+        ctx->rReady = 1;
+            TRACE(MOLE_TR_RX_IV, ctx->tag, 0);
+            DUMP((uint8_t*)&ctx->hashCounterRX, 8);
+            TRACE2(MOLE_TR_RX_CTR, 0, 0);
+            DUMP((uint8_t*)&ctx->rxbuf[MOLE_IV_LENGTH], MOLE_IV_LENGTH);
+            TRACE2(MOLE_TR_PRIVATE_CIV, 0, 0);
+        if (ctx->tag == MOLE_TAG_IV_A) {
+            r = Work(ctx, WORK_IV_B);
+        }
+        break;
+    case MOLE_TAG_ADMIN:
+        if (r && RESYNC) {
+            Rollback(ctx);
+            break;
+        }
+        ctx->adminOK = 0;
+        if (r) break;
+            DUMP(ctx->adminpasscode, MOLE_ADMINPASS_LENGTH);
+            TRACE2(MOLE_TR_PASS_EXPECTED, 0, 0);
+            DUMP(ctx->rxbuf, MOLE_ADMINPASS_LENGTH);
+            TRACE2(MOLE_TR_PASS_ACTUAL, 0, 0);
+        ctx->rPosOK = ctx->rPos;
+        if (memcmp(ctx->rxbuf, ctx->adminpasscode,
+                   MOLE_ADMINPASS_LENGTH) == 0) {
+            ctx->adminOK = MOLE_ADMIN_ACTIVE;
+        }
+        break;
+    case MOLE_TAG_SEQMSG:
+        r = Resync(ctx, r, temp / MOLE_BLOCKSIZE);
+        if (r) break;                   // dropped, the session survives
+        lost = ctx->rGap;
+        ctx->stats.lost += lost;
+        first = ctx->hashCounterRX - lost - 1;
+        // fall through
+    case MOLE_TAG_MESSAGE:
+        if (r) {
+            if (RESYNC) Rollback(ctx);     // stray tag, the peer sends SEQMSG
+            else molePair(ctx);         // assume synchronization is lost
+        } else {
+            ctx->rPosOK = ctx->rPos;
+            switch(c) {
+            case MOLE_MSG_MESSAGE:
+                i = ctx->rxbuf[temp - 1];     // remainder
+                temp = temp + i - 17;     // trim padding
+                r = Deliver(ctx, &ctx->rxbuf[1], temp);
+                if (!Handed(ctx)) {
+                    memset(&ctx->rxbuf[1], 0, temp); // burn after reading
+                }
+                break;
+            case MOLE_MSG_NEW_KEY:
+            case MOLE_MSG_REKEYED:
+                TRACE(MOLE_TR_TESTING_KEY, 0, 0);
+                r = testKey(ctx, &ctx->rxbuf[1]);
+                if (r) break;                   // bad key
+                k = ctx->WrKeyFn(&ctx->rxbuf[1]);
+                if (k == NULL) break;           // no key
+                if (c == MOLE_MSG_NEW_KEY) {
+                    moleReKeyRequest(ctx, k, MOLE_MSG_REKEYED);
+                }
+                ctx->workKey = k;       // re-key locally
+                ctx->kdfDone = 0;
+                r = Work(ctx, WORK_KEYS);   // say "you've been re-keyed"
+                break;
+            case MOLE_MSG_LZ:           // compressed data[]
+                if (ctx->lz == NULL) goto unknown;
+                i = ctx->rxbuf[temp - 1];
+                temp = temp + i - 17;
+                r = Decompress(ctx, &ctx->rxbuf[1], temp);
+                memset(&ctx->rxbuf[1], 0, temp);
+                break;
+            case MOLE_MSG_ARQ:          // seq[1], data[]
+                if (ctx->arq == NULL) goto unknown;
+                i = ctx->rxbuf[temp - 1];
+                temp = temp + i - 17;
+                r = ArqReceive(ctx, &ctx->rxbuf[1], temp);
+                memset(&ctx->rxbuf[1], 0, temp);
+                break;
+            case MOLE_MSG_ACK:          // next seq[1], received bitmap[2]
+                if (ctx->arq == NULL) goto unknown;
+                ArqAcked(ctx, &ctx->rxbuf[1]);
+                break;
+            case MOLE_MSG_BATCH:        // length[1], data[] records
+                if (ctx->batch == NULL) goto unknown;
+                i = ctx->rxbuf[temp - 1];
+                temp = temp + i - 17;
+                r = Unbatch(ctx, &ctx->rxbuf[1], temp);
+                memset(&ctx->rxbuf[1], 0, temp);
+                break;
+            case MOLE_MSG_LOST:         // counter[8], count[1]
+                memcpy(&ctx->lostCounter, &ctx->rxbuf[1], 8);
+                ctx->lostCount = ctx->rxbuf[9];
+                r = MOLE_ERROR_MSG_LOST;
+                break;
+            default:                    // or a feature this port lacks
+unknown:        r = MOLE_ERROR_UNKNOWN_MSG;
+                memset(&ctx->rxbuf[1], 0, temp - 1);
+            }
+        }
+        break;
+    default: break;
+    }
+    if (lost) ReportLost(ctx, first, lost); // even if the message was bad
+    return r;
+}
+
+// One slice of the queued work, the lowest WORK_? bit first
+static int Poll(port_ctx *ctx) {
+    uint8_t work = ctx->work & (~ctx->work + 1);
+    ctx->work &= ~work;
+    if (work == WORK_FRAME) return Frame(ctx);
+    return work ? Job(ctx, work, MOLE_POLL_STEPS) : 0;
+}
+
+static int Finish(port_ctx *ctx) {      // all of it, return the last error
+    int r = 0;
+    while (ctx->work) {
+        int ret = Poll(ctx);
+        if (ret) r = ret;
+    }
+    return r;
+}
+
 // Receive char or command from input stream
-int molePutc(port_ctx *ctx, uint8_t c){
+static int PutFSM(port_ctx *ctx, uint8_t c) {
     int r = 0;
     int temp;
-    uint8_t *k;
     // Pack escape sequence to binary ----------------------------------------
     int ended = (c == MOLE_TAG_END);    // distinguish '0A' from '0B 02'
     if (ctx->escaped) {
         ctx->escaped = 0;
         if (c > 1) switch(c) {
-            case MOLE_HMAC_TRIGGER:
+            case MOLE_HMAC_TRIGGER: {
+                STAMP(t0);
                 EndHash(CTX->rhCtx, ctx->hmac);
+                TIMED(MOLE_STAGE_HMAC, t0);
                     DUMP((uint8_t*)&ctx->hashCounterRX, 8);
-                    PRINTF("%s receiving HMAC with hashCounterRX, ", ctx->name);
+                    TRACE2(MOLE_TR_RX_HMAC, 0, 0);
                 ctx->hashCounterRX++;
                 ctx->MACed = 1;
                 return 0;
+            }
+            case MOLE_FEC_TRIGGER:      // coded frame that is not decoded,
+                return 0;               // its HMAC will fail
             default:                    // embedded reset
+                if ((ctx->state != IDLE) && (ctx->tag == MOLE_TAG_SEQMSG)) {
+                    Rollback(ctx);      // more likely a corrupted escape
+                    ctx->stats.rejected++;
+                    ctx->state = IDLE;
+                    return MOLE_ERROR_BAD_HMAC;
+                }
                 ctx->state = IDLE;
-                molePair(ctx);
-                return 0;
+                return Work(ctx, WORK_PAIR); // after the frame before it
         } else {
         c += MOLE_TAG_END;
         }
@@ -450,38 +1517,78 @@ int molePutc(port_ctx *ctx, uint8_t c){
         return 0;
     }
     // FSM ---------------------------------------------------------------------
-    Hash(CTX->rhCtx, c);                // add to hash
+    if ((ctx->state != IDLE) && (ctx->state != SKIP)) { // IDLE restarts
+        Hash(CTX->rhCtx, c);            // it at the tag, which may be primed
+    }
     int i = ctx->ridx;
     switch (ctx->state) {
     case IDLE:
         if (c < MOLE_TAG_GET_BOILER) break; // limit range of valid tags
-        if (c > MOLE_TAG_ADMIN)      break;
-        if (c == MOLE_TAG_IV_A) {
+        if (c > MOLE_TAG_SEQMSG)     break;
+        if (ctx->work) {                // molePoll is behind: drop the frame
+            ctx->stats.overruns++;      // instead of doing its work here
+            ctx->state = SKIP;
+            TRACE(MOLE_TR_HANG, 0, 0);
+            return MOLE_ERROR_OVERRUN;
+        }
+        if (ctx->rxFn) Restage(ctx);
+        if ((c == MOLE_TAG_IV_A) && !RESYNC) {
+            Requeue(ctx);
             ctx->hashCounterRX = 0;     // before initializing the hash
             ctx->rReady = 0;
             ctx->tReady = 0;
         }
-        BeginHash(CTX->rhCtx, ctx->hmackey, MOLE_HMAC_LENGTH,
-                  ctx->hashCounterRX);
-        Hash(CTX->rhCtx, c);
+        FRAME_START;
         ctx->tag = c;
         ctx->MACed = 0;
+        ctx->rGap = 0;
         ctx->state = DISPATCH;
+        if (c == MOLE_TAG_SEQMSG) {     // hash waits for the sequence number
+            ctx->ridx = 0;
+            ctx->state = GET_AD;
+            break;
+        }
+        if (c == MOLE_TAG_ADMIN) {
+            SeekRX(ctx, ctx->rPosOK);   // in case a bad message was dropped
+        }
+        BeginRX(ctx, (c == MOLE_TAG_IV_A) ? 0 : ctx->hashCounterRX);
+        Hash(CTX->rhCtx, c);
         break;
+    case GET_AD:                        // seq[1], position[2]
+        ctx->rxbuf[ctx->ridx++] = c;
+        if (ctx->ridx == SEQ_AD_LENGTH) {
+            ctx->rGap = ctx->rxbuf[0] - (uint8_t)ctx->hashCounterRX;
+            ctx->hashCounterRX += ctx->rGap;
+            BeginRX(ctx, ctx->hashCounterRX);
+            Hash(CTX->rhCtx, ctx->tag);
+            for (i = 0; i < SEQ_AD_LENGTH; i++) {
+                Hash(CTX->rhCtx, ctx->rxbuf[i]);
+            }
+            temp = (ctx->rxbuf[1] | (ctx->rxbuf[2] << 8)) - ctx->rPosOK;
+            SeekRX(ctx, ctx->rPosOK + (uint16_t)temp);
+            ToApp(ctx);
+            ctx->ridx = 0;
+            ctx->state = GET_PAYLOAD;
+        }
+        goto noend;
     case DISPATCH: // message data begins here
+        if (ctx->tag == MOLE_TAG_MESSAGE) ToApp(ctx);
         ctx->rxbuf[0] = c;
         ctx->ridx = 1;
         ctx->state = GET_PAYLOAD;
-            PRINTF("\n%s incoming packet, tag=%d\n", ctx->name, ctx->tag);
+            TRACE2(MOLE_TR_INCOMING, ctx->tag, 0);
         switch (ctx->tag) {
-        case MOLE_TAG_GET_BOILER:
-            SendBoiler(ctx);
+        case MOLE_TAG_GET_BOILER:       // requests are just the tag and END
+            if (ended) {
+                ctx->stats.boilerReqs++;
+                SendBoiler(ctx);
+            }
             ctx->state = IDLE;
             break;
         case MOLE_TAG_RESET:
-            ctx->hashCounterTX = 0;
             ctx->state = IDLE;
-            r = SendIV(ctx, MOLE_TAG_IV_A);
+            if (!ended) break;          // stray tag in a run of ciphertext
+            r = Work(ctx, WORK_IV_A);
             break;
         case MOLE_TAG_BOILERPLATE:
             ctx->state = GET_BOILER;
@@ -493,18 +1600,21 @@ int molePutc(port_ctx *ctx, uint8_t c){
         }
         if (ended) ctx->state = IDLE;
         break;
+    case SKIP:
+        if (ended) ctx->state = IDLE;
+        break;
     case HANG:                          // wait for end tsg
 noend:  if (ended) {                    // premature end not allowed
+            if (RESYNC || (ctx->tag == MOLE_TAG_SEQMSG)) Rollback(ctx);
             ctx->state = IDLE;
-            PRINTf("\nHANG state ");
+            ctx->stats.rejected++;
+            TRACE(MOLE_TR_HANG, 0, 0);
             r = MOLE_ERROR_INVALID_LENGTH;
         }
         break;
-    case GET_IV:
+    case GET_IV:                        // mIV[], cIV[] are not decrypted yet
         ctx->rxbuf[ctx->ridx++] = c;
-        if (ctx->ridx == MOLE_IV_LENGTH) {
-            PRINTf("\nSet temporary IV for decrypting the secret IV ");
-            BeginCipher(CTX->rcCtx, ctx->cryptokey, ctx->rxbuf, 0);
+        if (ctx->ridx == 2 * MOLE_IV_LENGTH) {
             ctx->state = GET_PAYLOAD;
         }
         goto noend;
@@ -523,102 +1633,26 @@ noend:  if (ended) {                    // premature end not allowed
         break;
     case GET_PAYLOAD:
         if (!ended) {                   // input terminated by end tag
-            if (i != (ctx->rBlocks << BLOCK_SHIFT)) {
+            if (i != RX_SIZE) {
                 ctx->rxbuf[ctx->ridx++] = c;
                 temp = ctx->ridx;
                 if (!ctx->MACed && !(temp & (MOLE_BLOCKSIZE - 1))) {
                     temp -= MOLE_BLOCKSIZE; // -> beginning of block
-                PRINTF("\n%s decrypting payload rxbuf[%d]; ", ctx->name,temp);
+                TRACE2(MOLE_TR_DECRYPT, temp, 0);
                     BlockCipher(CTX->rcCtx, &ctx->rxbuf[temp],
                                 &ctx->rxbuf[temp], 1);
+                    ctx->rPos++;
                 }
             } else {
                 ctx->state = HANG;
-                PRINTf("\nGET_PAYLOAD state ");
+                TRACE(MOLE_TR_OVERFLOW, 0, 0);
                 r = MOLE_ERROR_INVALID_LENGTH;
             }
             break;
         }
         ctx->state = IDLE;
-        temp = i - MOLE_HMAC_LENGTH;
-        c = ctx->rxbuf[0];              // repurpose c
-        r = testHMAC(ctx, &ctx->rxbuf[temp]); // 0 if okay, else bad HMAC
-        PRINTF("\n%s received packet of length %d, tag %d, rxbuf[0]=0x%02X; ",
-                ctx->name, temp, ctx->tag, c);
-        if (r) {
-            PRINTf("\n**** Bad HMAC ****");
-        }
-        switch (ctx->tag) {
-        case MOLE_TAG_IV_A:
-            ctx->tReady = 0;
-            ctx->hashCounterTX = 0;
-        case MOLE_TAG_IV_B:
-            ctx->rReady = 0;
-            if (r) break;
-            if (temp != (2 * MOLE_IV_LENGTH + ivADlength)) {
-                PRINTf("\nIV length was funny ");
-                r = MOLE_ERROR_INVALID_LENGTH;
-                break;
-            }
-            BeginCipher(CTX->rcCtx, ctx->cryptokey,
-                        &ctx->rxbuf[MOLE_IV_LENGTH], 0);
-            memcpy(&ctx->hashCounterTX, &ctx->rxbuf[MOLE_IV_LENGTH], 8);
-            memcpy(&ctx->avail, &ctx->rxbuf[2 * MOLE_IV_LENGTH], 2);
-            ctx->rReady = 1;
-                PRINTf("\nReceived IV, tag=%d; ", ctx->tag);
-                DUMP((uint8_t*)&ctx->hashCounterRX, 8);
-                PRINTF("Received HMAC hashCounterRX, ");
-                DUMP((uint8_t*)&ctx->rxbuf[MOLE_IV_LENGTH], MOLE_IV_LENGTH);
-                PRINTF("Private cIV, ");
-            if (ctx->tag == MOLE_TAG_IV_A) {
-                r = SendIV(ctx, MOLE_TAG_IV_B);
-            }
-            break;
-        case MOLE_TAG_ADMIN:
-            ctx->adminOK = 0;
-            if (r) break;
-                DUMP(ctx->adminpasscode, MOLE_ADMINPASS_LENGTH);
-                PRINTF("Expected Passcode");
-                DUMP(ctx->rxbuf, MOLE_ADMINPASS_LENGTH);
-                PRINTF("Actual Passcode");
-            if (memcmp(ctx->rxbuf, ctx->adminpasscode,
-                       MOLE_ADMINPASS_LENGTH) == 0) {
-                ctx->adminOK = MOLE_ADMIN_ACTIVE;
-            }
-            break;
-        case MOLE_TAG_MESSAGE:
-            if (r) {
-                molePair(ctx);          // assume synchronization is lost
-            } else {
-                switch(c) {
-                case MOLE_MSG_MESSAGE:
-                    i = ctx->rxbuf[temp - 1]; // remainder
-                    temp = temp + i - 17; // trim padding
-                    ctx->plainFn(&ctx->rxbuf[1], temp);
-                    memset(&ctx->rxbuf[1], 0, temp); // burn after reading
-                    break;
-                case MOLE_MSG_NEW_KEY:
-                case MOLE_MSG_REKEYED:
-                    PRINTf("\n%s is testing the new key", ctx->name);
-                    temp = testKey(ctx, &ctx->rxbuf[1]);
-                    if (temp) return temp;      // bad key
-                    k = ctx->WrKeyFn(&ctx->rxbuf[1]);
-                    if (k == NULL) return 0;    // no key
-                    if (c == MOLE_MSG_NEW_KEY) {
-                        moleReKeyRequest(ctx, k, MOLE_MSG_REKEYED);
-                    }
-                    moleNewKeys(ctx, k); // re-key locally
-                    PRINTf("\n%s has been re-keyed", ctx->name);
-                    if (r) return r;
-                    r = MOLE_ERROR_REKEYED; // say "you've been re-keyed"
-                    break;
-                default:
-                    r = MOLE_ERROR_UNKNOWN_MSG;
-                }
-            }
-            break;
-        default: break;
-        }
+        if (ctx->defer) ctx->work |= WORK_FRAME;
+        else r = Frame(ctx);
         break;
     default:
         ctx->state = IDLE;
@@ -627,6 +1661,123 @@ noend:  if (ended) {                    // premature end not allowed
     return r;
 }
 
+// Correct a received codeword and pass its data bytes on to the FSM
+static int FecFlush(port_ctx *ctx) {
+    mole_fec *f = ctx->fec;
+    int r = 0;
+    int n = f->rxCount;
+    int e = rs_decode(&f->rx, f->cw, n + f->rxParity);
+    if (e < 0) f->failed++;
+    else f->corrected += e;
+    f->rxCount = 0;                     // before the FSM, it may send
+    f->rxParity = 0;
+    f->rxEsc = 0;
+    for (int i = 0; i < n; i++) {
+        int ret = PutFSM(ctx, f->cw[i]);
+        if (ret) r = ret;
+    }
+    return r;
+}
+
+int molePutc(port_ctx *ctx, uint8_t c) {
+    mole_fec *f = ctx->fec;
+    int r = 0;
+    ctx->stats.bytesIn++;
+    if (f == NULL) return PutFSM(ctx, c);
+    switch (f->rxState) {
+    case FEC_TAG:
+        if (c == MOLE_TAG_END) break;
+        f->rxState = (FEC && FecTag(c)) ? FEC_DATA : FEC_OFF;
+        if (f->rxState == FEC_OFF) break;
+        f->rxCount = 0;
+        f->rxParity = 0;
+        f->rxEsc = 0;
+        // fall through
+    case FEC_DATA:
+        if (c == MOLE_TAG_END) {        // lost the parity, pass data as is
+            f->rxParity = 0;
+            if (f->rxCount) r = FecFlush(ctx);
+            break;
+        }
+        if (f->rxEsc && (c == MOLE_FEC_TRIGGER)) {
+            f->rxCount--;               // short codeword, parity follows
+            f->rxEsc = 0;
+            f->rxState = FEC_PARITY;
+            return 0;
+        }
+        f->rxEsc = (c == MOLE_ESCAPE);
+        f->cw[f->rxCount++] = c;
+        if (f->rxCount == f->rxData) {
+            f->rxEsc = 0;
+            f->rxState = FEC_PARITY;
+        }
+        return 0;
+    case FEC_PARITY:
+        if (c == MOLE_TAG_END) {
+            f->rxParity = 0;
+            if (f->rxCount) r = FecFlush(ctx);
+            break;
+        }
+        if (f->rxEsc) {
+            c = MOLE_TAG_END + (c & 1);
+            f->rxEsc = 0;
+        } else if (c == MOLE_ESCAPE) {
+            f->rxEsc = 1;
+            return 0;
+        }
+        f->cw[f->rxCount + f->rxParity++] = c;
+        if (f->rxParity == f->rx.nparity) {
+            f->rxState = FEC_DATA;
+            return FecFlush(ctx);
+        }
+        return 0;
+    default:
+        break;
+    }
+    if (c == MOLE_TAG_END) f->rxState = FEC_TAG;
+    int ret = PutFSM(ctx, c);
+    return ret ? ret : r;
+}
+
+int molePutBuf(port_ctx *ctx, const uint8_t *src, int len) {
+    int r = 0;
+    while (len--) {
+        int ret = molePutc(ctx, *src++);
+        if (ret) r = ret;
+    }
+    return r;
+}
+
+int moleDrain(port_ctx *ctx, fifo_ctx *rx, int max) {
+    const uint8_t *p;
+    int r = 0;
+    if (max <= 0) max = FIFO_MAX_SIZE;
+    while (max) {                       // at most twice, buf may wrap
+        int n = fifo_peek(rx, &p);
+        if (!n) break;
+        if (n > max) n = max;
+        int ret = molePutBuf(ctx, p, n);
+        if (ret) r = ret;
+        fifo_drop(rx, n);
+        max -= n;
+    }
+    return r;
+}
+
+void moleTxFifo(port_ctx *ctx, fifo_ctx *tx) {
+    if (ctx->txFifo != NULL) TxCommit(ctx);
+    ctx->txFifo = tx;
+}
+
+int molePoll(port_ctx *ctx) {
+    return Poll(ctx);
+}
+
+int moleDefer(port_ctx *ctx, int defer) {
+    ctx->defer = (uint8_t)defer;
+    return defer ? 0 : Finish(ctx);
+}
+
 // ---------------------------------------------------------------------------
 // File output: Init to start a packet, Out to append blocks, Final to finish.
 
@@ -635,48 +1786,410 @@ static void moleFileInit (port_ctx *ctx) {
     SendByte(ctx, MOLE_ANYLENGTH);
 }
 
+static void FileBlock(port_ctx *ctx) {  // send txbuf, already hashed
+    SendTxBuf(ctx);
+    uint32_t p = ctx->counter + 2 * MOLE_HMAC_LENGTH + 3;
+    uint8_t block = (uint8_t)(p >> MOLE_FILE_CHUNK_SIZE_LOG2);
+    if (ctx->prevblock != block) {
+        ctx->prevblock = block;
+        ctx->stats.chunksOut++;
+        SendTxHash(ctx, MOLE_END_PADDED);
+        moleFileInit(ctx);              // restart block if too long
+    }
+}
+
+static void FileChar(void *port, uint8_t c) { // compressed file output
+    port_ctx *ctx = port;
+    ctx->lz->packed++;
+    ctx->txbuf[ctx->txidx++] = c;
+    if (ctx->txidx == MOLE_BLOCKSIZE) {
+        ctx->txidx = 0;
+        HashN(ctx, CTX->rhCtx, ctx->txbuf, MOLE_BLOCKSIZE); // overall hash
+        FileBlock(ctx);                 // uses the rx channel
+    }
+}
+
+// Compress what is in lz->txbuf, keeping the last window as history
+static void FileCompress(port_ctx *ctx) {
+    mole_lz *z = ctx->lz;
+    lz_encode(&z->enc, &z->txbuf[z->txdone], z->txfill - z->txdone,
+              z->txdone, MOLE_LZ_WINDOW, FileChar, ctx);
+    z->txdone = z->txfill;
+    if (z->txfill > MOLE_LZ_WINDOW) {
+        memmove(z->txbuf, &z->txbuf[z->txfill - MOLE_LZ_WINDOW],
+                MOLE_LZ_WINDOW);
+        z->txfill = z->txdone = MOLE_LZ_WINDOW;
+    }
+}
+
 int moleFileNew(port_ctx *ctx) {        // start a new one-way message
-    int r = NewStream(ctx, 0);
+    uint8_t caps = ctx->caps & MOLE_CAP_LZ; // the only cap a file uses
+    int r = NewStream(ctx, 0, caps);
+    if (caps) {
+        ctx->lz->file = 1;
+        ctx->lz->txfill = ctx->lz->txdone = 0;
+        lz_enc_init(&ctx->lz->enc);
+        ctx->txidx = 0;
+    }
+    ctx->primed = PRIME_HOLD;           // both HMAC contexts are in use
     BeginHash(CTX->rhCtx, ctx->hmackey, MOLE_HMAC_LENGTH, ctx->hashCounterRX);
-        DUMP((uint8_t*)&ctx->hashCounterRX, 8);  PRINTF("Overall hash ctr");
+        DUMP((uint8_t*)&ctx->hashCounterRX, 8);  TRACE2(MOLE_TR_OVERALL_CTR, 0, 0);
     ctx->hashCounterTX = ctx->hashCounterRX + 1;
     moleFileInit(ctx);                  // get ready to write blocks
     return r;
 }
 
 void moleFileFinal (port_ctx *ctx) {    // end the one-way message
+    mole_lz *z = ctx->lz;
+    STAMP(t0);
+    if ((z != NULL) && z->file) {
+        FileCompress(ctx);
+        lz_flush(&z->enc, 1, FileChar, ctx);
+        while (ctx->txidx) FileChar(ctx, 0); // pad the last block
+        z->file = 0;
+    }
     SendTxHash(ctx, 0);                 // finish last chunk
+    ctx->stats.chunksOut++;
     SendEnd(ctx);
     SendByteU(ctx, MOLE_TAG_EOF);
     EndHash(CTX->rhCtx, ctx->hmac);
     SendAsHash(ctx, ctx->hmac);         // send overall hash
+    ctx->primed = 0;
+    TIMED(MOLE_STAGE_FILE_OUT, t0);
 }
 
-// Note: len must be a multiple of 16.
+// Note: len must be a multiple of 16 unless the file is compressed.
 void moleFileOut (port_ctx *ctx, const uint8_t *src, int len) {
-    while (len > 0) {
-        memcpy(ctx->txbuf, src, MOLE_BLOCKSIZE);
-        for (int i = 0; i < MOLE_BLOCKSIZE; i++) {
-            Hash(CTX->rhCtx, src[i]);   // overall hash uses rx chan
+    mole_lz *z = ctx->lz;
+    STAMP(t0);
+    if ((z != NULL) && z->file) {
+        z->plain += len;
+        while (len > 0) {
+            int n = 2 * MOLE_LZ_WINDOW - z->txfill;
+            if (n > len) n = len;
+            memcpy(&z->txbuf[z->txfill], src, n);
+            z->txfill += n;
+            src += n;
+            len -= n;
+            if (z->txfill == 2 * MOLE_LZ_WINDOW) FileCompress(ctx);
         }
-        SendTxBuf(ctx);
-        src += MOLE_BLOCKSIZE;
-        len -= MOLE_BLOCKSIZE;
-        uint32_t p = ctx->counter + 2 * MOLE_HMAC_LENGTH + 3;
-        uint8_t block = (uint8_t)(p >> MOLE_FILE_CHUNK_SIZE_LOG2);
-        if (ctx->prevblock != block) {
-            ctx->prevblock = block;
-            SendTxHash(ctx, MOLE_END_PADDED);
-            moleFileInit(ctx);          // restart block if too long
+    } else {
+        HashN(ctx, CTX->rhCtx, src, len); // overall hash, in one piece
+        while (len > 0) {
+            memcpy(ctx->txbuf, src, MOLE_BLOCKSIZE);
+            FileBlock(ctx);
+            src += MOLE_BLOCKSIZE;
+            len -= MOLE_BLOCKSIZE;
         }
     }
+    TIMED(MOLE_STAGE_FILE_OUT, t0);
 }
 
 int moleSend(port_ctx *ctx, const uint8_t *src, int len) {
-    moleSendMsg(ctx, src, len, MOLE_MSG_MESSAGE);
+    STAMP(t0);
+    SendRest(ctx, SEND_QUEUED);         // messages go in order
+    if (Coalesce(ctx, src, len)) return 0;
+    moleFlush(ctx);
+    if (!Compress(ctx, src, len)) {
+        moleSendMsg(ctx, src, len, MOLE_MSG_MESSAGE);
+    }
+    TIMED(MOLE_STAGE_SEND, t0);
+    return 0;
+}
+
+int moleSendv(port_ctx *ctx, const struct mole_iov *iov, int cnt) {
+    STAMP(t0);
+    for (int i = 0; i < cnt; i++) {
+        if (iov[i].len < 0) return MOLE_ERROR_INVALID_LENGTH;
+    }
+    SendRest(ctx, SEND_QUEUED);
+    moleFlush(ctx);
+    moleSendInit(ctx, MOLE_MSG_MESSAGE);
+    for (int i = 0; i < cnt; i++) moleSendBytes(ctx, iov[i].src, iov[i].len);
+    moleSendFinal(ctx);
+    TIMED(MOLE_STAGE_SEND, t0);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Resumable send: moleSendPump encodes the message a step at a time, where a
+// step is the header, one block or the last block and HMAC. A step only
+// starts when the TX FIFO has room for all of it, so nothing is dropped.
+
+#define SEND_STEP (2 * MOLE_BLOCKSIZE + 2 * MOLE_HMAC_LENGTH + 8) /* wire bytes */
+
+static int StepBytes(port_ctx *ctx) {   // FEC adds parity to each codeword
+    mole_fec *f = ctx->fec;
+    if (!FEC) return SEND_STEP;
+    return SEND_STEP + (SEND_STEP / f->txData + 2) * (2 * f->tx.nparity + 2);
+}
+
+static void Step(port_ctx *ctx) {
+    if (ctx->sendState == SEND_QUEUED) {
+        ctx->sendState = SEND_IDLE;     // so that SendHeader does not wait
+        moleSendInit(ctx, ctx->sendType);
+        ctx->sendState = SEND_BODY;
+    } else if (ctx->sendPos < ctx->sendLen) {
+        do moleSendChar(ctx, ctx->sendSrc[ctx->sendPos++]);
+        while (ctx->txidx && (ctx->sendPos < ctx->sendLen));
+    } else {
+        moleSendFinal(ctx);
+        ctx->sendState = SEND_IDLE;
+        ctx->sendSrc = NULL;
+    }
+}
+
+static void SendRest(port_ctx *ctx, uint8_t state) { // finish it, waiting
+    while (ctx->sendState >= state) Step(ctx);
+}
+
+int moleSendBegin(port_ctx *ctx, const uint8_t *src, int len) {
+    mole_lz *z = ctx->lz;
+    if (ctx->sendState || (ctx->primed & PRIME_HOLD)) {
+        return MOLE_ERROR_MSG_NOT_SENT; // busy with a message or a file
+    }
+    moleFlush(ctx);
+    ctx->sendSrc = src;
+    ctx->sendLen = len;
+    ctx->sendType = MOLE_MSG_MESSAGE;
+    int n = Packed(ctx, src, len);
+    if (n && (n <= 2 * MOLE_LZ_WINDOW)) { // compressed into lz->txbuf
+        z->plain += len;
+        z->txfill = 0;
+        lz_enc_init(&z->enc);
+        lz_encode(&z->enc, src, len, 0, MOLE_LZ_WINDOW, LzBuf, ctx);
+        lz_flush(&z->enc, 0, LzBuf, ctx);
+        ctx->sendSrc = z->txbuf;
+        ctx->sendLen = n;
+        ctx->sendType = MOLE_MSG_LZ;
+    }
+    ctx->sendPos = 0;
+    ctx->sendState = SEND_QUEUED;
+    return 0;
+}
+
+int moleSendPump(port_ctx *ctx, int max, int *left) {
+    fifo_ctx *f = ctx->txFifo;
+    uint32_t start = ctx->stats.bytesOut;
+    uint32_t budget = (max > 0) ? (uint32_t)max : 0xFFFFFFFF;
+    int r = 0;
+    STAMP(t0);
+    while (ctx->sendState && !(ctx->primed & PRIME_HOLD)
+        && ((ctx->stats.bytesOut - start) < budget)) {
+        if ((f != NULL) && fifo_used(f) && (fifo_room(f) < StepBytes(ctx))) {
+            r = MOLE_ERROR_TX_FULL;     // come back when the ISR made room
+            break;
+        }
+        Step(ctx);
+        if (f != NULL) TxCommit(ctx);   // the step is one chunk
+    }
+    if (ctx->stats.bytesOut != start) TIMED(MOLE_STAGE_SEND, t0);
+    if (left != NULL) {
+        *left = ctx->sendState ? (int)(ctx->sendLen - ctx->sendPos + 1) : 0;
+    }
+    return r;
+}
+
+int moleArqSend(port_ctx *ctx, const uint8_t *src, int len) {
+    mole_arq *q = ctx->arq;
+    if (!ARQ) return moleSend(ctx, src, len);
+    SendRest(ctx, SEND_QUEUED);
+    moleFlush(ctx);
+    if (!moleAvail(ctx)) return MOLE_ERROR_MSG_NOT_SENT;
+    if ((len >= (int)moleAvail(ctx)) || (len > q->size)) {
+        return MOLE_ERROR_INVALID_LENGTH;
+    }
+    ArqFlush(ctx);                      // lost messages go first
+    if ((uint8_t)(q->txNext - q->txBase) >= q->window) {
+        return MOLE_ERROR_MSG_NOT_SENT; // window is full
+    }
+    uint8_t seq = q->txNext++;
+    int slot = TxSlot(q, seq);
+    memcpy(&q->txq[slot * q->size], src, len);
+    q->txlen[slot] = len;
+    ArqSend(ctx, seq);
+    return 0;
+}
+
+int moleArqTick(port_ctx *ctx) {
+    mole_arq *q = ctx->arq;
+    if (!ARQ) return 0;
+    for (uint8_t seq = q->txBase; seq != q->txNext; seq++) {
+        uint8_t *age = &q->age[TxSlot(q, seq)];
+        if (*age < MOLE_ARQ_TIMEOUT) (*age)++;
+    }
+    ArqFlush(ctx);
+    if (q->ackDue && (++q->ackAge >= (MOLE_ARQ_TIMEOUT - 2))) ArqAck(ctx);
+    return (uint8_t)(q->txNext - q->txBase);
+}
+
+int moleFlush(port_ctx *ctx) {
+    mole_batch *b = ctx->batch;
+    if ((b == NULL) || !b->fill) return 0;
+    STAMP(t0);
+    SendRest(ctx, SEND_QUEUED);
+    if (BATCH && (b->fill < (int)moleAvail(ctx))) {
+        moleSendMsg(ctx, b->buf, b->fill, MOLE_MSG_BATCH);
+    } else {                            // re-paired without it, one by one
+        for (int i = 0; i < b->fill; i += b->buf[i] + 1) {
+            moleSendMsg(ctx, &b->buf[i + 1], b->buf[i], MOLE_MSG_MESSAGE);
+        }
+    }
+    memset(b->buf, 0, b->fill);
+    b->fill = 0;
+    TIMED(MOLE_STAGE_SEND, t0);
     return 0;
 }
 
+int moleBatchTick(port_ctx *ctx) {
+    mole_batch *b = ctx->batch;
+    if ((b == NULL) || !b->fill) return 0;
+    if (b->delay && (++b->age >= b->delay)) moleFlush(ctx);
+    return b->fill;
+}
+
+// ---------------------------------------------------------------------------
+// Statistics: the counters are always on, the optional features keep their own.
+
+void moleStats(port_ctx *ctx, mole_stats *out) {
+    *out = ctx->stats;
+    if (ctx->arq != NULL) out->resent = ctx->arq->resent;
+    if (ctx->fec != NULL) {
+        out->corrected = ctx->fec->corrected;
+        out->uncorrected = ctx->fec->failed;
+    }
+    if (ctx->lz != NULL) {
+        out->plain = ctx->lz->plain;
+        out->packed = ctx->lz->packed;
+    }
+}
+
+static const char *statNames[] = {      // in mole_stats order
+    "bytes_in", "bytes_out", "escapes", "frames_in", "frames_out",
+    "rejected", "bad_hmac", "lost", "pairings", "boiler_reqs", "rekeys",
+    "chunks_in", "chunks_out", "overruns", "tx_full", "resent", "corrected",
+    "uncorrected", "lz_plain", "lz_packed"};
+
+static int Append(char *dest, const char *src) {
+    int n = 0;
+    while (*src) dest[n++] = *src++;
+    return n;
+}
+
+static int Decimal(char *dest, uint32_t x) {
+    char digits[10];
+    int d = 0, n = 0;
+    do {
+        digits[d++] = '0' + (x % 10);
+        x /= 10;
+    } while (x);
+    while (d) dest[n++] = digits[--d];
+    return n;
+}
+
+// Begin a line: mole_<metric>{port="<name>"
+static int Label(char *line, const char *metric, const char *name) {
+    int n = Append(line, "mole_");
+    n += Append(&line[n], metric);
+    n += Append(&line[n], "{port=\"");
+    for (int j = 0; name[j] && (j < 32); j++) line[n++] = name[j];
+    line[n++] = '"';
+    return n;
+}
+
+// End a line with its value and append it to dest if it fits.
+// Returns the new length of dest, or -1 if it is full.
+static int AddLine(char *dest, int len, int size, char *line, int n,
+                   uint32_t value) {
+    line[n++] = '}';
+    line[n++] = ' ';
+    n += Decimal(&line[n], value);
+    line[n++] = '\n';
+    if ((len + n) >= size) return -1;   // whole lines only
+    memcpy(&dest[len], line, n);
+    dest[len + n] = 0;
+    return len + n;
+}
+
+int moleStatsText(const mole_stats *s, const char *name, char *dest, int size){
+    const uint32_t *v = (const uint32_t *)s;
+    int len = 0;
+    if (size > 0) dest[0] = 0;
+    for (int i = 0; i < (int)(sizeof(mole_stats) / sizeof(uint32_t)); i++) {
+        char line[96];
+        int n = Label(line, statNames[i], name);
+        n = AddLine(dest, len, size, line, n, v[i]);
+        if (n < 0) break;
+        len = n;
+    }
+    return len;
+}
+
+#if (MOLE_TIMING)
+static const char *stageNames[MOLE_STAGES] = {
+    "frame", "hmac", "deliver", "send", "iv", "kdf", "file_out", "file_in"};
+
+const uint32_t *moleHistogram(port_ctx *ctx, int stage) {
+    if ((stage < 0) || (stage >= MOLE_STAGES)) return NULL;
+    return ctx->timing.hist[stage];
+}
+
+int moleHistText(port_ctx *ctx, char *dest, int size) {
+    int len = 0;
+    if (size > 0) dest[0] = 0;
+    for (int i = 0; i < MOLE_STAGES; i++) {
+        const uint32_t *h = ctx->timing.hist[i];
+        uint32_t total = 0, sum = 0;
+        for (int b = 0; b < MOLE_HIST_BUCKETS; b++) total += h[b];
+        for (int b = 0; total; b++) {   // up to the highest bucket, +Inf
+            char line[128];
+            int inf = (sum == total) || (b == (MOLE_HIST_BUCKETS - 1));
+            int n = Label(line, "ticks_bucket", ctx->name);
+            n += Append(&line[n], ",stage=\"");
+            n += Append(&line[n], stageNames[i]);
+            n += Append(&line[n], "\",le=\"");
+            if (inf) n += Append(&line[n], "+Inf");
+            else     n += Decimal(&line[n], (1UL << b) - 1);
+            line[n++] = '"';
+            sum += h[b];
+            n = AddLine(dest, len, size, line, n, inf ? total : sum);
+            if (n < 0) return len;
+            len = n;
+            if (inf) break;
+        }
+    }
+    return len;
+}
+#endif
+
+#if (MOLE_TRACE)
+static void Out32(mole_outFn out, uint32_t x, int bytes) {
+    while (bytes--) {
+        out((uint8_t)x);
+        x >>= 8;
+    }
+}
+
+int moleTraceDump(port_ctx *ctx, mole_outFn out) {
+    mole_trace *t = &ctx->trace;
+    uint32_t head = t->head;
+    uint32_t n = (head < MOLE_TRACE_RECORDS) ? head : MOLE_TRACE_RECORDS;
+    for (int i = 0; ctx->name[i]; i++) out(ctx->name[i]);
+    out(0);
+    Out32(out, head, 4);
+    Out32(out, n, 2);
+    for (uint32_t i = head - n; i != head; i++) {
+        const mole_trace_rec *rec = &t->rec[i & (MOLE_TRACE_RECORDS - 1)];
+        out(rec->event);
+        out(rec->port);
+        Out32(out, rec->counter, 2);
+        Out32(out, rec->arg[0], 4);
+        Out32(out, rec->arg[1], 4);
+    }
+    return n;
+}
+#endif
+
 // ---------------------------------------------------------------------------
 // File input: Decrypt and authenticate
 // This is usually done in two passes. The first pass only authenticates.
@@ -764,52 +2277,60 @@ static int NextBlock(port_ctx *ctx, uint8_t *dest) {
 }
 
 int moleFileIn (port_ctx *ctx, mole_inFn cFn, mole_outFn mFn) {
+    Finish(ctx);                        // it uses rxbuf and the contexts
+    if (ctx->rxFn) Restage(ctx);
     done = 0;
 #if (MOLE_TRACE)
     position = 0;
 #endif
     inFn = cFn;
-        PRINTf("\n%s decrypting input stream c, producing output stream m",
-                ctx->name);
-    if (mFn == NULL) PRINTf("\nAuthenticate Only");
+        TRACE(MOLE_TR_FILE_IN, 0, 0);
+    if (mFn == NULL) TRACE(MOLE_TR_AUTH_ONLY, 0, 0);
     FindEndTag();                       // skip boilerplate
     int c = SkipChars(0xFF);            // skip blanks, if there are any
         c = SkipChars(MOLE_TAG_END);    // skip end tags
     if (c != MOLE_TAG_IV_A) return MOLE_ERROR_MISSING_IV;
-        PRINTf("\nIV tag is at position 0x%x ", position - 1);
+        TRACE(MOLE_TR_IV_TAG_AT, position - 1, 0);
     ctx->hashCounterRX = 0;
+    ctx->primed = 0;                    // both HMAC contexts are used here
     BeginHash  (CTX->rhCtx, ctx->hmackey, MOLE_HMAC_LENGTH, 0);
     Hash(CTX->rhCtx, c);                // hash includes the tag
     NextBlock  (ctx, mIV);
-        DUMP(mIV, MOLE_HMAC_LENGTH); PRINTF("mIV read");
+        DUMP(mIV, MOLE_HMAC_LENGTH); TRACE2(MOLE_TR_MIV_READ, 0, 0);
     BeginCipher(CTX->rcCtx, ctx->cryptokey, mIV, 0);
     NextBlock  (ctx, mIV);
-        DUMP(mIV, MOLE_HMAC_LENGTH); PRINTF("cIV read");
+        DUMP(mIV, MOLE_HMAC_LENGTH); TRACE2(MOLE_TR_CIV_READ, 0, 0);
     RX; RX;                             // skip avail field
     BlockCipher(CTX->rcCtx, mIV, cIV, 0);
     memcpy(&ctx->hashCounterRX, cIV, 8);
-        DUMP(cIV, MOLE_HMAC_LENGTH); PRINTF("IV calculated\n");
-        DUMP((uint8_t*)&ctx->hashCounterRX, 8); PRINTF("hashCounterRX ");
+        DUMP(cIV, MOLE_HMAC_LENGTH); TRACE2(MOLE_TR_IV_CALC, 0, 0);
+        DUMP((uint8_t*)&ctx->hashCounterRX, 8); TRACE2(MOLE_TR_FILE_RX_CTR, 0, 0);
     BeginHash  (CTX->thCtx, ctx->hmackey, MOLE_HMAC_LENGTH,
                 ctx->hashCounterRX);
     BeginCipher(CTX->rcCtx, ctx->cryptokey, cIV, 0);
-    if (NextBlock(ctx, mIV)) return MOLE_ERROR_MISSING_HMAC;
-        PRINTf("\nIV HMAC is at position 0x%x ", position);
+    int caps = NextBlock(ctx, mIV);     // caps[1] if compressed
+    if (caps > 1) return MOLE_ERROR_MISSING_HMAC;
+    caps = caps ? mIV[0] : 0;
+    if (caps & MOLE_CAP_LZ) {
+        if (ctx->lz == NULL) return MOLE_ERROR_BUF_TOO_SMALL;
+        lz_dec_init(&ctx->lz->dec, ctx->lz->rxbuf, ctx->lz->rxsize, mFn);
+    }
+        TRACE(MOLE_TR_IV_HMAC_AT, position, 0);
     NextBlock  (ctx, mIV);
     if (testHMAC(ctx, mIV)) {
-badmac: DUMP(ctx->hmac, MOLE_HMAC_LENGTH); PRINTF("expected key hmac ");
-        DUMP(mIV, MOLE_HMAC_LENGTH); PRINTF("actual key hmac\n");
+badmac: DUMP(ctx->hmac, MOLE_HMAC_LENGTH); TRACE2(MOLE_TR_FILE_EXPECTED, 0, 0);
+        DUMP(mIV, MOLE_HMAC_LENGTH); TRACE2(MOLE_TR_FILE_ACTUAL, 0, 0);
         return MOLE_ERROR_BAD_HMAC;
     }
     if (SkipEndTags(3)) return MOLE_ERROR_BAD_END_RUN;
-        PRINTf("\nRandom IV (nonce) has been set up and authenticated");
+        TRACE(MOLE_TR_NONCE_OK, 0, 0);
     ctx->chunks = 0;
     while(1) {
+        STAMP(t0);
         BeginHash(CTX->rhCtx, ctx->hmackey, MOLE_HMAC_LENGTH,
                   ctx->hashCounterRX);
         int n = RX;
-        PRINTf("\nDecrypting the stream at position 0x%x, c=%d\n",
-               position, n);
+        TRACE(MOLE_TR_STREAM_AT, position, n);
         if (n == MOLE_TAG_EOF)    break;
         if (n != MOLE_TAG_RAWTX)  return MOLE_ERROR_NO_RAWPACKET;
         if (RX != MOLE_ANYLENGTH) return MOLE_ERROR_NO_ANYLENGTH;
@@ -818,10 +2339,14 @@ badmac: DUMP(ctx->hmac, MOLE_HMAC_LENGTH); PRINTF("expected key hmac ");
             if (done)             return MOLE_ERROR_STREAM_ENDED;
             if (n < 16) break;          // HMAC was captured
             BlockCipher(CTX->rcCtx, mIV, mIV, 0);
+            HashN(ctx, CTX->thCtx, mIV, 16); // add plaintext to overall hash
             for (int i=0; i<16; i++) {
                 uint8_t c = mIV[i];
-                Hash(CTX->thCtx, c);    // add plaintext to overall hash
-                if (mFn != NULL) mFn(c);
+                if (caps & MOLE_CAP_LZ) {
+                    if (lz_dec_putc(&ctx->lz->dec, c) < 0) {
+                        return MOLE_ERROR_INVALID_LENGTH;
+                    }
+                } else if (mFn != NULL) mFn(c);
             }
         }
         NextBlock(ctx, mIV);            // get expected HMAC
@@ -830,8 +2355,9 @@ badmac: DUMP(ctx->hmac, MOLE_HMAC_LENGTH); PRINTF("expected key hmac ");
         SkipChars(0);                   // skip padding
         if (SkipEndTags(1)) return MOLE_ERROR_BAD_END_RUN;
         ctx->chunks++;
-    }   PRINTf("\nEOF found at position 0x%x, %d chunks\n",
-               position, ctx->chunks);
+        ctx->stats.chunksIn++;
+        TIMED(MOLE_STAGE_FILE_IN, t0);
+    }   TRACE(MOLE_TR_EOF, position, ctx->chunks);
     EndHash(CTX->thCtx, ctx->hmac);
     NextBlock(ctx, mIV);
     if (testHMAC(ctx, mIV)) goto badmac;
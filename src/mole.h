@@ -8,6 +8,9 @@ extern "C" {
 #include <stdint.h>
 #include "xchacha.h"
 #include "blake2s.h"
+#include "reedsolomon.h"
+#include "lzss.h"
+#include "fifo.h"
 
 // Define MOLE_ALLOC_MEM_UINT32S in the project to avoid escess RAM usage
 #ifndef MOLE_ALLOC_MEM_UINT32S
@@ -25,10 +28,73 @@ extern "C" {
 #define MOLE_PASSCODE_HMAC  (MOLE_PASSCODE_LENGTH - MOLE_HMAC_LENGTH)
 #define MOLE_BLOCKSIZE                16 /* Bytes per encryption block */
 
+// moleAddPort protocols
+#define MOLE_PROTOCOL_BLAKE2S          0 /* XChaCha20, BLAKE2s HMAC */
+#define MOLE_PROTOCOL_POLY1305         1 /* XChaCha20, Poly1305 one-time key per message */
+#define MOLE_PROTOCOL_AES              2 /* AES-256-CTR, GHASH */
+#define MOLE_PROTOCOL_BLAKE3           3 /* XChaCha20, keyed BLAKE3 */
+#define MOLE_PROTOCOL_BLAKE2S_MID      4 /* XChaCha20, BLAKE2s from a keyed midstate */
+#define MOLE_PROTOCOLS                 5
+
+// Resynchronization tolerance for sequenced messages (MOLE_CAP_RESYNC)
+#ifndef MOLE_RESYNC_WINDOW
+#define MOLE_RESYNC_WINDOW            16 /* max lost messages, also max bad frames in a row */
+#endif
+#ifndef MOLE_RESYNC_BLOCKS
+#define MOLE_RESYNC_BLOCKS          1024 /* max keystream blocks skipped */
+#endif
+
+// Selective-repeat delivery (MOLE_CAP_ARQ)
+#ifndef MOLE_ARQ_TIMEOUT
+#define MOLE_ARQ_TIMEOUT               8 /* moleArqTick calls before a resend */
+#endif
+#define MOLE_ARQ_MAX_SLOTS            16 /* limited by the ACK bitmap */
+
+// IV generation: DRBG outputs per reseed from moleTRNG, 0 to use moleTRNG only
+#ifndef MOLE_DRBG_RESEED
+#define MOLE_DRBG_RESEED              64
+#endif
+
+// Cooperative mode (moleDefer): key derivation iterations per molePoll call,
+// each one a BLAKE2s compression. A re-key takes 144 of them.
+#ifndef MOLE_POLL_STEPS
+#define MOLE_POLL_STEPS               16
+#endif
+
+// Latency histograms of protocol stages, timed by moleClock
+#ifndef MOLE_TIMING
+#define MOLE_TIMING                    0 /* 1 to enable, needs moleClock */
+#endif
+#define MOLE_HIST_BUCKETS             32 /* log2 buckets of clock ticks */
+
+// Binary event trace: 0 = none, 1 = protocol flow, 2 = also buffer contents
+#ifndef MOLE_TRACE
+#define MOLE_TRACE                     0
+#endif
+#ifndef MOLE_TRACE_RECORDS
+#define MOLE_TRACE_RECORDS            64 /* ring size per port, a power of 2 */
+#endif
+
+// Compression of messages and files (MOLE_CAP_LZ)
+#ifndef MOLE_LZ_WINDOW
+#define MOLE_LZ_WINDOW               256 /* LZSS window in bytes, up to 4095 */
+#endif
+
+// Coalescing of small messages (MOLE_CAP_BATCH)
+#ifndef MOLE_BATCH_RECORD
+#define MOLE_BATCH_RECORD             32 /* longest message that is coalesced, up to 255 */
+#endif
+
+// Receive buffers lent to the app until moleRelease, see moleRxRing
+#ifndef MOLE_RX_RING_MAX
+#define MOLE_RX_RING_MAX               4 /* up to 8 */
+#endif
+
 // Message tags
 #define MOLE_TAG_END                0x0A /* signal end of message (don't change) */
 #define MOLE_ESCAPE                 0x0B
 #define MOLE_HMAC_TRIGGER           0x02 /* 2nd char of escape sequence, triggers HMAC */
+#define MOLE_FEC_TRIGGER            0x03 /* 2nd char of escape sequence, parity follows */
 #define MOLE_TAG_GET_BOILER         0x14 /* request boilerplate */
 #define MOLE_TAG_BOILERPLATE        0x15 /* boilerplate */
 #define MOLE_TAG_RESET              0x16 /* trigger a 2-way IV init */
@@ -36,12 +102,25 @@ extern "C" {
 #define MOLE_TAG_IV_A               0x18 /* signal a 2-way IV init */
 #define MOLE_TAG_IV_B               0x19 /* signal a 1-way IV init */
 #define MOLE_TAG_ADMIN              0x1A /* adminOK password (random 128-bit number) */
+#define MOLE_TAG_SEQMSG             0x1B /* encrypted message with sequence AD */
 #define MOLE_TAG_EOF                0x1E /* End-of-file */
 #define MOLE_TAG_RAWTX              0x1F /* Raw non-repeatable AEAD message */
 
 #define MOLE_MSG_MESSAGE               1
 #define MOLE_MSG_NEW_KEY               2
 #define MOLE_MSG_REKEYED               3
+#define MOLE_MSG_LOST                  4 /* report of lost sequenced messages */
+#define MOLE_MSG_ARQ                   5 /* sequenced data: seq[1], data[] */
+#define MOLE_MSG_ACK                   6 /* next seq[1], received bitmap[2] */
+#define MOLE_MSG_LZ                    7 /* LZSS compressed message */
+#define MOLE_MSG_BATCH                 8 /* records: length[1], data[] */
+
+// Capabilities advertised in the IV exchange
+#define MOLE_CAP_RESYNC             0x01 /* tolerate lost or corrupted messages */
+#define MOLE_CAP_ARQ                0x02 /* acknowledge and resend messages */
+#define MOLE_CAP_FEC                0x04 /* Reed-Solomon coded frames */
+#define MOLE_CAP_LZ                 0x08 /* compressed messages and files */
+#define MOLE_CAP_BATCH              0x10 /* small messages coalesced into one */
 
 #define MOLE_ANYLENGTH              0x01
 #define MOLE_END_UNPADDED              0
@@ -67,6 +146,10 @@ extern "C" {
 #define MOLE_ERROR_BAD_END_RUN        16
 #define MOLE_ERROR_BAD_BIST           17
 #define MOLE_ERROR_UNKNOWN_MSG        18
+#define MOLE_ERROR_MSG_LOST           19
+#define MOLE_ERROR_OUT_OF_SYNC        20
+#define MOLE_ERROR_OVERRUN            21
+#define MOLE_ERROR_TX_FULL            22
 
 enum moleStates {
   IDLE = 0,
@@ -74,7 +157,9 @@ enum moleStates {
   GET_BOILER,
   GET_IV,
   GET_PAYLOAD,
-  HANG
+  HANG,
+  GET_AD,
+  SKIP                      // frame dropped, wait for the end tag
 };
 
 /*
@@ -88,18 +173,191 @@ The FSM is not full-duplex. If the FSM has wait for the UART transmitter
 - Operate in half-duplex mode
 - Buffer the input with a FIFO
 - Buffer the output with a FIFO
+
+fifo.h has lock-free FIFOs for this: the receive ISR puts bytes in one that
+moleDrain feeds to the port, and moleTxFifo sends the port's output to one
+that the transmit ISR empties.
 */
 
 typedef void (*mole_ciphrFn)(uint8_t c);    // output raw ciphertext byte
 typedef void (*mole_plainFn)(const uint8_t *src, int length);
 typedef void (*mole_boilrFn)(const uint8_t *src);
 typedef uint8_t* (*mole_WrKeyFn)(uint8_t* keyset);
+typedef uint8_t* (*mole_bufFn)(uint16_t size);   // app buffer for a message
 
 typedef int  (*hmac_initFn)(size_t *ctx, const uint8_t *key, int hsize, uint64_t ctr);
 typedef void (*hmac_putcFn)(size_t *ctx, uint8_t c);
+typedef void (*hmac_putsFn)(size_t *ctx, const uint8_t *src, int len);
 typedef int  (*hmac_finalFn)(size_t *ctx, uint8_t *out);
 typedef void (*crypt_initFn)(size_t *ctx, const uint8_t *key, const uint8_t *iv, int mode);
 typedef void (*crypt_blockFn)(size_t *ctx, const uint8_t *in, uint8_t *out, int mode);
+typedef void (*crypt_seekFn)(size_t *ctx, uint32_t block);
+typedef int  (*crypt_fillFn)(size_t *ctx, int blocks);
+
+/*
+Selective-repeat queues. Sequence numbers are 8-bit. A message's slot is its
+sequence number modulo the number of slots (a power of 2), the transmit side
+being offset by txShift so that the queue need not move when it is renumbered.
+*/
+
+typedef struct
+{   uint8_t *txq;           // retransmit queue, slots * size bytes
+    uint8_t *rxq;           // reorder buffer, slots * size bytes
+    uint16_t txlen[MOLE_ARQ_MAX_SLOTS];
+    uint16_t rxlen[MOLE_ARQ_MAX_SLOTS];
+    uint8_t age[MOLE_ARQ_MAX_SLOTS];    // ticks since the message was sent
+    uint16_t size;          // bytes per slot
+    uint16_t rxMap;         // reorder slots in use
+    uint8_t slots;          // local window
+    uint8_t window;         // negotiated send window
+    uint8_t txBase;         // oldest unacknowledged sequence number
+    uint8_t txNext;         // next sequence number to send
+    uint8_t txShift;        // slot offset of the transmit queue
+    uint8_t rxBase;         // next sequence number to deliver
+    uint8_t ackDue;         // deliveries not yet acknowledged
+    uint8_t ackAge;         // ticks since the first of them
+    uint32_t resent;        // messages sent again
+} mole_arq;
+
+/*
+Forward error correction of encrypted frames (MESSAGE, SEQMSG and ADMIN tags).
+The wire bytes of a frame, after escaping, are split into codewords of `data`
+bytes, each followed by its escaped parity. A shorter last codeword is marked
+by ESC FEC_TRIGGER before its parity. Each end sends at its own code rate.
+*/
+
+enum moleFecStates {
+  FEC_TAG = 0,              // first byte after END decides
+  FEC_DATA,
+  FEC_PARITY,
+  FEC_OFF                   // frame is not coded
+};
+
+typedef struct
+{   rs_ctx tx;              // encoder at the local code rate
+    rs_ctx rx;              // decoder at the peer's code rate
+    uint8_t cw[255];        // codeword being received
+    uint8_t txData;         // data bytes per codeword sent
+    uint8_t rxData;         // data bytes per codeword received
+    uint8_t txCount;        // data bytes in the codeword being sent
+    uint8_t rxCount;        // data bytes in the codeword being received
+    uint8_t rxParity;       // parity bytes received
+    uint8_t rxEsc;          // previous byte was MOLE_ESCAPE
+    enum moleFecStates txState;
+    enum moleFecStates rxState;
+    uint32_t corrected;     // bytes corrected
+    uint32_t failed;        // codewords that could not be corrected
+} mole_fec;
+
+// Compression state. Messages are compressed on their own, files as a stream.
+
+typedef struct
+{   lz_enc enc;             // file compressor
+    lz_dec dec;             // message and file decompressor
+    uint8_t *rxbuf;         // decompressed message or file history
+    uint8_t *txbuf;         // file history and lookahead
+    uint16_t rxsize;
+    uint16_t txfill;        // bytes in txbuf
+    uint16_t txdone;        // bytes of txbuf compressed
+    uint8_t file;           // compressing a file
+    uint32_t plain;         // plaintext bytes compressed
+    uint32_t packed;        // compressed bytes sent
+} mole_lz;
+
+// Small messages waiting to be sent as one MOLE_MSG_BATCH
+
+typedef struct
+{   uint8_t *buf;           // records: length[1], data[]
+    uint16_t size;          // of buf, 0 to only receive batches
+    uint16_t fill;          // bytes of records in buf
+    uint8_t delay;          // moleBatchTick calls before a flush, 0 for none
+    uint8_t age;            // moleBatchTick calls since the first record
+} mole_batch;
+
+// Receive buffers that the app holds until moleRelease. A message in rxbuf
+// changes places with a free one, other messages are copied into one.
+
+typedef struct
+{   uint8_t *buf[MOLE_RX_RING_MAX]; // rBlocks * 64 bytes each
+    uint16_t len[MOLE_RX_RING_MAX]; // of the message at &buf[k][1]
+    uint8_t count;
+    uint8_t held;           // bit k: the app has buf[k]
+} mole_ring;
+
+/*
+Link statistics, always counted. They are free-running 32-bit counters, so
+take differences between snapshots to get rates. All fields are uint32_t.
+*/
+
+typedef struct
+{   uint32_t bytesIn;       // wire bytes received by molePutc
+    uint32_t bytesOut;      // wire bytes sent, including FEC parity
+    uint32_t escapes;       // bytes sent as 2-byte escape sequences
+    uint32_t framesIn;      // received frames that passed the HMAC check
+    uint32_t framesOut;     // authenticated frames sent
+    uint32_t rejected;      // frames dropped: bad HMAC, length or escape
+    uint32_t badHMAC;       // of which the HMAC was bad
+    uint32_t lost;          // sequenced messages skipped by resynchronization
+    uint32_t pairings;      // pairing requests sent, including re-pairs
+    uint32_t boilerReqs;    // boilerplate requests answered
+    uint32_t rekeys;        // re-keys over the link
+    uint32_t chunksIn;      // file chunks authenticated by moleFileIn
+    uint32_t chunksOut;     // file chunks sent
+    uint32_t overruns;      // frames dropped: the app held every buffer,
+                            // or molePoll had not finished the last one
+    uint32_t txFull;        // times a send waited for TX FIFO room
+// Copied by moleStats from the optional features, 0 if absent
+    uint32_t resent;        // messages resent by selective repeat
+    uint32_t corrected;     // bytes corrected by FEC
+    uint32_t uncorrected;   // codewords FEC could not correct
+    uint32_t plain;         // plaintext bytes compressed
+    uint32_t packed;        // compressed bytes sent
+} mole_stats;
+
+/*
+Stage timing. Bucket 0 counts times of 0 ticks, bucket b counts times of
+2^(b-1) to 2^b - 1 ticks, and the last bucket also counts longer times.
+*/
+
+enum moleStages {
+  MOLE_STAGE_FRAME = 0,     // received frame, first byte to HMAC verified
+  MOLE_STAGE_HMAC,          // HMAC finalization of a received frame
+  MOLE_STAGE_DELIVER,       // plainFn
+  MOLE_STAGE_SEND,          // moleSend
+  MOLE_STAGE_IV,            // SendIV, including random numbers
+  MOLE_STAGE_KDF,           // key derivation, or a slice of it (molePoll)
+  MOLE_STAGE_FILE_OUT,      // moleFileOut and moleFileFinal
+  MOLE_STAGE_FILE_IN,       // a chunk of moleFileIn
+  MOLE_STAGES
+};
+
+#if (MOLE_TIMING)
+typedef struct
+{   uint32_t frame;         // moleClock at the start of the received frame
+    uint32_t hist[MOLE_STAGES][MOLE_HIST_BUCKETS];
+} mole_timing;
+#endif
+
+/*
+Trace ring. The port writes records, advancing head after each one, so a
+reader (a debugger, another thread or moleTraceDump) needs no lock. Records
+older than head - MOLE_TRACE_RECORDS have been overwritten.
+*/
+
+#if (MOLE_TRACE)
+typedef struct
+{   uint8_t event;          // MOLE_TR_?, see moletrace.h
+    uint8_t port;           // order of the port's moleAddPort
+    uint16_t counter;       // low half of the port's TX counter
+    uint32_t arg[2];
+} mole_trace_rec;
+
+typedef struct
+{   volatile uint32_t head; // records written
+    uint8_t port;
+    mole_trace_rec rec[MOLE_TRACE_RECORDS];
+} mole_trace;
+#endif
 
 typedef struct
 {   const char* name;       // port name (for debugging)
@@ -112,49 +370,105 @@ typedef struct
     mole_boilrFn boilrFn;   // boilerplate handler (from molePutc)
     mole_plainFn plainFn;   // plaintext handler (from molePutc)
     mole_ciphrFn ciphrFn;   // ciphertext transmit function
+    fifo_ctx *txFifo;       // ciphertext output FIFO, NULL to use ciphrFn
+    uint8_t *txChunk;       // space reserved in txFifo
     mole_WrKeyFn WrKeyFn;   // rewrite key set for this port
+    mole_bufFn rxFn;        // app receive buffers, NULL if none
     hmac_initFn hInitFn;    // HMAC initialization function
     hmac_putcFn hputcFn;    // HMAC putc function
+    hmac_putsFn hputsFn;    // HMAC bulk input, NULL to use hputcFn
     hmac_finalFn hFinalFn;  // HMAC finalization function
     crypt_initFn cInitFn;   // Encryption initialization function
     crypt_blockFn cBlockFn; // Encryption block function
+    crypt_seekFn cSeekFn;   // Keystream seek function
+    crypt_fillFn cFillFn;   // Keystream precompute function, NULL if none
     uint64_t hashCounterRX; // HMAC counters
     uint64_t hashCounterTX;
+    uint64_t lostCounter;   // first hashCounterTX the peer reported lost
+    uint64_t primeTX;       // counters of the primed HMAC contexts
+    uint64_t primeRX;
     uint8_t cryptokey[MOLE_ENCR_KEY_LENGTH];
     uint8_t hmackey[MOLE_HMAC_KEY_LENGTH];
     uint8_t adminpasscode[MOLE_ADMINPASS_LENGTH];
     const uint8_t *boilerplate;
+    const uint8_t *workKey; // keyset being derived
+    const uint8_t *sendSrc; // message being sent by moleSendPump
+    uint32_t sendLen;
+    uint32_t sendPos;       // bytes of it encoded
     uint8_t *rxbuf;
+    uint8_t *rxstage;       // own rxbuf when rxFn is used
+    uint8_t *rxapp;         // app buffer for the next message, NULL if none
+    mole_arq *arq;          // selective-repeat state, NULL if none
+    mole_fec *fec;          // error correction state, NULL if none
+    mole_lz *lz;            // compression state, NULL if none
+    mole_ring *ring;        // receive buffers lent to the app, NULL if none
+    mole_batch *batch;      // coalescing state, NULL if none
+    mole_stats stats;       // link statistics
+#if (MOLE_TIMING)
+    mole_timing timing;     // stage latency histograms
+#endif
+#if (MOLE_TRACE)
+    mole_trace trace;       // event trace ring
+#endif
     uint8_t txbuf[16];
     enum moleStates state;  // of the FSM
     uint8_t hmac[MOLE_HMAC_LENGTH];
     uint32_t counter;       // TX counter
     uint32_t chunks;        // for stream decryption
+    uint32_t tPos;          // keystream positions in blocks (for resync)
+    uint32_t rPos;
+    uint32_t rPosOK;        // rPos after the last authenticated message
     uint16_t rBlocks;       // size of rxbuf in blocks
+    uint16_t sBlocks;       // size of the port's own rxbuf in blocks
     uint16_t avail;         // max size of message you can send = avail*64 bytes
     uint16_t ridx;          // rxbuf index
+    uint16_t txUsed;        // bytes written to txChunk, not yet committed
+    uint16_t txRoom;        // size of txChunk
     uint8_t MACed;          // HMAC triggered
     uint8_t tag;            // received message type
     uint8_t escaped;        // assembling a 2-byte escape sequence
     uint8_t txidx;          // byte index for char output
     uint8_t prevblock;      // previous message block (for file out)
+    uint8_t caps;           // local capabilities, MOLE_CAP_?
+    uint8_t peerCaps;       // capabilities advertised by the far end
+    uint8_t rGap;           // messages skipped by the current frame
+    uint8_t rBad;           // bad sequenced frames in a row
+    uint8_t lostCount;      // number of messages the peer reported lost
+    uint8_t primed;         // HMAC contexts started ahead, see molePrecompute
+    uint8_t defer;          // cooperative mode, see moleDefer
+    uint8_t kdfDone;        // KDF iterations done for workKey
+    uint8_t sendState;      // moleSendPump: idle, queued or mid-frame
+    uint8_t sendType;       // MOLE_MSG_MESSAGE or MOLE_MSG_LZ
     // Things the app needs to know...
     uint8_t rReady;         // receiver is initialized
     uint8_t tReady;         // transmitter is initialized
     uint8_t adminOK;        // adminOK password was received
+    uint8_t work;           // heavy work waiting for molePoll
 } port_ctx;
 
 // external functions call by mole:
 int moleTRNG(uint8_t *dest, int length); // return 0 if okay
+#if (MOLE_TIMING)
+uint32_t moleClock(void);   // free-running ticks: a cycle counter, ns, etc.
+#endif
 
 
 // Streaming I/O function types
 typedef int (*mole_inFn)(void);
 typedef void (*mole_outFn)(uint8_t c);
 
+/** Reseed the IV generator from moleTRNG before the next IV.
+ *  It reseeds itself every MOLE_DRBG_RESEED IVs. Call this too when the
+ *  TRNG has fresh entropy to offer, for example from a slow timer.
+ *  The generator is shared by all ports and has no lock: calls that may
+ *  make an IV (pairing and re-keying through molePutc, molePoll, moleReKey
+ *  and moleFileNew) must not run at the same time on different ports.
+ */
+void moleReseed(void);
+
 /** Clear the port list. Call before moleAddPort.
  *  May be used to wipe contexts before exiting an app so sensitive data
- *  doesn't hang around in memory.
+ *  doesn't hang around in memory. Also wipes the IV generator's key.
  */
 void moleNoPorts(void);
 
@@ -162,7 +476,11 @@ void moleNoPorts(void);
 /** Append to the port list.
  * @param ctx         Port identifier
  * @param boilerplate Plaintext port identification boilerplate
- * @param protocol    AEAD protocol used: 0 = xchacha20-blake2s
+ * @param protocol    AEAD protocol used: 0 = xchacha20-blake2s,
+ *                    1 = xchacha20-poly1305, 2 = aes256ctr-ghash,
+ *                    3 = xchacha20-blake3, 4 = xchacha20-blake2s with
+ *                    the counter in the message,
+ *                    see MOLE_PROTOCOL_?
  * @param name        Name of port (for debugging)
  * @param rxBlocks    Size of receive buffer in 64-byte blocks
  * @param boiler      Handler for received boilerplate (src, n)
@@ -194,6 +512,70 @@ int moleRAMunused (void);
 int molePutc(port_ctx *ctx, uint8_t c);
 
 
+/** Input a buffer of raw ciphertext, as molePutc does byte by byte
+ * @param ctx Port identifier
+ * @param src Incoming bytes
+ * @param len Number of bytes
+ * @return 0 if okay, otherwise the last MOLE_ERROR_? of molePutc
+ */
+int molePutBuf(port_ctx *ctx, const uint8_t *src, int len);
+
+/** Input the bytes waiting in a receive FIFO, without copying them out.
+ *  Call it from the main loop, the receive ISR puts bytes in the FIFO.
+ * @param ctx Port identifier
+ * @param rx  FIFO whose consumer is this port
+ * @param max Most bytes to take, 0 for all of them
+ * @return 0 if okay, otherwise the last MOLE_ERROR_? of molePutc
+ */
+int moleDrain(port_ctx *ctx, fifo_ctx *rx, int max);
+
+/** Send the port's output to a FIFO instead of ciphrFn, for a transmit ISR
+ *  to empty. Frames are written in chunks with fifo_reserve and committed
+ *  at the end of each frame. When the FIFO is full, the port waits for the
+ *  ISR to make room, counted in stats.txFull, so the ISR must be able to run
+ *  then. moleSendPump never waits, it stops until there is room.
+ * @param ctx Port identifier
+ * @param tx  FIFO whose producer is this port, NULL to go back to ciphrFn
+ */
+void moleTxFifo(port_ctx *ctx, fifo_ctx *tx);
+
+
+/** Queue heavy work for molePoll instead of doing it in molePutc, so that
+ *  molePutc can be called from a receive ISR. The work is handling a
+ *  received frame (including plainFn), answering a pairing with an IV,
+ *  pairing again after an embedded reset and deriving the keys of a re-key.
+ *  molePutc never does queued work: a frame that starts while there is
+ *  some is dropped, counted in stats.overruns, and molePutc returns
+ *  MOLE_ERROR_OVERRUN. So call molePoll soon enough. Sending a frame
+ *  finishes a key derivation first.
+ * @param ctx    Port identifier
+ * @param defer  1 to queue the work, 0 to finish it and stop queueing
+ * @return       0 if okay, otherwise MOLE_ERROR_? of the finished work
+ */
+int moleDefer(port_ctx *ctx, int defer);
+
+/** Do a slice of the work queued by molePutc in cooperative mode: a frame,
+ *  an IV, a pairing request or MOLE_POLL_STEPS iterations of key derivation.
+ *  Call it from the main loop while ctx->work is not 0.
+ * @param ctx    Port identifier
+ * @return       0 if okay, otherwise MOLE_ERROR_? as from molePutc
+ */
+int molePoll(port_ctx *ctx);
+
+
+/** Do work ahead of the next message while the port is idle: start the HMAC
+ *  for the next counter in each direction and compute keystream ahead
+ *  (xc_crypt_fill). The next moleSend or received frame then skips that
+ *  work. Call it from the main loop when there is time to spare.
+ * @param ctx    Port identifier
+ * @param budget Most steps to take, a step is an HMAC start or 64 bytes of
+ *               keystream: about one hash or cipher block
+ * @return       Steps taken, 0 when there is nothing left to do or
+ *               molePoll has work
+ */
+int molePrecompute(port_ctx *ctx, int budget);
+
+
 /** Send an IV to enable moleSend, needed if not paired
  * @param ctx   Port identifier
  */
@@ -208,6 +590,49 @@ int moleTxInit(port_ctx *ctx);
  */
 int moleSend(port_ctx *ctx, const uint8_t *m, int bytes);
 
+// A piece of a message for moleSendv
+struct mole_iov {
+    const uint8_t *src;
+    int len;
+};
+
+/** Send the pieces of a message as one message, without copying them
+ *  together first. It is not compressed.
+ * @param ctx   Port identifier
+ * @param iov   Pieces, in order
+ * @param cnt   Number of pieces
+ * @return      0 if okay, otherwise MOLE_ERROR_?
+ */
+int moleSendv(port_ctx *ctx, const struct mole_iov *iov, int cnt);
+
+
+/** Queue a message for moleSendPump, which sends it a piece at a time so
+ *  that a long message does not hold up the main loop. m must stay put
+ *  until moleSendPump leaves 0 bytes, unless the message is compressed.
+ *  Other sends finish the frame moleSendPump has started first, and
+ *  moleSend and moleArqSend send the whole message first.
+ * @param ctx   Port identifier
+ * @param m     Plaintext message to send
+ * @param bytes Length of message in bytes
+ * @return      0 if okay, MOLE_ERROR_MSG_NOT_SENT if the port is busy with
+ *              another message from moleSendBegin or a file
+ */
+int moleSendBegin(port_ctx *ctx, const uint8_t *m, int bytes);
+
+
+/** Send more of the message queued by moleSendBegin. A step encodes a block
+ *  of it, at most 2 * 16 wire bytes plus the HMAC at the end. Steps stop
+ *  after max bytes, so the last one may go a step over. With a TX FIFO,
+ *  steps also stop when it does not have room for one, instead of waiting.
+ * @param ctx   Port identifier
+ * @param max   Wire bytes to send, 0 for no limit
+ * @param left  If not NULL, gets the bytes of the message left to encode
+ *              plus 1 for the HMAC, 0 when it has been sent
+ * @return      0 if okay, MOLE_ERROR_TX_FULL if the TX FIFO has no room
+ *              for the next step
+ */
+int moleSendPump(port_ctx *ctx, int max, int *left);
+
 
 /** Encrypt and send a re-key message
  * @param key   64-byte passcode
@@ -222,6 +647,169 @@ int moleReKey(port_ctx *ctx, const uint8_t *key);
  */
 uint32_t moleAvail(port_ctx *ctx);
 
+/** Set the capabilities advertised at the next pairing
+ * @param ctx   Port identifier
+ * @param caps  MOLE_CAP_? flags, used when both ends advertise them
+ */
+void moleSetCaps(port_ctx *ctx, uint8_t caps);
+
+/** Add selective-repeat delivery to a port, call after moleAddPort.
+ *  Also sets MOLE_CAP_ARQ in the port's capabilities.
+ * @param ctx   Port identifier
+ * @param slots Messages in flight, a power of 2 up to MOLE_ARQ_MAX_SLOTS.
+ *              Both queues use slots * rxBlocks * 64 bytes of context memory.
+ * @return      0 if okay, otherwise MOLE_ERROR_?
+ */
+int moleArqInit(port_ctx *ctx, uint8_t slots);
+
+/** Send a message that is acknowledged and resent until it is delivered.
+ *  Without MOLE_CAP_ARQ at both ends, it is the same as moleSend.
+ *  Messages are delivered in order. A re-pairing resends unacknowledged
+ *  messages, which the peer may already have delivered.
+ * @param ctx   Port identifier
+ * @param m     Plaintext message to send
+ * @param bytes Length of message in bytes, up to moleAvail - 1
+ * @return      0 if okay, MOLE_ERROR_MSG_NOT_SENT if the window is full
+ */
+int moleArqSend(port_ctx *ctx, const uint8_t *m, int bytes);
+
+/** Retransmit timer, call periodically. Resends messages that have not been
+ *  acknowledged within MOLE_ARQ_TIMEOUT ticks and sends ACKs that have been
+ *  held back for MOLE_ARQ_TIMEOUT - 2 ticks.
+ * @param ctx   Port identifier
+ * @return      Number of messages not yet acknowledged
+ */
+int moleArqTick(port_ctx *ctx);
+
+/** Add forward error correction to a port, call after moleAddPort.
+ *  Also sets MOLE_CAP_FEC in the port's capabilities. The code rate is
+ *  data / (data + parity), advertised at pairing.
+ * @param ctx    Port identifier
+ * @param data   Wire bytes per codeword, up to 255 - parity
+ * @param parity Parity bytes per codeword, even, 2 to RS_MAX_PARITY.
+ *               Corrects up to parity/2 bytes per codeword.
+ * @return       0 if okay, otherwise MOLE_ERROR_?
+ */
+int moleFecInit(port_ctx *ctx, uint8_t data, uint8_t parity);
+
+/** Add compression to a port, call after moleAddPort.
+ *  Also sets MOLE_CAP_LZ in the port's capabilities. moleSend compresses a
+ *  message if the peer advertised MOLE_CAP_LZ and it gets smaller.
+ *  moleFileNew starts a compressed file if the port's caps include it.
+ * @param ctx    Port identifier
+ * @return       0 if okay, otherwise MOLE_ERROR_?
+ */
+int moleLzInit(port_ctx *ctx);
+
+/** Lend received messages to the app, call after moleAddPort. plainFn's
+ *  src then stays valid after plainFn returns, until moleRelease, while
+ *  the port receives into another buffer. If the app holds all of them when
+ *  a message arrives, it is dropped and counted in stats.overruns.
+ * @param ctx     Port identifier
+ * @param buffers Buffers the app can hold at once, 1 to MOLE_RX_RING_MAX.
+ *                They use buffers * rxBlocks * 64 bytes of context memory.
+ * @return        0 if okay, otherwise MOLE_ERROR_?
+ */
+int moleRxRing(port_ctx *ctx, uint8_t buffers);
+
+/** Give a received message back to the port, which wipes it
+ * @param ctx     Port identifier
+ * @param src     What plainFn got
+ * @return        0 if okay, MOLE_ERROR_INVALID_STATE if the app did not
+ *                hold it. Without moleRxRing, 0.
+ */
+int moleRelease(port_ctx *ctx, const uint8_t *src);
+
+/** Receive messages straight into app memory, call after moleAddPort and
+ *  before moleArqInit, moleLzInit and molePair. When a message frame
+ *  starts, rxFn gives the buffer it is decrypted into, and plainFn gets
+ *  &buf[1] once it is authenticated. The app has buf from then on. A frame
+ *  that is not delivered is wiped and its buffer is used for the next one.
+ *  If rxFn returns NULL, the message is received in the port's own rxbuf.
+ *  Compressed and selective-repeat messages are passed as before, valid
+ *  only during plainFn.
+ * @param ctx    Port identifier
+ * @param rxFn   Returns a buffer of size bytes, or NULL
+ * @param blocks Size of the app's buffers in 64-byte blocks. It replaces
+ *               rxBlocks as the longest message the peer may send, so the
+ *               rxBlocks of moleAddPort only has to hold IVs, boilerplate
+ *               and short messages, 2 blocks at least.
+ * @return       0 if okay, otherwise MOLE_ERROR_?
+ */
+int moleRxInto(port_ctx *ctx, mole_bufFn rxFn, uint16_t blocks);
+
+/** Coalesce small messages, call after moleAddPort. Also sets
+ *  MOLE_CAP_BATCH in the port's capabilities. When both ends advertise it,
+ *  moleSend adds messages of up to MOLE_BATCH_RECORD bytes to a batch that
+ *  is sent as one frame, and the receiver passes them to plainFn one by one.
+ *  The batch is sent when the next message does not fit, by moleFlush, by
+ *  moleBatchTick and before any other message.
+ * @param ctx    Port identifier
+ * @param size   Batch size in bytes, 0 to only receive batches
+ * @param delay  moleBatchTick calls a message may wait, 0 for no limit
+ * @return       0 if okay, otherwise MOLE_ERROR_?
+ */
+int moleBatchInit(port_ctx *ctx, uint16_t size, uint8_t delay);
+
+/** Send the coalesced messages now
+ * @param ctx    Port identifier
+ * @return       0 if okay, otherwise MOLE_ERROR_?
+ */
+int moleFlush(port_ctx *ctx);
+
+/** Batch timer, call periodically. Sends the batch once its first message
+ *  has waited for delay calls.
+ * @param ctx    Port identifier
+ * @return       Bytes still waiting in the batch
+ */
+int moleBatchTick(port_ctx *ctx);
+
+/** Take a snapshot of a port's statistics
+ * @param ctx   Port identifier
+ * @param out   Snapshot
+ */
+void moleStats(port_ctx *ctx, mole_stats *out);
+
+/** Format a snapshot as text, one "mole_<counter>{port="<name>"} <value>"
+ *  line per counter (the Prometheus text format).
+ * @param s     Snapshot from moleStats
+ * @param name  Port name for the label
+ * @param dest  Output buffer, zero-terminated. About 1K holds all counters.
+ * @param size  Size of dest, only whole lines are written
+ * @return      Length of the text
+ */
+int moleStatsText(const mole_stats *s, const char *name, char *dest, int size);
+
+#if (MOLE_TIMING)
+/** Get a latency histogram
+ * @param ctx   Port identifier
+ * @param stage MOLE_STAGE_?
+ * @return      MOLE_HIST_BUCKETS counts, NULL if stage is out of range
+ */
+const uint32_t *moleHistogram(port_ctx *ctx, int stage);
+
+/** Format a port's histograms as Prometheus text, cumulative buckets
+ *  mole_ticks_bucket{port="<name>",stage="<stage>",le="<ticks>"} <count>
+ *  up to the highest one in use, then le="+Inf". Unused stages are skipped.
+ * @param ctx   Port identifier
+ * @param dest  Output buffer, zero-terminated
+ * @param size  Size of dest, only whole lines are written
+ * @return      Length of the text
+ */
+int moleHistText(port_ctx *ctx, char *dest, int size);
+#endif
+
+#if (MOLE_TRACE)
+/** Write a port's trace ring, oldest record first, for tests/tracedump.c:
+ *  name[] 0, head[4], count[2], then count records of
+ *  event[1] port[1] counter[2] arg0[4] arg1[4], little-endian.
+ * @param ctx   Port identifier
+ * @param out   Output function
+ * @return      Number of records
+ */
+int moleTraceDump(port_ctx *ctx, mole_outFn out);
+#endif
+
 /** Send a pairing request
  * @param ctx   Port identifier
  */
@@ -248,7 +836,8 @@ int moleFileIn (port_ctx *ctx, mole_inFn cFn, mole_outFn mFn);
 
 
 int  moleFileNew (port_ctx *ctx);       // boilerplate and IV preamble
-void moleFileOut (port_ctx *ctx, const uint8_t *src, int len);
+void moleFileOut (port_ctx *ctx, const uint8_t *src, int len); // len%16==0
+                                        // unless compressed
 void moleFileFinal (port_ctx *ctx);     // finish
 
 /* Typical usage: Redirect ciphrFn to a file output, then:
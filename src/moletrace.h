@@ -0,0 +1,68 @@
+/*
+ * Trace events of mole.c, see MOLE_TRACE in mole.h
+ * Each event is a binary record in the port's ring buffer. The format strings
+ * are only used by the decoder (tests/tracedump.c): %s is the port name and
+ * the other conversions take the record's two arguments in order.
+ * MOLE_TR_DATA records hold 8 bytes of a buffer dump.
+ */
+#ifndef _MOLETRACE_H_
+#define _MOLETRACE_H_
+
+#define MOLE_TRACE_EVENTS(X) \
+  X(MOLE_TR_DATA,          "") \
+  X(MOLE_TR_KEYSET,        "keyset data\n") \
+  X(MOLE_TR_KEY_EXPECTED,  "expected key hmac") \
+  X(MOLE_TR_KEY_ACTUAL,    "actual key hmac\n") \
+  X(MOLE_TR_TX_HMAC,       "%s is sending HMAC with hashCounterTX, ") \
+  X(MOLE_TR_TX_IV,         "\n%s sending IV, tag=%d, ") \
+  X(MOLE_TR_NEW_RX_CTR,    "New %s.hashCounterRX") \
+  X(MOLE_TR_CUR_TX_CTR,    "Current %s.hashCounterTX") \
+  X(MOLE_TR_MIV,           "mIV used by %s to encrypt cIV") \
+  X(MOLE_TR_IV,            "IV (not output)") \
+  X(MOLE_TR_CIV,           "cIV output as encrypted IV\n") \
+  X(MOLE_TR_KDF,           "KDF output ") \
+  X(MOLE_TR_PAIR,          "\n%s sending Pairing request, ") \
+  X(MOLE_TR_BOILER_REQ,    "\n%s sending Boilerplate request, ") \
+  X(MOLE_TR_ADMIN,         "\n%s sending Admin token, ") \
+  X(MOLE_TR_DROPPED,       "\n%s dropped a bad message, %d in a row") \
+  X(MOLE_TR_LOST,          "\n%s lost %d messages") \
+  X(MOLE_TR_RX_HMAC,       "%s receiving HMAC with hashCounterRX, ") \
+  X(MOLE_TR_INCOMING,      "\n%s incoming packet, tag=%d\n") \
+  X(MOLE_TR_HANG,          "\nHANG state ") \
+  X(MOLE_TR_DECRYPT,       "\n%s decrypting payload rxbuf[%d]; ") \
+  X(MOLE_TR_OVERFLOW,      "\nGET_PAYLOAD state ") \
+  X(MOLE_TR_RECEIVED,      "\n%s received packet of length %d, tag %d, ") \
+  X(MOLE_TR_MSG_TYPE,      "rxbuf[0]=0x%02X; ") \
+  X(MOLE_TR_BAD_HMAC,      "\n**** Bad HMAC ****") \
+  X(MOLE_TR_IV_FUNNY,      "\nIV length was funny ") \
+  X(MOLE_TR_TEMP_IV,       "\nSet temporary IV for decrypting the secret IV ") \
+  X(MOLE_TR_RX_IV,         "\nReceived IV, tag=%d; ") \
+  X(MOLE_TR_RX_CTR,        "Received HMAC hashCounterRX, ") \
+  X(MOLE_TR_PRIVATE_CIV,   "Private cIV, ") \
+  X(MOLE_TR_PASS_EXPECTED, "Expected Passcode") \
+  X(MOLE_TR_PASS_ACTUAL,   "Actual Passcode") \
+  X(MOLE_TR_TESTING_KEY,   "\n%s is testing the new key") \
+  X(MOLE_TR_REKEYED,       "\n%s has been re-keyed") \
+  X(MOLE_TR_OVERALL_CTR,   "Overall hash ctr") \
+  X(MOLE_TR_FILE_IN,       "\n%s decrypting input stream c, producing output stream m") \
+  X(MOLE_TR_AUTH_ONLY,     "\nAuthenticate Only") \
+  X(MOLE_TR_IV_TAG_AT,     "\nIV tag is at position 0x%x ") \
+  X(MOLE_TR_MIV_READ,      "mIV read") \
+  X(MOLE_TR_CIV_READ,      "cIV read") \
+  X(MOLE_TR_IV_CALC,       "IV calculated\n") \
+  X(MOLE_TR_FILE_RX_CTR,   "hashCounterRX ") \
+  X(MOLE_TR_IV_HMAC_AT,    "\nIV HMAC is at position 0x%x ") \
+  X(MOLE_TR_FILE_EXPECTED, "expected key hmac ") \
+  X(MOLE_TR_FILE_ACTUAL,   "actual key hmac\n") \
+  X(MOLE_TR_NONCE_OK,      "\nRandom IV (nonce) has been set up and authenticated") \
+  X(MOLE_TR_STREAM_AT,     "\nDecrypting the stream at position 0x%x, c=%d\n") \
+  X(MOLE_TR_EOF,           "\nEOF found at position 0x%x, %d chunks\n")
+
+#define X(id, format) id,
+enum moleTraceEvents {
+  MOLE_TRACE_EVENTS(X)
+  MOLE_TR_EVENTS
+};
+#undef X
+
+#endif /* _MOLETRACE_H_ */
@@ -0,0 +1,193 @@
+/*
+ * Poly1305, see poly1305.h
+ * The arithmetic follows poly1305-donna-32.h (public domain, Andrew Moon):
+ * h = (h + m) * r mod 2^130 - 5 in five 26-bit limbs.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "poly1305.h"
+#include "xchacha.h"
+
+#define MASK26 0x3FFFFFF
+
+static uint32_t u8tou32(const uint8_t *p) {
+    return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8)
+         | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void u32tou8(uint8_t *p, uint32_t v) {
+    p[0] = v;  p[1] = v >> 8;  p[2] = v >> 16;  p[3] = v >> 24;
+}
+
+static void SetKey(poly1305_ctx *ctx, const uint8_t *key) {
+    ctx->r[0] = (u8tou32(&key[ 0])     ) & 0x3FFFFFF;   // clamp r
+    ctx->r[1] = (u8tou32(&key[ 3]) >> 2) & 0x3FFFF03;
+    ctx->r[2] = (u8tou32(&key[ 6]) >> 4) & 0x3FFC0FF;
+    ctx->r[3] = (u8tou32(&key[ 9]) >> 6) & 0x3F03FFF;
+    ctx->r[4] = (u8tou32(&key[12]) >> 8) & 0x00FFFFF;
+    for (int i = 0; i < 5; i++) ctx->h[i] = 0;
+    for (int i = 0; i < 4; i++) ctx->pad[i] = u8tou32(&key[16 + 4 * i]);
+}
+
+void poly1305_init(poly1305_ctx *ctx, const uint8_t *key) {
+    SetKey(ctx, key);
+    ctx->len = 0;
+    ctx->hsize = POLY1305_TAGBYTES;
+    ctx->key = NULL;
+}
+
+// One-time key for counter 0, from the first block (zero padded if short)
+static void Deferred(poly1305_ctx *ctx) {
+    uint8_t in[16], otk[POLY1305_KEYBYTES];
+    for (int i = 1; i < 16; i++) in[i - 1] = (i < ctx->len) ? ctx->buf[i] : 0;
+    in[15] = 1;                         // apart from counter keys
+    xchacha_hchacha20(otk, in, ctx->key);
+    SetKey(ctx, otk);
+    ctx->key = NULL;
+    memset(otk, 0, sizeof(otk));
+}
+
+// One 16-byte block, hibit is 2^128 in limb 4 unless it is a padded last block
+static void Block(poly1305_ctx *ctx, const uint8_t *m, uint32_t hibit) {
+    const uint32_t r0 = ctx->r[0], r1 = ctx->r[1], r2 = ctx->r[2];
+    const uint32_t r3 = ctx->r[3], r4 = ctx->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2];
+    uint32_t h3 = ctx->h[3], h4 = ctx->h[4];
+    uint64_t d0, d1, d2, d3, d4;
+    uint32_t c;
+    h0 += (u8tou32(&m[ 0])     ) & MASK26;
+    h1 += (u8tou32(&m[ 3]) >> 2) & MASK26;
+    h2 += (u8tou32(&m[ 6]) >> 4) & MASK26;
+    h3 += (u8tou32(&m[ 9]) >> 6) & MASK26;
+    h4 += (u8tou32(&m[12]) >> 8) | hibit;
+    d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3
+       + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+    d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4
+       + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+    d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0
+       + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+    d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1
+       + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+    d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2
+       + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+                   c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & MASK26;
+    d1 += c;       c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & MASK26;
+    d2 += c;       c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & MASK26;
+    d3 += c;       c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & MASK26;
+    d4 += c;       c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & MASK26;
+    h0 += c * 5;   c = h0 >> 26;             h0 &= MASK26;
+    h1 += c;
+    ctx->h[0] = h0;  ctx->h[1] = h1;  ctx->h[2] = h2;
+    ctx->h[3] = h3;  ctx->h[4] = h4;
+}
+
+void poly1305_putc(poly1305_ctx *ctx, uint8_t c) {
+    ctx->buf[ctx->len++] = c;
+    if (ctx->len == 16) {
+        if (ctx->key) Deferred(ctx);
+        Block(ctx, ctx->buf, 1UL << 24);
+        ctx->len = 0;
+    }
+}
+
+void poly1305_puts(poly1305_ctx *ctx, const uint8_t *m, int len) {
+    while ((ctx->len || ctx->key) && len) { // partial or first deferred block
+        poly1305_putc(ctx, *m++);
+        len--;
+    }
+    while (len >= 16) {
+        Block(ctx, m, 1UL << 24);
+        m += 16;
+        len -= 16;
+    }
+    while (len--) poly1305_putc(ctx, *m++);
+}
+
+void poly1305_final(poly1305_ctx *ctx, uint8_t *tag) {
+    uint32_t h0, h1, h2, h3, h4, g0, g1, g2, g3, g4, c, mask;
+    uint64_t f;
+    if (ctx->key) Deferred(ctx);
+    if (ctx->len) {                     // pad with 1, then zeros
+        int i = ctx->len;
+        ctx->buf[i++] = 1;
+        while (i < 16) ctx->buf[i++] = 0;
+        Block(ctx, ctx->buf, 0);
+    }
+    h0 = ctx->h[0];  h1 = ctx->h[1];  h2 = ctx->h[2];
+    h3 = ctx->h[3];  h4 = ctx->h[4];
+                 c = h1 >> 26; h1 &= MASK26;    // fully carry h
+    h2 += c;     c = h2 >> 26; h2 &= MASK26;
+    h3 += c;     c = h3 >> 26; h3 &= MASK26;
+    h4 += c;     c = h4 >> 26; h4 &= MASK26;
+    h0 += c * 5; c = h0 >> 26; h0 &= MASK26;
+    h1 += c;
+    g0 = h0 + 5; c = g0 >> 26; g0 &= MASK26;    // g = h - p = h + 5 - 2^130
+    g1 = h1 + c; c = g1 >> 26; g1 &= MASK26;
+    g2 = h2 + c; c = g2 >> 26; g2 &= MASK26;
+    g3 = h3 + c; c = g3 >> 26; g3 &= MASK26;
+    g4 = h4 + c - (1UL << 26);
+    mask = (g4 >> 31) - 1;              // all ones if h >= p, constant time
+    g0 &= mask;  g1 &= mask;  g2 &= mask;  g3 &= mask;  g4 &= mask;
+    mask = ~mask;
+    h0 = (h0 & mask) | g0;
+    h1 = (h1 & mask) | g1;
+    h2 = (h2 & mask) | g2;
+    h3 = (h3 & mask) | g3;
+    h4 = (h4 & mask) | g4;
+    h0 = (h0      ) | (h1 << 26);       // h mod 2^128
+    h1 = (h1 >>  6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 <<  8);
+    f = (uint64_t)h0 + ctx->pad[0];             u32tou8(&tag[ 0], (uint32_t)f);
+    f = (uint64_t)h1 + ctx->pad[1] + (f >> 32); u32tou8(&tag[ 4], (uint32_t)f);
+    f = (uint64_t)h2 + ctx->pad[2] + (f >> 32); u32tou8(&tag[ 8], (uint32_t)f);
+    f = (uint64_t)h3 + ctx->pad[3] + (f >> 32); u32tou8(&tag[12], (uint32_t)f);
+    memset(ctx, 0, sizeof(poly1305_ctx));
+}
+
+/* ------------------------------------------------------------------------- */
+
+// The HMAC slots get the HMAC key and counter, not the cipher's nonce, so the
+// one-time key is HChaCha20 of them rather than RFC 8439's keystream block 0.
+// It is a PRF either way. See docs/mole.md.
+int p1305_hmac_init(poly1305_ctx *ctx, const uint8_t *key, int hsize, uint64_t ctr) {
+    uint8_t in[16], otk[POLY1305_KEYBYTES];
+    if ((hsize < 1) || (hsize > POLY1305_TAGBYTES)) return 0;
+    if (ctr == 0) {                     // key from the first block
+        memset(ctx, 0, sizeof(poly1305_ctx));
+        ctx->key = key;
+        ctx->hsize = hsize;
+        return hsize;
+    }
+    memset(in, 0, sizeof(in));
+    for (int i = 0; i < 8; i++) in[i] = (uint8_t)(ctr >> (8 * i));
+    xchacha_hchacha20(otk, in, key);
+    poly1305_init(ctx, otk);
+    ctx->hsize = hsize;
+    memset(otk, 0, sizeof(otk));        // burn the one-time key
+    return hsize;
+}
+int p1305_hmac_init_g(size_t *ctx, const uint8_t *key, int hsize, uint64_t ctr) {
+    return p1305_hmac_init((void *)ctx, key, hsize, ctr);
+}
+
+void p1305_hmac_putc(poly1305_ctx *ctx, uint8_t c) {
+    poly1305_putc(ctx, c);
+}
+void p1305_hmac_putc_g(size_t *ctx, uint8_t c) {
+    poly1305_putc((void *)ctx, c);
+}
+
+int p1305_hmac_final(poly1305_ctx *ctx, uint8_t *out) {
+    uint8_t tag[POLY1305_TAGBYTES];
+    int hsize = ctx->hsize;
+    poly1305_final(ctx, tag);
+    memcpy(out, tag, hsize);
+    memset(tag, 0, sizeof(tag));
+    return hsize;
+}
+int p1305_hmac_final_g(size_t *ctx, uint8_t *out) {
+    return p1305_hmac_final((void *)ctx, out);
+}
@@ -0,0 +1,81 @@
+/*
+ * Poly1305 one-time authenticator (RFC 8439), 32-bit arithmetic after
+ * poly1305-donna by Andrew Moon, with a byte-wise streaming API for mole.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _POLY1305_H_
+#define _POLY1305_H_
+
+#define POLY1305_KEYBYTES   32
+#define POLY1305_TAGBYTES   16
+
+typedef struct
+{   uint32_t r[5];          // clamped key, 26-bit limbs
+    uint32_t h[5];          // accumulator, 26-bit limbs
+    uint32_t pad[4];        // s, added at the end
+    uint8_t buf[16];        // partial block
+    uint8_t len;            // bytes in buf
+    uint8_t hsize;          // tag bytes output by p1305_hmac_final
+    const uint8_t *key;     // long-term key until the first block is in
+} poly1305_ctx;
+
+/** Start a MAC with a one-time key
+ * @param ctx   Poly1305 context
+ * @param key   One-time key (r, s), 32 bytes
+ */
+void poly1305_init(poly1305_ctx *ctx, const uint8_t *key);
+
+/** Add a byte to the MAC
+ * @param ctx   Poly1305 context
+ * @param c     Byte
+ */
+void poly1305_putc(poly1305_ctx *ctx, uint8_t c);
+
+/** Add bytes to the MAC
+ * @param ctx   Poly1305 context
+ * @param m     Bytes
+ * @param len   Length in bytes
+ */
+void poly1305_puts(poly1305_ctx *ctx, const uint8_t *m, int len);
+
+/** Finish the MAC and wipe the context
+ * @param ctx   Poly1305 context
+ * @param tag   16-byte tag
+ */
+void poly1305_final(poly1305_ctx *ctx, uint8_t *tag);
+
+/* ------------------------------------------------------------------------- */
+// The mole HMAC contract: a long-term key and a message counter.
+// The one-time key is HChaCha20(key, counter), so every counter value
+// gets its own Poly1305 key. Counter 0 is used by every IV_A frame, so
+// there the key waits for the first 16 bytes of the message and is
+// HChaCha20(key, bytes 1 to 15 | 1), bytes 1 to 15 being the random IV.
+
+/** MAC initialization
+ * @param ctx   Poly1305 context
+ * @param key   Key, 32 bytes
+ * @param hsize Expected tag length in bytes, up to 16
+ * @param ctr   Message counter
+ * @return      Actual tag length in bytes (0 if bogus)
+ */
+int p1305_hmac_init(poly1305_ctx *ctx, const uint8_t *key, int hsize, uint64_t ctr);
+int p1305_hmac_init_g  (size_t *ctx, const uint8_t *key, int hsize, uint64_t ctr);
+
+/** MAC append byte
+ * @param ctx   Poly1305 context
+ * @param c     Byte to add to MAC
+ */
+void p1305_hmac_putc(poly1305_ctx *ctx, uint8_t c);
+void p1305_hmac_putc_g  (size_t *ctx, uint8_t c);
+
+/** MAC finalization
+ * @param ctx   Poly1305 context
+ * @param out   Output tag, hsize bytes
+ * @return      Tag length in bytes
+ */
+int p1305_hmac_final(poly1305_ctx *ctx, uint8_t *out);
+int p1305_hmac_final_g  (size_t *ctx, uint8_t *out);
+
+#endif /* _POLY1305_H_ */
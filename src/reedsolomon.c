@@ -0,0 +1,136 @@
+/*
+ * Reed-Solomon codec over GF(256)
+ * Encoder: LFSR over the data, so no codeword buffer is needed to encode.
+ * Decoder: syndromes, Berlekamp-Massey, Chien search and Forney.
+ * Tables are built in RAM on first use (768 bytes).
+ */
+#include <stdint.h>
+#include <string.h>
+#include "reedsolomon.h"
+
+static uint8_t gf_exp[512];         // doubled to skip a modulo
+static uint8_t gf_log[256];
+
+static void gf_init(void) {
+    int x = 1;
+    if (gf_exp[0]) return;          // already built
+    for (int i = 0; i < 255; i++) {
+        gf_exp[i] = x;
+        gf_exp[i + 255] = x;
+        gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) x ^= 0x11D;
+    }
+}
+
+static uint8_t gf_mul(uint8_t a, uint8_t b) {
+    if ((a == 0) || (b == 0)) return 0;
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static uint8_t gf_div(uint8_t a, uint8_t b) {
+    if (a == 0) return 0;
+    return gf_exp[gf_log[a] + 255 - gf_log[b]];
+}
+
+static uint8_t gf_pow(int e) {      // a^e for any integer e
+    e %= 255;
+    if (e < 0) e += 255;
+    return gf_exp[e];
+}
+
+int rs_init(rs_ctx *ctx, int nparity) {
+    if ((nparity < 2) || (nparity > RS_MAX_PARITY) || (nparity & 1)) return -1;
+    gf_init();
+    memset(ctx, 0, sizeof(rs_ctx));
+    ctx->nparity = nparity;
+    ctx->gen[0] = 1;                // g(x) = (x - a^0)(x - a^1)...
+    for (int i = 0; i < nparity; i++) {
+        uint8_t root = gf_exp[i];
+        ctx->gen[i + 1] = gf_mul(ctx->gen[i], root);
+        for (int j = i; j > 0; j--) {
+            ctx->gen[j] ^= gf_mul(ctx->gen[j - 1], root);
+        }
+    }
+    return 0;
+}
+
+void rs_clear(rs_ctx *ctx) {
+    memset(ctx->reg, 0, sizeof(ctx->reg));
+}
+
+void rs_putc(rs_ctx *ctx, uint8_t c) {
+    int np = ctx->nparity;
+    uint8_t fb = c ^ ctx->reg[0];
+    for (int j = 0; j < (np - 1); j++) {
+        ctx->reg[j] = ctx->reg[j + 1] ^ gf_mul(fb, ctx->gen[j + 1]);
+    }
+    ctx->reg[np - 1] = gf_mul(fb, ctx->gen[np]);
+}
+
+int rs_decode(rs_ctx *ctx, uint8_t *cw, int n) {
+    int np = ctx->nparity;
+    uint8_t S[RS_MAX_PARITY];           // syndromes
+    uint8_t C[RS_MAX_PARITY + 1];       // error locator, lowest degree first
+    uint8_t B[RS_MAX_PARITY + 1];
+    uint8_t T[RS_MAX_PARITY + 1];
+    uint8_t Om[RS_MAX_PARITY];          // error evaluator
+    uint8_t pos[RS_MAX_PARITY / 2];
+    int errors = 0;
+    if ((n <= np) || (n > 255)) return -1;
+    uint8_t any = 0;
+    for (int j = 0; j < np; j++) {      // S[j] = r(a^j)
+        uint8_t s = 0;
+        for (int i = 0; i < n; i++) s = gf_mul(s, gf_exp[j]) ^ cw[i];
+        S[j] = s;
+        any |= s;
+    }
+    if (!any) return 0;
+    memset(C, 0, sizeof(C));            // Berlekamp-Massey
+    memset(B, 0, sizeof(B));
+    C[0] = B[0] = 1;
+    int L = 0, m = 1;
+    uint8_t b = 1;
+    for (int k = 0; k < np; k++) {
+        uint8_t d = S[k];
+        for (int i = 1; i <= L; i++) d ^= gf_mul(C[i], S[k - i]);
+        if (d == 0) {
+            m++;
+            continue;
+        }
+        uint8_t coef = gf_div(d, b);
+        memcpy(T, C, sizeof(C));
+        for (int i = 0; (i + m) <= np; i++) C[i + m] ^= gf_mul(coef, B[i]);
+        if ((2 * L) <= k) {
+            L = k + 1 - L;
+            memcpy(B, T, sizeof(B));
+            b = d;
+            m = 1;
+        } else {
+            m++;
+        }
+    }
+    if ((2 * L) > np) return -1;
+    for (int p = 0; p < n; p++) {       // Chien search: C(a^-p) == 0
+        uint8_t v = 0;
+        for (int i = 0; i <= L; i++) v ^= gf_mul(C[i], gf_pow(-p * i));
+        if (v == 0) {
+            if (errors == L) return -1;
+            pos[errors++] = p;
+        }
+    }
+    if (errors != L) return -1;
+    for (int i = 0; i < np; i++) {      // Om = S * C mod x^np
+        Om[i] = 0;
+        for (int j = 0; (j <= i) && (j <= L); j++) Om[i] ^= gf_mul(C[j], S[i - j]);
+    }
+    for (int k = 0; k < errors; k++) {  // Forney
+        int p = pos[k];
+        uint8_t num = 0, den = 0;
+        for (int i = 0; i < np; i++) num ^= gf_mul(Om[i], gf_pow(-p * i));
+        for (int i = 1; i <= L; i += 2) den ^= gf_mul(C[i], gf_pow(-p * (i - 1)));
+        if (den == 0) return -1;
+        cw[n - 1 - p] ^= gf_mul(gf_exp[p], gf_div(num, den));
+    }
+    return errors;
+}
@@ -0,0 +1,48 @@
+/*
+ * Reed-Solomon codec over GF(256) for forward error correction
+ * Systematic code, primitive polynomial 0x11D, generator roots a^0..a^(2t-1).
+ * Codewords may be shortened: n = data + parity <= 255 bytes.
+ */
+#include <stdint.h>
+
+#ifndef _REEDSOLOMON_H_
+#define _REEDSOLOMON_H_
+
+#define RS_MAX_PARITY  16           /* corrects up to 8 byte errors */
+
+/** rs_ctx holds the generator polynomial and the encoder's parity register
+ */
+typedef struct {
+    uint8_t gen[RS_MAX_PARITY + 1]; // generator, highest degree first
+    uint8_t reg[RS_MAX_PARITY];     // parity of the data so far
+    uint8_t nparity;                // parity bytes per codeword
+} rs_ctx;
+
+/** Initialize the codec and clear the parity register
+ * @param ctx     Codec context
+ * @param nparity Number of parity bytes, even, 2 to RS_MAX_PARITY
+ * @return 0 if okay, -1 if nparity is not supported
+ */
+int rs_init(rs_ctx *ctx, int nparity);
+
+/** Clear the parity register to start a new codeword
+ * @param ctx     Codec context
+ */
+void rs_clear(rs_ctx *ctx);
+
+/** Add a data byte to the codeword. The parity is in ctx->reg[0..nparity-1]
+ *  after the last one.
+ * @param ctx     Codec context
+ * @param c       Data byte
+ */
+void rs_putc(rs_ctx *ctx, uint8_t c);
+
+/** Correct a codeword in place
+ * @param ctx     Codec context (only nparity is used)
+ * @param cw      Data bytes followed by nparity parity bytes
+ * @param n       Length of codeword, nparity < n <= 255
+ * @return Number of bytes corrected, -1 if uncorrectable
+ */
+int rs_decode(rs_ctx *ctx, uint8_t *cw, int n);
+
+#endif /* _REEDSOLOMON_H_ */
@@ -75,28 +75,47 @@ void xchacha_init(xChaCha_ctx *ctx, const uint8_t *k, uint8_t *iv){
     ctx->input[15] = u8tou32(iv + 20);
     ctx->chaptr = 64;
     ctx->blox = 0;
+#if (XC_RESERVE)
+    ctx->rhead = 0;
+    ctx->rcount = 0;
+#endif
 }
 
 void xchacha_set_counter(xChaCha_ctx *ctx, uint8_t *counter){
     ctx->input[12] = u8tou32(&counter[0]);
     ctx->input[13] = u8tou32(&counter[4]);
+#if (XC_RESERVE)
+    ctx->rcount = 0;
+#endif
+}
+
+// Keystream block at the counter, then bump the counter
+static void NextBlock(xChaCha_ctx *ctx, uint8_t *out){
+    uint32_t x[16], j[16];
+    memcpy(j, &ctx->input, 64);
+    memcpy(x, j, 64);
+    doRounds(x);
+    for (int i = 0; i < 16; i++) {
+        x[i] += j[i];
+    }
+    memcpy(out, x, 64);
+    j[12]++;
+    if (!j[12]) j[13]++;
+    ctx->input[12] = j[12];
+    ctx->input[13] = j[13];
 }
 
 uint8_t xchacha_next(xChaCha_ctx *ctx){
     if (ctx->chaptr > 63) {
         ctx->chaptr = 0;
-        uint32_t x[16], j[16];
-        memcpy(j, &ctx->input, 64);
-        memcpy(x, j, 64);
-        doRounds(x);
-        for (int i = 0; i < 16; i++) {
-            x[i] += j[i];
-        }
-        memcpy(ctx->chabuf, x, 64);
-        j[12]++;
-        if (!j[12]) j[13]++;
-        ctx->input[12] = j[12];
-        ctx->input[13] = j[13];
+#if (XC_RESERVE)
+        if (ctx->rcount) {              // computed ahead by xc_crypt_fill
+            memcpy(ctx->chabuf, ctx->reserve[ctx->rhead], 64);
+            ctx->rhead = (ctx->rhead + 1) % XC_RESERVE;
+            ctx->rcount--;
+        } else
+#endif
+        NextBlock(ctx, ctx->chabuf);
     }
     return ctx->chabuf[ctx->chaptr++];
 }
@@ -132,3 +151,35 @@ void xc_crypt_block(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out, int mode)
 void xc_crypt_block_g(size_t *ctx, const uint8_t *in, uint8_t *out, int mode) {
     xc_crypt_block((void *)ctx, in, out, mode);
 }
+
+void xc_crypt_seek(xChaCha_ctx *ctx, uint32_t block) {
+    ctx->input[12] = block >> 2;        // 4 blocks per keystream block
+    ctx->input[13] = 0;
+    ctx->chaptr = 64;
+    ctx->blox = (uint8_t)block;
+#if (XC_RESERVE)
+    ctx->rcount = 0;
+#endif
+    if (block & 3) {
+        xchacha_next(ctx);              // fill chabuf, then skip into it
+        ctx->chaptr = (block & 3) * 16;
+    }
+}
+void xc_crypt_seek_g(size_t *ctx, uint32_t block) {
+    xc_crypt_seek((void *)ctx, block);
+}
+
+int xc_crypt_fill(xChaCha_ctx *ctx, int blocks) {
+    int n = 0;
+#if (XC_RESERVE)
+    while ((n < blocks) && (ctx->rcount < XC_RESERVE)) {
+        NextBlock(ctx, ctx->reserve[(ctx->rhead + ctx->rcount) % XC_RESERVE]);
+        ctx->rcount++;
+        n++;
+    }
+#endif
+    return n;
+}
+int xc_crypt_fill_g(size_t *ctx, int blocks) {
+    return xc_crypt_fill((void *)ctx, blocks);
+}
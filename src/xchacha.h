@@ -26,8 +26,15 @@
 
 #define ROTL32(v, n) (U32V((v) << (n)) | ((v) >> (32 - (n))))
 
+/** Keystream blocks (64 bytes each) that xc_crypt_fill can compute ahead of
+ *  use, so that xc_crypt_block only has to XOR. 0 leaves the reserve out.
+ */
+#ifndef XC_RESERVE
+#define XC_RESERVE 2
+#endif
+
 /** ChaCha_ctx is the structure containing the representation of the internal
- *  state of the xChaCha cipher. Typically 129 to 132 bytes.
+ *  state of the xChaCha cipher. Typically 132 bytes, plus 64 per reserve block.
  */
 
 typedef struct
@@ -35,6 +42,11 @@ typedef struct
     uint8_t chabuf[64];     // keystream buffer
     uint8_t chaptr;         // keystream pointer
     uint8_t blox;           // block counter
+#if (XC_RESERVE)
+    uint8_t rhead;          // oldest reserve block
+    uint8_t rcount;         // reserve blocks ready, they follow chabuf
+    uint8_t reserve[XC_RESERVE][64];
+#endif
 } xChaCha_ctx;
 
 /* ------------------------------------------------------------------------- */
@@ -57,6 +69,21 @@ void xc_crypt_init_g   (size_t *ctx, const uint8_t *key, const uint8_t *iv, int
 void xc_crypt_block(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out, int mode);
 void xc_crypt_block_g   (size_t *ctx, const uint8_t *in, uint8_t *out, int mode);
 
+/** Position the keystream at a 16-byte block index
+ * @param ctx   Encryption/Decryption context
+ * @param block Number of blocks since xc_crypt_init
+ */
+void xc_crypt_seek(xChaCha_ctx *ctx, uint32_t block);
+void xc_crypt_seek_g   (size_t *ctx, uint32_t block);
+
+/** Compute keystream ahead of use, for idle time
+ * @param ctx    Encryption/Decryption context
+ * @param blocks Most keystream blocks (64 bytes) to compute
+ * @return       Blocks computed, 0 if the reserve is full
+ */
+int xc_crypt_fill(xChaCha_ctx *ctx, int blocks);
+int xc_crypt_fill_g    (size_t *ctx, int blocks);
+
 // Classic functions for testing
 void xchacha_hchacha20(uint8_t *out, const uint8_t *in, const uint8_t *k);
 void xchacha_init(xChaCha_ctx *ctx, const uint8_t *k, uint8_t *iv);
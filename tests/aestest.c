@@ -0,0 +1,241 @@
+/*************************************************************************
+ * AES-256 and GHASH tests: the FIPS-197 AES-256 vector, GCM test cases 13
+ * and 14 (McGrew and Viega), random blocks against a table-based reference
+ * whose S-box is computed here, and the hardware against the software
+ * version. Then the mole slots: CTR seeking and the GHASH MAC.
+ *************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/aes.h"
+
+static int Hex(uint8_t *dest, const char *s) {
+    int n = 0;
+    unsigned x;
+    while (s[0] && s[1] && (sscanf(s, "%2x", &x) == 1)) {
+        dest[n++] = x;
+        s += 2;
+    }
+    return n;
+}
+
+static int Same(const char *name, const uint8_t *got, const char *hex) {
+    uint8_t expect[16];
+    Hex(expect, hex);
+    if (!memcmp(got, expect, 16)) return 0;
+    printf("%s failed: expected %s, got ", name, hex);
+    for (int i = 0; i < 16; i++) printf("%02x", got[i]);
+    printf("\n");
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Reference AES-256 with an S-box table from GF(2^8) inverses
+
+static uint8_t sbox[256];
+
+static uint8_t Mul(uint8_t a, uint8_t b) {
+    uint8_t p = 0;
+    while (b) {
+        if (b & 1) p ^= a;
+        a = (a << 1) ^ ((a & 0x80) ? 0x1B : 0);
+        b >>= 1;
+    }
+    return p;
+}
+
+static void MakeSbox(void) {
+    for (int x = 0; x < 256; x++) {
+        uint8_t inv = 0;
+        for (int y = 1; (y < 256) && x; y++) {
+            if (Mul(x, y) == 1) inv = y;
+        }
+        uint8_t s = inv;
+        for (int i = 1; i < 5; i++) s ^= (uint8_t)((inv << i) | (inv >> (8 - i)));
+        sbox[x] = s ^ 0x63;
+    }
+}
+
+static void Reference(const uint8_t *key, const uint8_t *in, uint8_t *out) {
+    uint8_t w[240], s[16], t[16], rcon = 1;
+    memcpy(w, key, 32);
+    for (int i = 8; i < 60; i++) {
+        uint8_t k[4];
+        memcpy(k, &w[4 * (i - 1)], 4);
+        if ((i % 8) == 0) {
+            uint8_t k0 = k[0];
+            k[0] = sbox[k[1]] ^ rcon;  k[1] = sbox[k[2]];
+            k[2] = sbox[k[3]];         k[3] = sbox[k0];
+            rcon = Mul(rcon, 2);
+        } else if ((i % 8) == 4) {
+            for (int j = 0; j < 4; j++) k[j] = sbox[k[j]];
+        }
+        for (int j = 0; j < 4; j++) w[4 * i + j] = w[4 * (i - 8) + j] ^ k[j];
+    }
+    for (int i = 0; i < 16; i++) s[i] = in[i] ^ w[i];
+    for (int r = 1; r <= 14; r++) {
+        for (int i = 0; i < 16; i++) t[i] = sbox[s[(i + 4 * (i & 3)) & 15]];
+        for (int c = 0; (c < 16) && (r < 14); c += 4) {
+            uint8_t a[4];
+            memcpy(a, &t[c], 4);
+            for (int j = 0; j < 4; j++) {
+                t[c + j] = Mul(a[j], 2) ^ Mul(a[(j + 1) & 3], 3)
+                         ^ a[(j + 2) & 3] ^ a[(j + 3) & 3];
+            }
+        }
+        for (int i = 0; i < 16; i++) s[i] = t[i] ^ w[16 * r + i];
+    }
+    memcpy(out, s, 16);
+}
+
+// ---------------------------------------------------------------------------
+
+static int Vectors(void) {
+    aes_ctx a;
+    ghash_ctx g;
+    uint8_t key[32], b[16], j0[16], c[16];
+    int fails = 0;
+    for (int i = 0; i < 32; i++) key[i] = i;    // FIPS-197 C.3
+    Hex(b, "00112233445566778899aabbccddeeff");
+    aes_init(&a, key);
+    aes_encrypt(&a, b, b);
+    fails += Same("FIPS-197 C.3", b, "8ea2b7ca516745bfeafc49904b496089");
+    memset(key, 0, 32);                         // GCM cases 13 and 14
+    aes_init(&a, key);
+    memset(j0, 0, 16);
+    j0[15] = 1;
+    memset(g.h, 0, 16);
+    aes_encrypt(&a, g.h, g.h);
+    aes_encrypt(&a, j0, b);
+    fails += Same("GCM case 13", b, "530f8afbc74536b9a963b4f1c4cb738b");
+    j0[15] = 2;
+    aes_encrypt(&a, j0, c);                     // C = 0 ^ E(J0 + 1)
+    fails += Same("GCM case 14 C", c, "cea7403d4d606b6e074ec5d3baf39d18");
+    memset(g.y, 0, 16);
+    ghash_block(&g, c);
+    memset(c, 0, 16);
+    c[15] = 128;                                // len(A) = 0, len(C) = 128
+    ghash_block(&g, c);
+    for (int i = 0; i < 16; i++) g.y[i] ^= b[i];
+    fails += Same("GCM case 14 T", g.y, "d0d1c8a799996bf0265b98b5d48ab919");
+    return fails;
+}
+
+static int Random(void) {
+    aes_ctx a;
+    ghash_ctx g, gs;
+    uint8_t key[32], b[16], x[16], ref[16];
+    for (int n = 0; n < 200; n++) {
+        for (int i = 0; i < 32; i++) key[i] = rand();
+        for (int i = 0; i < 16; i++) b[i] = rand();
+        Reference(key, b, ref);
+        aes_init(&a, key);
+        aes_encrypt(&a, b, x);
+        if (memcmp(x, ref, 16)) {
+            printf("Random block %d differs from the reference\n", n);
+            return 1;
+        }
+        for (int i = 0; i < 16; i++) {
+            g.h[i] = rand();
+            g.y[i] = rand();
+            x[i] = rand();
+        }
+        gs = g;
+        int hw = aes_hw(1);
+        ghash_block(&g, x);
+        aes_hw(0);
+        ghash_block(&gs, x);
+        aes_hw(hw);
+        if (memcmp(g.y, gs.y, 16)) {
+            printf("GHASH hardware and software differ\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int Slots(void) {
+    aes_ctx a, b;
+    ghash_ctx g;
+    uint8_t key[32], iv[16], m[100], k[16], x[16], y[16], t1[16], t2[16];
+    for (int i = 0; i < 32; i++) key[i] = 7 * i;
+    for (int i = 0; i < 16; i++) iv[i] = 0xF0 + i;  // counter wraps at 2^32
+    for (int i = 0; i < 100; i++) m[i] = i;
+    aes_crypt_init(&a, key, iv, 1);
+    aes_crypt_init(&b, key, iv, 0);
+    memset(x, 0, 16);
+    for (uint32_t n = 0; n < 40; n++) {         // CTR definition and seek
+        aes_crypt_block(&a, x, y, 1);
+        memcpy(k, iv, 16);
+        uint32_t c = (k[12] << 24 | k[13] << 16 | k[14] << 8 | k[15]) + n;
+        k[12] = c >> 24;  k[13] = c >> 16;  k[14] = c >> 8;  k[15] = c;
+        aes_encrypt(&a, k, k);
+        if (memcmp(k, y, 16)) return 1;
+        aes_crypt_seek(&b, n);
+        aes_crypt_block(&b, y, k, 0);
+        if (memcmp(k, x, 16)) return 1;
+    }
+    memset(&g, 0, sizeof(g));                   // MAC definition
+    aes_init(&a, key);
+    memset(x, 0, 16);
+    memset(y, 0, 16);
+    y[0] = 5;                                   // counter 5
+    aes_encrypt(&a, y, t1);
+    ghash_ctx r;
+    aes_encrypt(&a, x, r.h);
+    memset(r.y, 0, 16);
+    for (int i = 0; i < 96; i += 16) ghash_block(&r, &m[i]);
+    memset(x, 0, 16);
+    memcpy(x, &m[96], 4);
+    ghash_block(&r, x);
+    memset(x, 0, 16);
+    x[7] = 100 * 8 % 256;  x[6] = 100 * 8 / 256;
+    ghash_block(&r, x);
+    for (int i = 0; i < 16; i++) t1[i] ^= r.y[i];
+    for (int hsize = 1; hsize <= 16; hsize++) {
+        if (gh_hmac_init(&g, key, hsize, 5) != hsize) return 1;
+        for (int i = 0; i < 100; i++) gh_hmac_putc(&g, m[i]);
+        if (gh_hmac_final(&g, t2) != hsize) return 1;
+        if (memcmp(t1, t2, hsize)) return 1;
+    }
+    if (gh_hmac_init(&g, key, 17, 5)) return 1;
+    gh_hmac_init(&g, key, 16, 0);               // counter 0 masks with the IV
+    for (int i = 0; i < 100; i++) gh_hmac_putc(&g, m[i]);
+    gh_hmac_final(&g, t2);
+    memcpy(x, &m[1], 15);
+    x[15] = 1;
+    aes_encrypt(&a, x, t1);
+    for (int i = 0; i < 16; i++) t1[i] ^= r.y[i];
+    if (memcmp(t1, t2, 16)) return 1;
+    memset(&g, 0, sizeof(g));                   // zero key, zeroed context
+    memset(key, 0, 32);
+    gh_hmac_init(&g, key, 16, 5);
+    gh_hmac_final(&g, t2);                      // GHASH of nothing is 0
+    aes_init(&a, key);
+    aes_encrypt(&a, y, t1);
+    return memcmp(t1, t2, 16) != 0;
+}
+
+int main(void) {
+    int fails = 0;
+    MakeSbox();
+    srand(1);
+    int hw = aes_hw(1);
+    for (int pass = 0; pass <= hw; pass++) {
+        aes_hw(pass);
+        const char *name = pass ? "AES-NI" : "software";
+        int f = Vectors() + Random();
+        if (Slots()) {
+            printf("The mole slots do not match their definitions\n");
+            f++;
+        }
+        if (!f) printf("AES-256 and GHASH ok (%s)\n", name);
+        fails += f;
+    }
+    if (fails) {
+        printf("%d AES tests failed\n", fails);
+        return 1;
+    }
+    return 0;
+}
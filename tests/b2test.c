@@ -82,6 +82,30 @@ int main( void )
     }
   }
 
+  /* Test the keyed midstate against its definition: counter, then message */
+  for (step = 0; step < 4; ++step) {
+    blake2s_keyed K;
+    uint8_t ref[BLAKE2S_OUTBYTES];
+    uint64_t ctr = 0x0123456789ABCDEFull * step;
+    memset(&K, 0, sizeof(K));
+    key[0] = (uint8_t)(step / 2);         /* a new key every other pass */
+    for (i = 0; i < BLAKE2_KAT_LENGTH; ++i) {
+      int hsize = 16 + (step & 1) * 16;
+      uint8_t c[8];
+      for (int j = 0; j < 8; ++j) c[j] = (uint8_t)(ctr >> (8 * j));
+      blake2s_state S;
+      b2s_hmac_init(&S, key, hsize, 0);
+      b2s_hmac_puts(&S, c, 8);
+      b2s_hmac_puts(&S, buf, i);
+      b2s_hmac_final(&S, ref);
+      if (b2s_keyed_init(&K, key, hsize, ctr) != hsize) goto fail;
+      b2s_hmac_puts(&K.S, buf, i);
+      b2s_hmac_final(&K.S, hash);
+      if (0 != memcmp(hash, ref, hsize)) goto fail;
+      ctr++;
+    }
+  }
+
   puts( "ok" );
   return 0;
 fail:
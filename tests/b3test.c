@@ -0,0 +1,96 @@
+/*************************************************************************
+ * BLAKE3 tests: the official known answers for the hash (64-byte output)
+ * and the keyed hash, input given byte by byte, all at once (whole chunks
+ * go through the SIMD lanes) and in steps that split blocks and chunks.
+ * Then the mole HMAC slots against their definition.
+ *************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/blake3.h"
+#include "blake3-kat.h"
+
+#define MAX_LENGTH 102400
+
+static uint8_t buf[MAX_LENGTH];
+static const uint8_t *key = (const uint8_t *)B3_KAT_KEY;
+
+static const int steps[] = {1, 63, 64, 65, 1000, 1024, 3 * 1024 + 7, 8 * 1024, 0};
+
+// Hash len bytes in pieces of step bytes, 0 for all at once, -1 for b3_putc
+static void Hash(blake3_state *S, int len, int step) {
+    const uint8_t *p = buf;
+    if (step < 0) {
+        while (len--) b3_putc(S, *p++);
+        return;
+    }
+    if (step == 0) step = len;
+    while (len > 0) {
+        int n = (len < step) ? len : step;
+        b3_puts(S, p, n);
+        p += n;
+        len -= n;
+    }
+}
+
+static int Known(void) {
+    blake3_state S;
+    uint8_t out[64];
+    int fails = 0;
+    for (int k = 0; k < B3_KAT_COUNT; k++) {
+        int len = blake3_kat_length[k];
+        for (int s = -1; s < (int)(sizeof(steps) / sizeof(steps[0])); s++) {
+            int step = (s < 0) ? -1 : steps[s];
+            b3_init(&S);
+            Hash(&S, len, step);
+            b3_final(&S, out, 64);
+            if (memcmp(out, blake3_kat[k], 64)) {
+                printf("Hash of %d bytes in steps of %d failed\n", len, step);
+                fails++;
+            }
+            b3_init_keyed(&S, key);
+            Hash(&S, len, step);
+            b3_final(&S, out, 32);
+            if (memcmp(out, blake3_keyed_kat[k], 32)) {
+                printf("Keyed hash of %d bytes in steps of %d failed\n", len, step);
+                fails++;
+            }
+        }
+    }
+    return fails;
+}
+
+static int Slots(void) {
+    blake3_state S;
+    uint8_t ref[32], out[32], ctr[8];
+    uint64_t counter = 0x0123456789ABCDEFull;
+    for (int i = 0; i < 8; i++) ctr[i] = (uint8_t)(counter >> (8 * i));
+    for (int len = 0; len < 3000; len += 299) {
+        b3_init_keyed(&S, key);
+        b3_puts(&S, ctr, 8);
+        b3_puts(&S, buf, len);
+        b3_final(&S, ref, 32);
+        for (int hsize = 1; hsize <= 32; hsize++) {
+            if (b3_hmac_init(&S, key, hsize, counter) != hsize) return 1;
+            for (int i = 0; i < len; i++) b3_hmac_putc(&S, buf[i]);
+            if (b3_hmac_final(&S, out) != hsize) return 1;
+            if (memcmp(out, ref, hsize)) return 1;
+        }
+    }
+    return b3_hmac_init(&S, key, 33, counter) != 0;
+}
+
+int main(void) {
+    for (int i = 0; i < MAX_LENGTH; i++) buf[i] = (uint8_t)(i % 251);
+    int fails = Known();
+    if (Slots()) {
+        printf("The mole slots do not match their definition\n");
+        fails++;
+    }
+    if (fails) {
+        printf("%d BLAKE3 tests failed\n", fails);
+        return 1;
+    }
+    printf("BLAKE3 ok (%d lanes)\n", B3_LANES);
+    return 0;
+}
@@ -0,0 +1,320 @@
+/*************************************************************************
+ * FIFO tests: the FIFO alone, then a producer and a consumer thread with a
+ * small FIFO between them, then two ports running full-duplex through
+ * FIFOs, with threads moving the bytes between them like UART ISRs.
+ *************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "../src/fifo.h"
+#include "../src/mole.h"
+#include "../src/moleconfig.h"
+
+#define STRESS_BYTES  4000000
+#define MESSAGES         2000
+#define FRAME_ROOM       1024   // more than the longest frame of a message
+
+int moleTRNG(uint8_t *dest, int length) {
+	while (length--) *dest++ = rand() & 0xFF;   // DO NOT USE 'rand' in a real application
+	return 0;                                   // Use a TRNG instead
+}
+
+static uint8_t Pattern(uint32_t i) {
+    return (uint8_t)(i ^ (i >> 8) ^ (i >> 16));
+}
+
+// ---------------------------------------------------------------------------
+// One thread
+
+static int Basic(void) {
+    static uint8_t buf[64];
+    const uint8_t *q;
+    uint8_t *p;
+    fifo_ctx f;
+    int fails = 0;
+    if (!fifo_init(&f, buf, 0) || !fifo_init(&f, buf, 48)
+     || !fifo_init(&f, buf, 2 * FIFO_MAX_SIZE)) fails++;
+    if (fifo_init(&f, buf, 64)) return fails + 1;
+    for (int i = 0; i < 64; i++) {
+        if (fifo_put(&f, Pattern(i))) fails++;
+    }
+    if (!fifo_put(&f, 0) || fifo_room(&f) || (fifo_used(&f) != 64)) fails++;
+    for (int i = 0; i < 64; i++) {
+        if (fifo_get(&f) != Pattern(i)) fails++;
+    }
+    if ((fifo_get(&f) != -1) || fifo_used(&f)) fails++;
+    uint32_t in = 0, out = 0;           // bulk, wrapping around buf
+    for (int round = 0; round < 5000; round++) {
+        int n = fifo_reserve(&f, &p);
+        if (n > (round % 23)) n = round % 23;
+        for (int i = 0; i < n; i++) p[i] = Pattern(in++);
+        fifo_commit(&f, n);
+        n = fifo_peek(&f, &q);
+        if (n > (round % 19)) n = round % 19;
+        for (int i = 0; i < n; i++) {
+            if (q[i] != Pattern(out++)) fails++;
+        }
+        fifo_drop(&f, n);
+        if (fifo_used(&f) != (int)(in - out)) fails++;
+    }
+    if (in < 10000) fails++;
+    return fails;
+}
+
+// ---------------------------------------------------------------------------
+// Two threads
+
+static uint8_t stressBuf[64];
+static fifo_ctx stress;
+
+static void *Producer(void *arg) {
+    uint8_t *p;
+    uint32_t i = 0;
+    while (i < STRESS_BYTES) {
+        if (i & 0x10000) {              // in bulk half the time
+            int n = fifo_reserve(&stress, &p);
+            if (!n) sched_yield();
+            if (n > (int)(STRESS_BYTES - i)) n = STRESS_BYTES - i;
+            for (int k = 0; k < n; k++) p[k] = Pattern(i + k);
+            fifo_commit(&stress, n);
+            i += n;
+        } else if (!fifo_put(&stress, Pattern(i))) {
+            i++;
+        } else {
+            sched_yield();              // full, let the consumer run
+        }
+    }
+    return NULL;
+}
+
+static void *Consumer(void *arg) {
+    const uint8_t *q;
+    uint32_t i = 0;
+    long errors = 0;
+    while (i < STRESS_BYTES) {
+        if (i & 0x8000) {
+            int n = fifo_peek(&stress, &q);
+            if (!n) sched_yield();
+            for (int k = 0; k < n; k++) {
+                if (q[k] != Pattern(i + k)) errors++;
+            }
+            fifo_drop(&stress, n);
+            i += n;
+        } else {
+            int c = fifo_get(&stress);
+            if (c < 0) {
+                sched_yield();
+                continue;
+            }
+            if (c != Pattern(i)) errors++;
+            i++;
+        }
+    }
+    *(long *)arg = errors;
+    return NULL;
+}
+
+static int Stress(void) {
+    pthread_t producer, consumer;
+    long errors = -1;
+    fifo_init(&stress, stressBuf, sizeof(stressBuf));
+    pthread_create(&consumer, NULL, Consumer, &errors);
+    pthread_create(&producer, NULL, Producer, NULL);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    return errors != 0;
+}
+
+// ---------------------------------------------------------------------------
+// Full duplex: the main loop runs both ports, a thread per direction stands
+// in for the UARTs, moving bytes from one port's output FIFO to the other's
+// input FIFO as the transmit and receive ISRs would.
+
+static port_ctx Alice, Bob;
+static uint8_t keys[] = TESTPASS_1;
+static uint8_t buffers[4][2048];
+static fifo_ctx aliceTx, aliceRx, bobTx, bobRx;
+static volatile int running;
+
+typedef struct {
+    port_ctx *port;
+    fifo_ctx *tx, *rx;
+    int pump;                           // send with moleSendPump
+    int sent, received, errors;
+    uint8_t m[202];                     // message being pumped
+} side_t;
+
+static side_t A = {&Alice, &aliceTx, &aliceRx, 1};
+static side_t B = {&Bob, &bobTx, &bobRx, 0};
+
+// Messages are a 16-bit sequence number and 1 to 200 bytes after it
+static void Received(side_t *s, const uint8_t *src, int length) {
+    int seq = src[0] | (src[1] << 8);
+    if ((seq != s->received) || (length != 3 + seq % 200)) s->errors++;
+    for (int i = 2; i < length; i++) {
+        if (src[i] != Pattern(seq + i)) s->errors++;
+    }
+    s->received++;
+}
+
+static void AlicePlain(const uint8_t *src, int length) {
+    Received(&A, src, length);
+}
+
+static void BobPlain(const uint8_t *src, int length) {
+    Received(&B, src, length);
+}
+
+static void Boiler(const uint8_t *src) {
+}
+
+static void Unused(uint8_t c) {         // the ports output to FIFOs
+}
+
+static uint8_t *KeySet(uint8_t *keyset) {
+    return NULL;
+}
+
+static const uint8_t boiler[] = {"\x09" "ftest0<>"};
+
+static void *Uart(void *arg) {
+    fifo_ctx **f = arg;                 // from, to
+    while (running) {
+        int c = -1;
+        if (fifo_room(f[1])) c = fifo_get(f[0]);
+        if (c < 0) sched_yield();
+        else fifo_put(f[1], c);
+    }
+    return NULL;
+}
+
+// Alice pumps her messages, which never waits for the UART. Bob sends his
+// only when a whole frame fits.
+static void Send(side_t *s) {
+    uint8_t *m = s->m;
+    int left = 0;
+    if (s->pump) moleSendPump(s->port, 0, &left);
+    if (left) return;
+    if (s->sent == MESSAGES) return;
+    if (!s->pump && (fifo_room(s->tx) <= FRAME_ROOM)) return;
+    int seq = s->sent++;
+    int length = 3 + seq % 200;
+    m[0] = (uint8_t)seq;
+    m[1] = (uint8_t)(seq >> 8);
+    for (int i = 2; i < length; i++) m[i] = Pattern(seq + i);
+    if (s->pump) moleSendBegin(s->port, m, length);
+    else moleSend(s->port, m, length);
+}
+
+static int FullDuplex(void) {
+    fifo_init(&aliceTx, buffers[0], sizeof(buffers[0]));
+    fifo_init(&aliceRx, buffers[1], sizeof(buffers[1]));
+    fifo_init(&bobTx, buffers[2], sizeof(buffers[2]));
+    fifo_init(&bobRx, buffers[3], sizeof(buffers[3]));
+    moleNoPorts();
+    int ior = moleAddPort(&Alice, boiler, 0, "ALICE", 8, Boiler, AlicePlain,
+                          Unused, KeySet);
+    if (!ior) ior = moleAddPort(&Bob, boiler, 0, "BOB", 8, Boiler, BobPlain,
+                                Unused, KeySet);
+    if (!ior) ior = moleNewKeys(&Alice, keys);
+    if (!ior) ior = moleNewKeys(&Bob, keys);
+    if (ior) {
+        printf("Error %d setting up the ports\n", ior);
+        return 1;
+    }
+    moleTxFifo(&Alice, &aliceTx);
+    moleTxFifo(&Bob, &bobTx);
+    fifo_ctx *ab[2] = {&aliceTx, &bobRx};
+    fifo_ctx *ba[2] = {&bobTx, &aliceRx};
+    pthread_t uart[2];
+    running = 1;
+    pthread_create(&uart[0], NULL, Uart, ab);
+    pthread_create(&uart[1], NULL, Uart, ba);
+    molePair(&Alice);
+    long loops = 0;
+    while ((A.received < MESSAGES) || (B.received < MESSAGES)) {
+        if (moleAvail(&Alice) && moleAvail(&Bob)) {
+            Send(&A);
+            Send(&B);
+        }
+        moleDrain(&Alice, &aliceRx, 0);
+        moleDrain(&Bob, &bobRx, 0);
+        if (!fifo_used(&aliceRx) && !fifo_used(&bobRx)) sched_yield();
+        if (++loops > 100000000) break;
+    }
+    running = 0;
+    pthread_join(uart[0], NULL);
+    pthread_join(uart[1], NULL);
+    printf("Full duplex: Alice got %d, Bob got %d messages\n",
+           A.received, B.received);
+    return A.errors + B.errors + (A.received != MESSAGES)
+         + (B.received != MESSAGES) + (Alice.stats.txFull != 0)
+         + (Bob.stats.txFull != 0);
+}
+
+// With the UARTs stopped, nothing empties the TX FIFOs. Pumps must report
+// that they are full instead of waiting for room. moleSend waits for a UART
+// with nothing attached to make room, and drops nothing.
+
+static volatile uint32_t sunk;
+
+static void *Sink(void *arg) {
+    fifo_ctx *f = arg;
+    while (running) {
+        int c = fifo_get(f);
+        if (c < 0) sched_yield();
+        else sunk++;
+    }
+    return NULL;
+}
+
+static int TxFull(void) {
+    int fails = 0, r = 0, left = 0;
+    for (int i = 0; (i < 100) && (r != MOLE_ERROR_TX_FULL); i++) {
+        moleSendBegin(&Alice, A.m, sizeof(A.m));
+        r = moleSendPump(&Alice, 0, &left);
+    }
+    if ((r != MOLE_ERROR_TX_FULL) || !left || Alice.stats.txFull) fails++;
+    while (fifo_room(&bobTx) > FRAME_ROOM) {
+        if (moleSend(&Bob, B.m, sizeof(B.m))) fails++;
+    }
+    uint32_t queued = fifo_used(&bobTx), out = Bob.stats.bytesOut;
+    pthread_t uart;
+    sunk = 0;
+    running = 1;
+    pthread_create(&uart, NULL, Sink, &bobTx);
+    for (int i = 0; i < 20; i++) {
+        if (moleSend(&Bob, B.m, sizeof(B.m))) fails++;
+    }
+    running = 0;
+    pthread_join(uart, NULL);
+    if (!Bob.stats.txFull || ((sunk + fifo_used(&bobTx))
+                              != (queued + Bob.stats.bytesOut - out))) fails++;
+    return fails;
+}
+
+int main(void) {
+    int fails = 0;
+    if (Basic()) {
+        printf("FIFO put, get, peek or reserve failed\n");
+        fails++;
+    }
+    if (Stress()) {
+        printf("FIFO between two threads lost or changed bytes\n");
+        fails++;
+    }
+    if (FullDuplex()) {
+        printf("Messages were lost or changed in full duplex\n");
+        fails++;
+    }
+    if (TxFull()) {
+        printf("A full TX FIFO made a pump wait or a send drop bytes\n");
+        fails++;
+    }
+    if (fails) return 1;
+    printf("FIFOs ok\n");
+    return 0;
+}
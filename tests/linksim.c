@@ -0,0 +1,90 @@
+/*
+ * Discrete-event serial link simulator, see linksim.h
+ */
+#include <string.h>
+#include "linksim.h"
+
+void sim_init(sim_link *link, const sim_config *cfg, port_ctx *a, port_ctx *b) {
+    memset(link, 0, sizeof(sim_link));
+    link->cfg = *cfg;
+    link->rng = cfg->seed ? cfg->seed : 1;
+    link->dir[0].to = b;
+    link->dir[1].to = a;
+}
+
+double sim_random(sim_link *link) {     // xorshift64*
+    uint64_t x = link->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    link->rng = x;
+    return ((x * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Flip bits at the current error rate, moving in and out of bursts
+static uint8_t Corrupt(sim_link *link, sim_dir *d, uint8_t c) {
+    const sim_config *cfg = &link->cfg;
+    if (cfg->burstStart > 0) {
+        if (d->burst) d->burst = (sim_random(link) >= cfg->burstEnd);
+        else          d->burst = (sim_random(link) < cfg->burstStart);
+    }
+    double ber = d->burst ? cfg->burstBer : cfg->ber;
+    if (ber <= 0) return c;
+    for (int i = 0; i < 10; i++) {      // start, 8 data and stop bits
+        if (sim_random(link) < ber) {
+            d->flipped++;
+            if ((i > 0) && (i < 9)) c ^= 1 << (i - 1);
+        }
+    }
+    return c;
+}
+
+uint64_t sim_free(sim_link *link, int dir) {
+    uint64_t t = link->dir[dir].free;
+    if (link->cfg.halfDuplex && (link->dir[dir ^ 1].free > t)) {
+        t = link->dir[dir ^ 1].free;
+    }
+    return (t > link->now) ? t : link->now;
+}
+
+void sim_send(sim_link *link, int dir, uint8_t c) {
+    sim_dir *d = &link->dir[dir];
+    uint64_t start = sim_free(link, dir);
+    d->free = start + 10000000000ULL / link->cfg.baud;
+    sim_byte *b = &d->q[d->tail++ % SIM_QUEUE];
+    b->time = d->free + link->cfg.delay;
+    b->c = Corrupt(link, d, c);
+    d->sent++;
+}
+
+int sim_run(sim_link *link, uint64_t until) {
+    int n = 0;
+    while (1) {
+        sim_dir *d = NULL;              // earliest arrival of both directions
+        for (int i = 0; i < 2; i++) {
+            sim_dir *e = &link->dir[i];
+            if (e->head == e->tail) continue;
+            if (e->q[e->head % SIM_QUEUE].time > until) continue;
+            if ((d == NULL) || (e->q[e->head % SIM_QUEUE].time
+                              < d->q[d->head % SIM_QUEUE].time)) d = e;
+        }
+        if (d == NULL) break;
+        sim_byte b = d->q[d->head++ % SIM_QUEUE];
+        if (b.time > link->now) link->now = b.time;
+        molePutc(d->to, b.c);           // may send more
+        n++;
+    }
+    if (until > link->now) link->now = until;
+    return n;
+}
+
+uint64_t sim_idle(sim_link *link) {
+    uint64_t t = link->now;
+    for (int i = 0; i < 2; i++) {
+        sim_dir *d = &link->dir[i];
+        if (d->head == d->tail) continue;
+        uint64_t last = d->q[(d->tail - 1) % SIM_QUEUE].time;
+        if (last > t) t = last;
+    }
+    return t;
+}
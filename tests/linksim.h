@@ -0,0 +1,97 @@
+/*
+ * Discrete-event simulation of a serial link between two mole ports.
+ * Bytes are paced at the baud rate (10 bits per byte), arrive after a
+ * propagation delay and may be corrupted on the way, either by independent
+ * bit errors or by bursts (a two-state Gilbert-Elliott model). A half-duplex
+ * link has one transmitter shared by both ends. Time is in nanoseconds and
+ * the random numbers come from the link's own seeded generator, so a run is
+ * reproducible.
+ *
+ * Port output functions call sim_send, which queues the byte. sim_run hands
+ * the bytes to molePutc in order of arrival, so replies are queued rather
+ * than nested inside the sender's call.
+ */
+#include <stdint.h>
+#include "../src/mole.h"
+
+#ifndef _LINKSIM_H_
+#define _LINKSIM_H_
+
+#define SIM_QUEUE   0x10000             /* bytes in flight per direction */
+#define SIM_MS      1000000ULL          /* nanoseconds per millisecond */
+
+typedef struct {
+    uint32_t baud;          // bits per second
+    uint32_t delay;         // propagation delay in ns
+    double ber;             // bit error rate outside of bursts
+    double burstBer;        // bit error rate during a burst
+    double burstStart;      // chance per byte that a burst starts
+    double burstEnd;        // chance per byte that a burst ends
+    int halfDuplex;         // one transmitter for both directions
+    uint64_t seed;          // random number seed, not 0
+} sim_config;
+
+typedef struct {
+    uint64_t time;          // arrival time
+    uint8_t c;
+} sim_byte;
+
+typedef struct {
+    sim_byte q[SIM_QUEUE];
+    uint32_t head, tail;    // q index of the next arrival and next send
+    uint64_t free;          // time the transmitter is free
+    port_ctx *to;           // receiving port
+    int burst;              // in a burst
+    uint32_t sent;          // bytes sent
+    uint32_t flipped;       // bits flipped
+} sim_dir;
+
+typedef struct {
+    sim_config cfg;
+    sim_dir dir[2];         // 0: a to b, 1: b to a
+    uint64_t now;           // simulated time
+    uint64_t rng;
+} sim_link;
+
+/** Initialize a link
+ * @param link  Link
+ * @param cfg   Configuration, copied
+ * @param a     Port at one end
+ * @param b     Port at the other end
+ */
+void sim_init(sim_link *link, const sim_config *cfg, port_ctx *a, port_ctx *b);
+
+/** Send a byte, for use in a port's output function
+ * @param link  Link
+ * @param dir   0 from a to b, 1 from b to a
+ * @param c     Byte
+ */
+void sim_send(sim_link *link, int dir, uint8_t c);
+
+/** Deliver the bytes that arrive by a given time, then advance to that time
+ * @param link  Link
+ * @param until Time in ns
+ * @return      Bytes delivered
+ */
+int sim_run(sim_link *link, uint64_t until);
+
+/** Time when a direction's transmitter is free
+ * @param link  Link
+ * @param dir   0 from a to b, 1 from b to a
+ * @return      Time in ns, at least now
+ */
+uint64_t sim_free(sim_link *link, int dir);
+
+/** Time when the last byte in flight arrives
+ * @param link  Link
+ * @return      Time in ns, at least now
+ */
+uint64_t sim_idle(sim_link *link);
+
+/** Random number from the link's generator
+ * @param link  Link
+ * @return      Uniform in [0, 1)
+ */
+double sim_random(sim_link *link);
+
+#endif /* _LINKSIM_H_ */
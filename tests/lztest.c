@@ -0,0 +1,83 @@
+/*************************************************************************
+ * This is a simple program to test the LZSS codec: round trips of text,
+ * long runs, random data and edge cases, with a wrapping history buffer.
+ *************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/lzss.h"
+
+static uint8_t packed[0x6000];
+static uint8_t unpacked[0x4000];
+static int npacked, nunpacked;
+
+static void Pack(void *arg, uint8_t c) {
+    (void)arg;
+    packed[npacked++] = c;
+}
+
+static void Unpack(uint8_t c) {
+    unpacked[nunpacked++] = c;
+}
+
+/** Compress, append an end marker, decompress through a small history.
+ * @returns 0 on success, -1 on failure
+ */
+int round_trip(const char *name, const uint8_t *src, int len, int window) {
+    uint8_t hist[LZ_MAX_WINDOW];
+    lz_enc enc;
+    lz_dec dec;
+    npacked = nunpacked = 0;
+    lz_enc_init(&enc);
+    int n = lz_encode(&enc, src, len, 0, window, NULL, NULL);
+    n += lz_flush(&enc, 0, NULL, NULL);
+    lz_enc_init(&enc);
+    lz_encode(&enc, src, len / 2, 0, window, Pack, NULL); // in two pieces
+    lz_encode(&enc, &src[len / 2], len - len / 2, len / 2, window, Pack, NULL);
+    lz_flush(&enc, 1, Pack, NULL);
+    lz_dec_init(&dec, hist, window, Unpack);
+    int r = 0;
+    for (int i = 0; (i < npacked) && (r == 0); i++) {
+        r = lz_dec_putc(&dec, packed[i]);
+    }
+    if ((r != 1) || (nunpacked != len) || memcmp(src, unpacked, len)
+     || (npacked > n + 8)) {     // the split costs a token or two
+        printf("%s: round trip failed\n", name);
+        return -1;
+    }
+    printf("%-8s %5d bytes -> %5d bytes, window %d\n", name, len, n, window);
+    return 0;
+}
+
+int main(void) {
+    static uint8_t buf[0x4000];
+    int fails = 0, len = 0;
+    const char *line = "[%6d.%03d] sensor %d: temperature %d.%d C, ok\r\n";
+    while (len < (int)sizeof(buf) - 64) {
+        int n = len / 50;
+        len += sprintf((char*)&buf[len], line, n, n % 1000, n % 4,
+                       20 + n % 7, n % 10);
+    }
+    fails += round_trip("log", buf, len, 256);
+    fails += round_trip("log", buf, len, 1024);
+    memset(buf, 'x', 1000);
+    fails += round_trip("run", buf, 1000, 16);
+    srand(1);
+    for (int i = 0; i < 1000; i++) buf[i] = rand();
+    fails += round_trip("random", buf, 1000, 512);
+    fails += round_trip("short", (const uint8_t*)"ab", 2, 64);
+    fails += round_trip("empty", buf, 0, 64);
+    lz_dec dec;                         // a match before the start is bad
+    uint8_t hist[16];
+    lz_dec_init(&dec, hist, sizeof(hist), NULL);
+    lz_dec_putc(&dec, 1);
+    lz_dec_putc(&dec, 0);
+    if (lz_dec_putc(&dec, 0x10) != -1) {
+        printf("Bad distance was not detected\n");
+        fails++;
+    }
+    if (fails) return 1;
+    printf("LZSS tests passed\n");
+    return 0;
+}
@@ -0,0 +1,355 @@
+/*************************************************************************
+ * Microbenchmarks of the crypto primitives and the mole protocol.
+ * Usage: mbench [-csv]
+ * Each result is the best of RUNS runs of a workload sized to take at least
+ * MIN_SECONDS, so results are repeatable enough to compare builds.
+ * Output is JSON, or CSV with -csv.
+ *************************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "../src/xchacha.h"
+#include "../src/blake2s.h"
+#include "../src/poly1305.h"
+#include "../src/aes.h"
+#include "../src/blake3.h"
+#include "../src/mole.h"
+#include "../src/moleconfig.h"
+
+#define RUNS            5
+#define MIN_SECONDS  0.05
+
+int moleTRNG(uint8_t *dest, int length) {
+	while (length--) *dest++ = rand() & 0xFF;   // DO NOT USE 'rand' in a real application
+	return 0;                                   // Use a TRNG instead
+}
+
+#if (MOLE_TIMING)
+uint32_t moleClock(void) {
+    return (uint32_t)clock();
+}
+#endif
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef void (*benchFn)(int n);         // run the workload n times
+
+static double excluded;                 // seconds the workload left out
+
+// Seconds per workload: best of RUNS, after doubling n to MIN_SECONDS
+static double Measure(benchFn fn) {
+    int n = 1;
+    double t;
+    while (1) {
+        excluded = 0;
+        t = Now();
+        fn(n);
+        t = Now() - t;
+        if ((t >= MIN_SECONDS) || (n >= (1 << 28))) break;
+        n *= 2;
+    }
+    double best = (t - excluded) / n;
+    for (int i = 1; i < RUNS; i++) {
+        excluded = 0;
+        t = Now();
+        fn(n);
+        t = (Now() - t - excluded) / n;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+static int csv, results;
+
+static void Report(const char *bench, int param, double value, const char *unit) {
+    if (csv) {
+        if (!results) printf("bench,param,value,unit\n");
+        printf("%s,%d,%.4g,%s\n", bench, param, value, unit);
+    } else {
+        printf("%s\n  {\"bench\": \"%s\", \"param\": %d, \"value\": %.4g, "
+               "\"unit\": \"%s\"}", results ? "," : "[", bench, param, value,
+               unit);
+    }
+    results++;
+}
+
+// ---------------------------------------------------------------------------
+// Primitives
+
+static const uint8_t key[32] = {1, 2, 3, 4, 5, 6, 7, 8};
+static const uint8_t iv[16] = {9, 10, 11, 12};
+static uint8_t buf[0x10000];
+static int size;                        // bytes per workload
+static xChaCha_ctx xc;
+static blake2s_state b2;
+static poly1305_ctx p1305;
+static aes_ctx aes;
+static ghash_ctx gh;
+static blake3_state b3;
+
+static void CryptBlock(int n) {
+    while (n--) {
+        for (int i = 0; i < size; i += 16) {
+            xc_crypt_block(&xc, &buf[i], &buf[i], 1);
+        }
+    }
+}
+
+static void EncryptBytes(int n) {
+    while (n--) xchacha_encrypt_bytes(&xc, buf, buf, size);
+}
+
+static void HmacPuts(int n) {
+    uint8_t hash[16];
+    while (n--) {
+        b2s_hmac_init(&b2, key, 16, 0);
+        b2s_hmac_puts(&b2, buf, size);
+        b2s_hmac_final(&b2, hash);
+    }
+}
+
+static void HmacPutc(int n) {           // the way mole hashes
+    uint8_t hash[16];
+    while (n--) {
+        b2s_hmac_init(&b2, key, 16, 0);
+        for (int i = 0; i < size; i++) b2s_hmac_putc(&b2, buf[i]);
+        b2s_hmac_final(&b2, hash);
+    }
+}
+
+static void PolyPutc(int n) {
+    uint8_t hash[16];
+    while (n--) {
+        p1305_hmac_init(&p1305, key, 16, 1);
+        for (int i = 0; i < size; i++) p1305_hmac_putc(&p1305, buf[i]);
+        p1305_hmac_final(&p1305, hash);
+    }
+}
+
+static void B3Puts(int n) {             // SIMD lanes for whole chunks
+    uint8_t hash[16];
+    while (n--) {
+        b3_init_keyed(&b3, key);
+        b3_puts(&b3, buf, size);
+        b3_final(&b3, hash, 16);
+    }
+}
+
+static void B3Putc(int n) {
+    uint8_t hash[16];
+    while (n--) {
+        b3_hmac_init(&b3, key, 16, 1);
+        for (int i = 0; i < size; i++) b3_hmac_putc(&b3, buf[i]);
+        b3_hmac_final(&b3, hash);
+    }
+}
+
+static void AesBlock(int n) {
+    while (n--) {
+        for (int i = 0; i < size; i += 16) {
+            aes_crypt_block(&aes, &buf[i], &buf[i], 1);
+        }
+    }
+}
+
+static void GhashPutc(int n) {
+    uint8_t hash[16];
+    while (n--) {
+        gh_hmac_init(&gh, key, 16, 1);
+        for (int i = 0; i < size; i++) gh_hmac_putc(&gh, buf[i]);
+        gh_hmac_final(&gh, hash);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Protocol: Alice and Bob connected by a loopback
+
+static port_ctx Alice, Bob;
+static uint8_t keys[] = TESTPASS_1;
+static int received;
+
+static void AliceOut(uint8_t c) {
+    molePutc(&Bob, c);
+}
+
+static void BobOut(uint8_t c) {
+    molePutc(&Alice, c);
+}
+
+static void Plain(const uint8_t *src, int length) {
+    received += length;
+}
+
+static void Boiler(const uint8_t *src) {
+}
+
+static uint8_t *KeySet(uint8_t *keyset) {
+    return NULL;
+}
+
+static const uint8_t boiler[] = {"\x09mbench0<>"};
+
+static void NewKeys(int n) {
+    while (n--) moleNewKeys(&Alice, keys);
+}
+
+static void RoundTrip(int n) {
+    while (n--) moleSend(&Alice, buf, size);
+}
+
+static void RoundTripPrimed(int n) {    // idle-time work is not counted
+    while (n--) {
+        double t = Now();
+        molePrecompute(&Alice, 100);
+        molePrecompute(&Bob, 100);
+        excluded += Now() - t;
+        moleSend(&Alice, buf, size);
+    }
+}
+
+static uint8_t file[0x12000];
+static int fileLen, filePos;
+
+static void ToFile(uint8_t c) {
+    file[fileLen++] = c;
+}
+
+static int FromFile(void) {
+    if (filePos == fileLen) return -1;
+    return file[filePos++];
+}
+
+static void Discard(uint8_t c) {
+}
+
+static void FileOut(int n) {            // 64K in pieces of size bytes
+    while (n--) {
+        fileLen = 0;
+        moleFileNew(&Alice);
+        for (int i = 0; i < (int)sizeof(buf); i += size) {
+            moleFileOut(&Alice, &buf[i], size);
+        }
+        moleFileFinal(&Alice);
+    }
+}
+
+static void FileIn(int n) {
+    while (n--) {
+        filePos = 0;
+        if (moleFileIn(&Bob, FromFile, Discard)) {
+            printf("\nmoleFileIn failed\n");
+            exit(1);
+        }
+    }
+}
+
+static const int msgs[] = {1, 16, 64, 256, 480};
+
+// Round trips with another protocol, the ports are set up again
+static int RoundTrips(int protocol, const char *bench) {
+    moleNoPorts();
+    int ior = moleAddPort(&Alice, boiler, protocol, "ALICE", 8, Boiler, Plain,
+                          AliceOut, KeySet);
+    if (!ior) ior = moleAddPort(&Bob, boiler, protocol, "BOB", 8, Boiler, Plain,
+                                BobOut, KeySet);
+    if (!ior) ior = moleNewKeys(&Alice, keys);
+    if (!ior) ior = moleNewKeys(&Bob, keys);
+    if (!ior) molePair(&Alice);
+    if (ior || !moleAvail(&Alice)) {
+        printf("\nProtocol %d pairing failed\n", protocol);
+        return 1;
+    }
+    received = 0;
+    for (int i = 0; i < 5; i++) {
+        size = msgs[i];
+        Report(bench, size, Measure(RoundTrip) * 1e6, "us");
+    }
+    return received == 0;
+}
+
+int main(int argc, char *argv[]) {
+    csv = (argc > 1) && !strcmp(argv[1], "-csv");
+    srand(1);
+    for (int i = 0; i < (int)sizeof(buf); i++) buf[i] = rand();
+    const int sizes[] = {64, 1024, 16384};
+    xc_crypt_init(&xc, key, iv, 1);
+    for (int i = 0; i < 3; i++) {
+        size = sizes[i];
+        Report("xc_crypt_block", size, size / Measure(CryptBlock) * 1e-6, "MB/s");
+        Report("xchacha_encrypt_bytes", size,
+               size / Measure(EncryptBytes) * 1e-6, "MB/s");
+        Report("b2s_hmac_puts", size, size / Measure(HmacPuts) * 1e-6, "MB/s");
+        Report("b2s_hmac_putc", size, size / Measure(HmacPutc) * 1e-6, "MB/s");
+        Report("p1305_hmac_putc", size, size / Measure(PolyPutc) * 1e-6, "MB/s");
+        Report("b3_puts", size, size / Measure(B3Puts) * 1e-6, "MB/s");
+        Report("b3_hmac_putc", size, size / Measure(B3Putc) * 1e-6, "MB/s");
+    }
+    aes_crypt_init(&aes, key, iv, 1);
+    for (int hw = aes_hw(1); hw >= 0; hw--) {   // AES-NI, then software
+        aes_hw(hw);
+        const char *names[2][2] = {{"aes_crypt_block_sw", "gh_hmac_putc_sw"},
+                                   {"aes_crypt_block", "gh_hmac_putc"}};
+        for (int i = 0; i < 3; i++) {
+            size = sizes[i];
+            Report(names[hw][0], size, size / Measure(AesBlock) * 1e-6, "MB/s");
+            Report(names[hw][1], size, size / Measure(GhashPutc) * 1e-6, "MB/s");
+        }
+    }
+    aes_hw(1);
+    moleNoPorts();
+    int ior = moleAddPort(&Alice, boiler, 0, "ALICE", 8, Boiler, Plain,
+                          AliceOut, KeySet);
+    if (!ior) ior = moleAddPort(&Bob, boiler, 0, "BOB", 8, Boiler, Plain,
+                                BobOut, KeySet);
+    if (!ior) ior = moleNewKeys(&Bob, keys);
+    if (ior) {
+        printf("\nError %d setting up the ports\n", ior);
+        return 1;
+    }
+    Report("moleNewKeys", 0, 1 / Measure(NewKeys), "1/s");
+    molePair(&Alice);
+    if (!moleAvail(&Alice)) {
+        printf("\nPairing failed\n");
+        return 1;
+    }
+    for (int i = 0; i < 5; i++) {
+        size = msgs[i];
+        Report("moleSend_molePutc", size, Measure(RoundTrip) * 1e6, "us");
+    }
+    for (int i = 0; i < 5; i++) {
+        size = msgs[i];
+        Report("moleSend_molePutc_primed", size,
+               Measure(RoundTripPrimed) * 1e6, "us");
+    }
+    if (received == 0) return 1;
+    Alice.ciphrFn = ToFile;
+    const int chunks[] = {16, 256, 4096};   // bytes per moleFileOut
+    for (int i = 0; i < 3; i++) {
+        size = chunks[i];
+        Report("moleFileOut", size, sizeof(buf) / Measure(FileOut) * 1e-6,
+               "MB/s");
+    }
+    Report("moleFileIn", 1 << MOLE_FILE_CHUNK_SIZE_LOG2,
+           sizeof(buf) / Measure(FileIn) * 1e-6, "MB/s");
+    if (RoundTrips(MOLE_PROTOCOL_POLY1305, "moleSend_molePutc_p1305")) return 1;
+    if (RoundTrips(MOLE_PROTOCOL_BLAKE2S_MID, "moleSend_molePutc_b2mid")) return 1;
+    if (RoundTrips(MOLE_PROTOCOL_BLAKE3, "moleSend_molePutc_b3")) return 1;
+    Alice.ciphrFn = ToFile;             // bulk hashing, then byte by byte
+    for (int i = 0; i < 2; i++) {
+        size = sizeof(buf) / 4;
+        Report(i ? "moleFileOut_b3_putc" : "moleFileOut_b3", size,
+               sizeof(buf) / Measure(FileOut) * 1e-6, "MB/s");
+        Alice.hputsFn = NULL;
+    }
+    if (RoundTrips(MOLE_PROTOCOL_AES, "moleSend_molePutc_aes")) return 1;
+    aes_hw(0);
+    if (RoundTrips(MOLE_PROTOCOL_AES, "moleSend_molePutc_aes_sw")) return 1;
+    if (!csv) printf("\n]\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Ciphertext capture, see molecap.h
+ */
+#include <string.h>
+#include <time.h>
+#include "molecap.h"
+
+static uint64_t Clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void Out(cap_file *cap, uint64_t x, int bytes) {
+    for (int i = 0; i < bytes; i++) fputc((x >> (8 * i)) & 0xFF, cap->file);
+}
+
+static void Record(cap_file *cap, int type, int port, uint64_t time,
+                   const uint8_t *data, int len) {
+    fputc(type, cap->file);
+    fputc(port, cap->file);
+    Out(cap, time - cap->start, 8);
+    Out(cap, len, 2);
+    fwrite(data, 1, len, cap->file);
+}
+
+static void Flush(cap_file *cap) {
+    if (cap->len) Record(cap, cap->type, cap->port, cap->time, cap->run, cap->len);
+    cap->len = 0;
+}
+
+int cap_open(cap_file *cap, const char *name) {
+    memset(cap, 0, sizeof(cap_file));
+    cap->file = fopen(name, "wb");
+    if (cap->file == NULL) return -1;
+    fwrite(CAP_MAGIC, 1, 8, cap->file);
+    cap->start = Clock();
+    return 0;
+}
+
+void cap_name(cap_file *cap, int port, const char *name) {
+    if (cap->file == NULL) return;
+    Flush(cap);
+    Record(cap, CAP_NAME, port, Clock(), (const uint8_t *)name, strlen(name));
+}
+
+void cap_port(cap_file *cap, int port, const cap_setup *setup) {
+    const uint8_t data[8] = {setup->protocol, setup->caps,
+        (uint8_t)setup->blocks, (uint8_t)(setup->blocks >> 8),
+        setup->arqSlots, setup->fecData, setup->fecParity, setup->lz};
+    if (cap->file == NULL) return;
+    Flush(cap);
+    Record(cap, CAP_PORT, port, Clock(), data, sizeof(data));
+}
+
+void cap_byte(cap_file *cap, int port, int type, uint8_t c) {
+    if (cap->file == NULL) return;
+    uint64_t t = Clock();
+    if ((type != cap->type) || (port != cap->port) || (cap->len == CAP_RUN)
+     || ((t - cap->last) > CAP_GAP)) {
+        Flush(cap);
+        cap->type = type;
+        cap->port = port;
+        cap->time = t;
+    }
+    cap->run[cap->len++] = c;
+    cap->last = t;
+}
+
+void cap_close(cap_file *cap) {
+    if (cap->file == NULL) return;
+    Flush(cap);
+    fclose(cap->file);
+    cap->file = NULL;
+}
@@ -0,0 +1,83 @@
+/*
+ * Capture of the ciphertext a port sends and receives, for replay by
+ * molereplay.c. Call cap_byte from the port's output function (CAP_TX) and
+ * next to molePutc (CAP_RX). Bytes are grouped into runs of one port and
+ * direction, each stamped with the CLOCK_MONOTONIC time of its first byte.
+ *
+ * File format, little-endian: "MOLECAP" 1, then records of
+ * type[1] port[1] time[8] length[2] data[length]
+ * where time is in ns since the capture was opened, a CAP_NAME record
+ * holds the port's name and a CAP_PORT record its setup:
+ * protocol[1] caps[1] blocks[2] arqSlots[1] fecData[1] fecParity[1] lz[1]
+ */
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef _MOLECAP_H_
+#define _MOLECAP_H_
+
+#define CAP_MAGIC   "MOLECAP\x01"
+#define CAP_RUN     1024                /* max bytes per record */
+#define CAP_GAP     100000              /* ns between bytes that ends a run */
+
+enum capTypes {
+    CAP_NAME,               // port name
+    CAP_RX,                 // ciphertext into molePutc
+    CAP_TX,                 // ciphertext from the output function
+    CAP_PORT                // port setup, see cap_setup
+};
+
+typedef struct {
+    uint8_t protocol;       // MOLE_PROTOCOL_? of moleAddPort
+    uint8_t caps;           // MOLE_CAP_? for moleSetCaps
+    uint16_t blocks;        // rxBlocks of moleAddPort
+    uint8_t arqSlots;       // moleArqInit, 0 if none
+    uint8_t fecData;        // moleFecInit, 0 if none
+    uint8_t fecParity;
+    uint8_t lz;             // 1 if moleLzInit was called
+} cap_setup;
+
+typedef struct {
+    FILE *file;
+    uint64_t start;         // clock when opened
+    uint64_t time, last;    // clock at the first and last byte of the run
+    uint8_t type, port;
+    uint16_t len;
+    uint8_t run[CAP_RUN];
+} cap_file;
+
+/** Start a capture
+ * @param cap   Capture
+ * @param name  File name
+ * @return      0 if okay, -1 if the file cannot be written
+ */
+int cap_open(cap_file *cap, const char *name);
+
+/** Name a port, for the replayer to find it
+ * @param cap   Capture
+ * @param port  Port number, chosen by the application
+ * @param name  Port name
+ */
+void cap_name(cap_file *cap, int port, const char *name);
+
+/** Record how a port is set up, for the replayer to set up its own the same
+ * @param cap   Capture
+ * @param port  Port number
+ * @param setup Port setup
+ */
+void cap_port(cap_file *cap, int port, const cap_setup *setup);
+
+/** Record a byte
+ * @param cap   Capture
+ * @param port  Port number
+ * @param type  CAP_RX or CAP_TX
+ * @param c     Ciphertext byte
+ */
+void cap_byte(cap_file *cap, int port, int type, uint8_t c);
+
+/** Finish a capture
+ * @param cap   Capture
+ */
+void cap_close(cap_file *cap);
+
+#endif /* _MOLECAP_H_ */
@@ -0,0 +1,323 @@
+/*************************************************************************
+ * Load generator: N virtual devices talk to N gateway ports in the same
+ * process, each pair connected by a socketpair or a pseudo-terminal.
+ * Usage: mload [-n devices] [-r msgs/s] [-s bytes] [-t seconds]
+ *              [-churn pairs/s] [-rekey rekeys/s] [-pty] [-seed n]
+ * Each device has its own keyset and boilerplate and sends timestamped
+ * messages at -r per second. -churn and -rekey are per-device rates of
+ * pairing requests and key changes. The report covers aggregate throughput,
+ * gateway CPU time per port and per message, and one-way latency.
+ *************************************************************************/
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "../src/blake2s.h"
+#include "../src/mole.h"
+#include "../src/moleconfig.h"
+
+#define OUT_BUFFER  0x2000              /* pending output per endpoint */
+
+int moleTRNG(uint8_t *dest, int length) {
+	while (length--) *dest++ = rand() & 0xFF;   // DO NOT USE 'rand' in a real application
+	return 0;                                   // Use a TRNG instead
+}
+
+// An endpoint is a device (0 to n-1) or its gateway port (n to 2n-1)
+typedef struct {
+    port_ctx port;
+    int fd;
+    uint8_t out[OUT_BUFFER];
+    int outLen;
+    uint64_t cpu;           // ns spent receiving
+    char name[16];
+    uint8_t boiler[16];     // counted string
+} endpoint;
+
+static endpoint *ep;
+static uint8_t (*keys)[MOLE_PASSCODE_LENGTH];   // per device
+static int n = 100;                     // devices
+static int cur;                         // endpoint being called
+static uint32_t overruns;               // output bytes dropped
+
+static uint64_t Now(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// Callbacks have no port argument, so cur says whose they are
+
+static void Out(uint8_t c) {
+    endpoint *e = &ep[cur];
+    if (e->outLen == OUT_BUFFER) overruns++;
+    else e->out[e->outLen++] = c;
+}
+
+static void Flush(endpoint *e) {
+    if (!e->outLen) return;
+    int r = write(e->fd, e->out, e->outLen);
+    if (r <= 0) return;                 // full, try again later
+    memmove(e->out, &e->out[r], e->outLen - r);
+    e->outLen -= r;
+}
+
+static void Boiler(const uint8_t *src) {
+}
+
+static uint32_t *latency;               // one-way, in ns
+static int latencies, latencyMax;
+static uint64_t delivered, deliveredBytes;
+
+static void DevicePlain(const uint8_t *src, int length) {
+}
+
+static void GatewayPlain(const uint8_t *src, int length) {
+    uint64_t sent = 0;
+    if (length < 8) return;
+    for (int i = 7; i >= 0; i--) sent = (sent << 8) | src[i];
+    delivered++;
+    deliveredBytes += length;
+    if (latencies == latencyMax) {
+        latencyMax = latencyMax ? 2 * latencyMax : 0x10000;
+        latency = realloc(latency, latencyMax * sizeof(uint32_t));
+        if (latency == NULL) exit(1);
+    }
+    uint64_t t = Now(CLOCK_MONOTONIC) - sent;
+    latency[latencies++] = (t > 0xFFFFFFFF) ? 0xFFFFFFFF : t;
+}
+
+static uint8_t *KeySet(uint8_t *keyset) {   // both ends keep the new keys
+    uint8_t *k = keys[cur % n];
+    memcpy(k, keyset, MOLE_PASSCODE_LENGTH);
+    return k;
+}
+
+static const uint8_t KHK[] = KDF_PASS;
+
+static void NewKeyset(uint8_t *k) {     // like randkey.c
+    blake2s_state h;
+    moleTRNG(k, MOLE_PASSCODE_HMAC);
+    b2s_hmac_init(&h, KHK, 16, 0);
+    b2s_hmac_puts(&h, k, MOLE_PASSCODE_HMAC);
+    b2s_hmac_final(&h, &k[MOLE_PASSCODE_HMAC]);
+}
+
+// ---------------------------------------------------------------------------
+// Connections
+
+static int pty;
+
+static int Raw(int fd) {
+    struct termios t;
+    if (tcgetattr(fd, &t)) return -1;
+    cfmakeraw(&t);
+    return tcsetattr(fd, TCSANOW, &t);
+}
+
+static int Connect(endpoint *device, endpoint *gateway) {
+    int fd[2];
+    if (pty) {
+        fd[1] = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((fd[1] < 0) || grantpt(fd[1]) || unlockpt(fd[1])) return -1;
+        fd[0] = open(ptsname(fd[1]), O_RDWR | O_NOCTTY);
+        if ((fd[0] < 0) || Raw(fd[0]) || Raw(fd[1])) return -1;
+    } else if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd)) {
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(fd[i], F_SETFL, fcntl(fd[i], F_GETFL) | O_NONBLOCK);
+    }
+    device->fd = fd[0];
+    gateway->fd = fd[1];
+    return 0;
+}
+
+static int Setup(int rxBlocks) {
+    struct rlimit lim;
+    if (!getrlimit(RLIMIT_NOFILE, &lim) && (lim.rlim_cur < lim.rlim_max)) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    ep = calloc(2 * n, sizeof(endpoint));
+    keys = calloc(n, MOLE_PASSCODE_LENGTH);
+    if ((ep == NULL) || (keys == NULL)) return 1;
+    moleNoPorts();
+    for (int i = 0; i < 2 * n; i++) {
+        endpoint *e = &ep[i];
+        int device = i < n;
+        if (device) NewKeyset(keys[i]);
+        snprintf(e->name, sizeof(e->name), "%s%d", device ? "DEV" : "GW", i % n);
+        int len = snprintf((char *)&e->boiler[1], sizeof(e->boiler) - 1,
+                           "load0<%05d>", i % n);
+        e->boiler[0] = len;
+        int ior = moleAddPort(&e->port, e->boiler, 0, e->name, rxBlocks, Boiler,
+                              device ? DevicePlain : GatewayPlain, Out, KeySet);
+        if (!ior) ior = moleNewKeys(&e->port, keys[i % n]);
+        if (ior) {
+            printf("Error %d adding port %s", ior, e->name);
+            if (ior == MOLE_ERROR_OUT_OF_MEMORY) {
+                printf(", context memory is short by %d bytes", -moleRAMunused());
+            }
+            printf("\n");
+            return 1;
+        }
+        if (device && Connect(e, &ep[i + n])) {
+            printf("Cannot connect %s, see ulimit -n\n", e->name);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+
+static double Chance(void) {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static int Compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double Percentile(double p) {    // in us, nearest rank
+    if (!latencies) return 0;
+    int i = (int)(p * latencies / 100 + 0.999999) - 1;
+    return latency[(i < 0) ? 0 : i] * 1e-3;
+}
+
+int main(int argc, char *argv[]) {
+    double rate = 10, seconds = 5, churn = 0, rekey = 0;
+    int size = 32, seed = 1;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : "0";
+        if      (!strcmp(a, "-pty"))   { pty = 1;  continue; }
+        else if (!strcmp(a, "-n"))     n = atoi(v);
+        else if (!strcmp(a, "-r"))     rate = atof(v);
+        else if (!strcmp(a, "-s"))     size = atoi(v);
+        else if (!strcmp(a, "-t"))     seconds = atof(v);
+        else if (!strcmp(a, "-churn")) churn = atof(v);
+        else if (!strcmp(a, "-rekey")) rekey = atof(v);
+        else if (!strcmp(a, "-seed"))  seed = atoi(v);
+        else {
+            printf("Usage: mload [-n devices] [-r msgs/s] [-s bytes] [-t seconds]\n"
+                   "             [-churn pairs/s] [-rekey rekeys/s] [-pty] [-seed n]\n");
+            return 1;
+        }
+        i++;
+    }
+    if (size < 8) size = 8;             // room for the timestamp
+    if ((n < 1) || (rate <= 0)) return 1;
+    srand(seed);
+    int rxBlocks = (size + 18 + 63) / 64 + 1;
+    if (Setup(rxBlocks)) return 1;
+    struct pollfd *pfd = calloc(2 * n, sizeof(struct pollfd));
+    uint64_t *due = calloc(n, sizeof(uint64_t));
+    uint8_t *m = calloc(size, 1);
+    if ((pfd == NULL) || (due == NULL) || (m == NULL)) return 1;
+    uint64_t period = 1e9 / rate;
+    uint64_t start = Now(CLOCK_MONOTONIC);
+    uint64_t end = start + seconds * 1e9;
+    uint64_t last = start;
+    for (int i = 0; i < n; i++) {
+        due[i] = start + period * Chance();     // spread the devices out
+        cur = i;
+        molePair(&ep[i].port);
+    }
+    uint64_t sent = 0, skipped = 0, rekeys = 0;
+    uint8_t k[MOLE_PASSCODE_LENGTH];
+    uint64_t now = start;
+    while (now < end) {
+        double dt = (now - last) * 1e-9;    // for churn and rekeys
+        last = now;
+        for (int i = 0; i < n; i++) {       // devices
+            port_ctx *p = &ep[i].port;
+            cur = i;
+            if ((churn > 0) && (Chance() < churn * dt)) molePair(p);
+            if ((rekey > 0) && moleAvail(p) && (Chance() < rekey * dt)) {
+                NewKeyset(k);
+                if (!moleReKey(p, k)) rekeys++;
+            }
+            while (due[i] <= now) {
+                due[i] += period;
+                if (!moleAvail(p)) {
+                    skipped++;
+                    continue;
+                }
+                uint64_t t = Now(CLOCK_MONOTONIC);
+                for (int j = 0; j < 8; j++) m[j] = t >> (8 * j);
+                if (!moleSend(p, m, size)) sent++;
+            }
+        }
+        for (int i = 0; i < 2 * n; i++) {
+            Flush(&ep[i]);
+            pfd[i].fd = ep[i].fd;
+            pfd[i].events = POLLIN;
+        }
+        poll(pfd, 2 * n, 1);
+        for (int i = 0; i < 2 * n; i++) {
+            if (!(pfd[i].revents & POLLIN)) continue;
+            endpoint *e = &ep[i];
+            uint8_t buf[1024];
+            int len = read(e->fd, buf, sizeof(buf));
+            uint64_t cpu = Now(CLOCK_THREAD_CPUTIME_ID);
+            cur = i;
+            for (int j = 0; j < len; j++) molePutc(&e->port, buf[j]);
+            e->cpu += Now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+            Flush(e);
+        }
+        now = Now(CLOCK_MONOTONIC);
+    }
+    double elapsed = (now - start) * 1e-9;
+    uint64_t gatewayCpu = 0, deviceCpu = 0, maxCpu = 0;
+    mole_stats s, total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < 2 * n; i++) {
+        moleStats(&ep[i].port, &s);
+        total.pairings += s.pairings;   // requests from either end
+        if (i < n) {
+            deviceCpu += ep[i].cpu;
+            continue;
+        }
+        gatewayCpu += ep[i].cpu;
+        if (ep[i].cpu > maxCpu) maxCpu = ep[i].cpu;
+        total.rekeys += s.rekeys;
+        total.badHMAC += s.badHMAC;
+        total.rejected += s.rejected;
+        total.lost += s.lost;
+    }
+    qsort(latency, latencies, sizeof(uint32_t), Compare);
+    printf("%d devices over %s, %.0f msgs/s of %d bytes each, %.1f s\n", n,
+           pty ? "ptys" : "socketpairs", rate, size, elapsed);
+    printf("sent %llu, delivered %llu, not paired %llu, output overruns %u\n",
+           (unsigned long long)sent, (unsigned long long)delivered,
+           (unsigned long long)skipped, overruns);
+    printf("throughput: %.0f msgs/s, %.0f bytes/s\n", delivered / elapsed,
+           deliveredBytes / elapsed);
+    printf("latency us: p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+           Percentile(50), Percentile(99), Percentile(99.9), Percentile(100));
+    printf("gateway CPU: %.2f%% of a core, %.4f%% per port (max %.4f%%), "
+           "%.2f us per message\n", 100e-9 * gatewayCpu / elapsed,
+           100e-9 * gatewayCpu / elapsed / n, 100e-9 * maxCpu / elapsed,
+           delivered ? 1e-3 * gatewayCpu / delivered : 0);
+    printf("device CPU receiving: %.2f%% of a core\n",
+           100e-9 * deviceCpu / elapsed);
+    printf("%u pairing requests, %llu rekeys requested, %u gateway ports rekeyed, "
+           "%u bad HMACs, %u rejected, %u lost\n", total.pairings,
+           (unsigned long long)rekeys, total.rekeys, total.badHMAC,
+           total.rejected, total.lost);
+    return 0;
+}
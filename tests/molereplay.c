@@ -0,0 +1,301 @@
+/*************************************************************************
+ * Replay a port's captured ciphertext (molecap.h) into a fresh port.
+ * Usage: mreplay file [-port name] [-k keyfile] [-timed] [-n repeats]
+ *                [-blocks n] [-arq slots] [-fec data parity] [-nolz] [-caps n]
+ *                [-protocol n]
+ * The received bytes go to molePutc as fast as possible, or at their
+ * captured times with -timed. The port is set up as the capture's CAP_PORT
+ * record says, and the port options override it. Captures without one get
+ * the setup of moletest.c. keyfile holds the port's 64-byte keyset,
+ * TESTPASS_1 by default.
+ *
+ * The port's HMAC counter for received frames comes from the secret part of
+ * the IV it sent, which is random. The replayer decrypts each IV the port
+ * sent from the captured output and gives the replay port the same counter.
+ * Rekeys started by the captured port are not followed.
+ *************************************************************************/
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "../src/xchacha.h"
+#include "../src/aes.h"
+#include "../src/mole.h"
+#include "../src/moleconfig.h"
+#include "molecap.h"
+
+int moleTRNG(uint8_t *dest, int length) {
+	while (length--) *dest++ = rand() & 0xFF;   // DO NOT USE 'rand' in a real application
+	return 0;                                   // Use a TRNG instead
+}
+
+typedef struct {
+    uint8_t type, port;
+    uint64_t time;          // ns since the capture started
+    uint16_t len;
+    const uint8_t *data;
+} record;
+
+static uint8_t *capture;
+static record *records;
+static int nrecords;
+
+static uint64_t In(const uint8_t *p, int bytes) {
+    uint64_t x = 0;
+    for (int i = bytes - 1; i >= 0; i--) x = (x << 8) | p[i];
+    return x;
+}
+
+static int Load(const char *name) {
+    FILE *f = fopen(name, "rb");
+    if (f == NULL) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    capture = malloc(size);
+    if ((capture == NULL) || (fread(capture, 1, size, f) != (size_t)size)
+     || (size < 8) || memcmp(capture, CAP_MAGIC, 8)) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    records = malloc((size / 12 + 1) * sizeof(record));
+    if (records == NULL) return -1;
+    for (long i = 8; (i + 12) <= size; ) {
+        record *r = &records[nrecords++];
+        r->type = capture[i];
+        r->port = capture[i + 1];
+        r->time = In(&capture[i + 2], 8);
+        r->len = In(&capture[i + 10], 2);
+        r->data = &capture[i + 12];
+        i += 12 + r->len;
+        if (i > size) return -1;        // truncated
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// The replay port
+
+static port_ctx port;
+static uint8_t keys[MOLE_PASSCODE_LENGTH] = TESTPASS_1;
+static const uint8_t boiler[] = {"\x07replay0"};
+static int blocks = 3, slots = 8, fecData = 64, fecParity = 8, lz = 1;
+static int caps = -1;                   // for moleSetCaps, -1 to keep
+static int protocol;                    // MOLE_PROTOCOL_?
+static int given;                       // options set on the command line
+static uint64_t delivered, deliveredBytes;
+
+static void Discard(uint8_t c) {
+}
+
+static void Boiler(const uint8_t *src) {
+}
+
+static void Plain(const uint8_t *src, int length) {
+    delivered++;
+    deliveredBytes += length;
+}
+
+static uint8_t *KeySet(uint8_t *keyset) {
+    memcpy(keys, keyset, MOLE_PASSCODE_LENGTH);
+    return keys;
+}
+
+#define OPT_BLOCKS   1
+#define OPT_ARQ      2
+#define OPT_FEC      4
+#define OPT_LZ       8
+#define OPT_CAPS    16
+#define OPT_PROTOCOL 32
+
+// Take the port setup from a CAP_PORT record, except what the options set
+static void Captured(const record *r) {
+    const uint8_t *d = r->data;
+    if (r->len < 8) return;
+    if (!(given & OPT_PROTOCOL)) protocol = d[0];
+    if (!(given & OPT_CAPS))     caps = d[1];
+    if (!(given & OPT_BLOCKS))   blocks = (int)In(&d[2], 2);
+    if (!(given & OPT_ARQ))      slots = d[4];
+    if (!(given & OPT_FEC)) {
+        fecData = d[5];
+        fecParity = d[6];
+    }
+    if (!(given & OPT_LZ))       lz = d[7];
+}
+
+static int Setup(const char *name) {
+    moleNoPorts();
+    int ior = moleAddPort(&port, boiler, protocol, name, blocks, Boiler, Plain,
+                          Discard, KeySet);
+    if (!ior && slots) ior = moleArqInit(&port, slots);
+    if (!ior && fecData) ior = moleFecInit(&port, fecData, fecParity);
+    if (!ior && lz) ior = moleLzInit(&port);
+    if (!ior) ior = moleNewKeys(&port, keys);
+    if (caps >= 0) moleSetCaps(&port, caps);
+    return ior;
+}
+
+// Follow the captured port's output and take the HMAC counter from its IVs:
+// Tag, mIV[16], encrypted cIV[16], ...
+static struct {
+    uint8_t prev, esc;
+    int n;                  // IV bytes collected, -1 if not in an IV
+    uint8_t iv[2 * MOLE_IV_LENGTH];
+} sent = {0, 0, -1};
+
+static void Sent(uint8_t c) {
+    uint8_t prev = sent.prev;
+    sent.prev = c;
+    if (c == MOLE_TAG_END) {
+        sent.n = -1;
+        return;
+    }
+    if ((prev == MOLE_TAG_END) && ((c == MOLE_TAG_IV_A) || (c == MOLE_TAG_IV_B))) {
+        sent.n = 0;
+        sent.esc = 0;
+        return;
+    }
+    if (sent.n < 0) return;
+    if (sent.esc) {
+        sent.esc = 0;
+        c += MOLE_TAG_END;
+    } else if (c == MOLE_ESCAPE) {
+        sent.esc = 1;
+        return;
+    }
+    sent.iv[sent.n++] = c;
+    if (sent.n < 2 * MOLE_IV_LENGTH) return;
+    uint8_t civ[MOLE_IV_LENGTH];
+    if (protocol == MOLE_PROTOCOL_AES) {
+        aes_ctx a;
+        aes_crypt_init(&a, port.cryptokey, sent.iv, 0);
+        aes_crypt_block(&a, &sent.iv[MOLE_IV_LENGTH], civ, 1);
+    } else {
+        xChaCha_ctx x;
+        xc_crypt_init(&x, port.cryptokey, sent.iv, 0);
+        xc_crypt_block(&x, &sent.iv[MOLE_IV_LENGTH], civ, 1);
+    }
+    memcpy(&port.hashCounterRX, civ, 8);
+    sent.n = -1;
+}
+
+static uint64_t Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void Until(uint64_t t) {
+    uint64_t now = Now();
+    if (t <= now) return;
+    struct timespec ts = {(t - now) / 1000000000ULL, (t - now) % 1000000000ULL};
+    nanosleep(&ts, NULL);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Usage: mreplay file [-port name] [-k keyfile] [-timed] [-n repeats]\n"
+               "               [-blocks n] [-arq slots] [-fec data parity] [-nolz] [-caps n]\n"
+               "               [-protocol n]\n");
+        return 1;
+    }
+    const char *name = NULL;
+    int timed = 0, repeats = 1;
+    for (int i = 2; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : "0";
+        if      (!strcmp(a, "-timed"))  { timed = 1;  continue; }
+        else if (!strcmp(a, "-nolz"))   { lz = 0;  given |= OPT_LZ;  continue; }
+        else if (!strcmp(a, "-port"))   name = v;
+        else if (!strcmp(a, "-n"))      repeats = atoi(v);
+        else if (!strcmp(a, "-blocks")) { blocks = atoi(v);  given |= OPT_BLOCKS; }
+        else if (!strcmp(a, "-arq"))    { slots = atoi(v);  given |= OPT_ARQ; }
+        else if (!strcmp(a, "-caps"))   { caps = strtol(v, NULL, 0);  given |= OPT_CAPS; }
+        else if (!strcmp(a, "-protocol")) { protocol = atoi(v);  given |= OPT_PROTOCOL; }
+        else if (!strcmp(a, "-fec")) {
+            given |= OPT_FEC;
+            fecData = atoi(v);
+            fecParity = (i + 2 < argc) ? atoi(argv[++i]) : 0;
+        } else if (!strcmp(a, "-k")) {
+            FILE *f = fopen(v, "rb");
+            int n = f ? fread(keys, 1, sizeof(keys), f) : 0;
+            if (f) fclose(f);
+            if (n != sizeof(keys)) {
+                printf("Cannot read a keyset from %s\n", v);
+                return 1;
+            }
+        } else {
+            printf("Unknown option %s\n", a);
+            return 1;
+        }
+        i++;
+    }
+    if (Load(argv[1])) {
+        printf("Cannot load %s\n", argv[1]);
+        return 1;
+    }
+    int p = -1;
+    for (int i = 0; (i < nrecords) && (p < 0); i++) {
+        const record *r = &records[i];
+        if (r->type != CAP_NAME) continue;
+        if ((name == NULL) || ((strlen(name) == r->len)
+                            && !memcmp(name, r->data, r->len))) {
+            p = r->port;
+            if (name == NULL) {
+                char *s = malloc(r->len + 1);
+                memcpy(s, r->data, r->len);
+                s[r->len] = 0;
+                name = s;
+            }
+        }
+    }
+    if (p < 0) {
+        printf("No port %s in %s\n", name ? name : "", argv[1]);
+        return 1;
+    }
+    for (int i = 0; i < nrecords; i++) {
+        if ((records[i].type == CAP_PORT) && (records[i].port == p)) {
+            Captured(&records[i]);
+        }
+    }
+    uint64_t bytes = 0, busy = 0;
+    mole_stats s;
+    for (int n = 0; n < repeats; n++) {
+        int ior = Setup(name);
+        if (ior) {
+            printf("Error %d setting up the port\n", ior);
+            return 1;
+        }
+        memset(&sent, 0, sizeof(sent));
+        sent.n = -1;
+        delivered = deliveredBytes = 0;
+        uint64_t start = Now();
+        for (int i = 0; i < nrecords; i++) {
+            const record *r = &records[i];
+            if (r->port != p) continue;
+            if (timed) Until(start + r->time);
+            if (r->type == CAP_TX) {
+                for (int j = 0; j < r->len; j++) Sent(r->data[j]);
+            } else if (r->type == CAP_RX) {
+                uint64_t t = Now();
+                for (int j = 0; j < r->len; j++) molePutc(&port, r->data[j]);
+                busy += Now() - t;
+                bytes += r->len;
+            }
+        }
+        moleStats(&port, &s);
+    }
+    printf("%s: %u frames in, %llu messages (%llu bytes) delivered, "
+           "%u bad HMACs, %u rejected, %u lost\n", name, s.framesIn,
+           (unsigned long long)delivered, (unsigned long long)deliveredBytes,
+           s.badHMAC, s.rejected, s.lost);
+    if (busy) {
+        printf("molePutc: %llu bytes in %.3f ms, %.2f MB/s, %.1f ns per byte\n",
+               (unsigned long long)bytes, busy * 1e-6, bytes * 1e3 / busy,
+               (double)busy / bytes);
+    }
+    return delivered == 0;
+}
@@ -0,0 +1,246 @@
+/*************************************************************************
+ * Link scenarios: Alice sends messages to Bob over a simulated serial link
+ * (linksim.c) as fast as the line allows. Each scenario reports goodput,
+ * message latency percentiles and re-pairs.
+ * Usage: msim [-csv] [seed]
+ * Runs are reproducible: the link and moleTRNG are seeded from seed.
+ * Returns 1 if a scenario that should deliver everything did not.
+ *************************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include "../src/mole.h"
+#include "../src/moleconfig.h"
+#include "linksim.h"
+
+#define MESSAGES     500
+#define MSG_BYTES     40                /* 4-byte sequence number, then text */
+#define PAIR_WAIT  (500 * SIM_MS)       /* before pairing again */
+#define GIVE_UP (120000 * SIM_MS)       /* time limit per scenario */
+
+int moleTRNG(uint8_t *dest, int length) {
+	while (length--) *dest++ = rand() & 0xFF;   // DO NOT USE 'rand' in a real application
+	return 0;                                   // Use a TRNG instead
+}
+
+typedef struct {
+    const char *name;
+    uint8_t caps;           // MOLE_CAP_?
+    int all;                // everything should be delivered
+    uint32_t tick;          // moleArqTick period in ms
+    sim_config link;        // seed is filled in
+} scenario;
+
+#define RS  MOLE_CAP_RESYNC
+#define ARQ MOLE_CAP_ARQ
+#define FEC MOLE_CAP_FEC
+
+static const scenario scenarios[] = {
+//    name             caps       all tick  baud   delay      ber  burst ber start end  half
+    {"clean",          0,          1, 20, {115200,  5*SIM_MS, 0,    0,    0,    0,   0}},
+    {"clean_half_arq", RS|ARQ,     1, 20, {115200,  5*SIM_MS, 0,    0,    0,    0,   1}},
+    {"ber_1e-5",       RS,         0, 20, {115200,  5*SIM_MS, 1e-5, 0,    0,    0,   0}},
+    {"ber_1e-4",       RS,         0, 20, {115200,  5*SIM_MS, 1e-4, 0,    0,    0,   0}},
+    {"ber_1e-4_arq",   RS|ARQ,     1, 20, {115200,  5*SIM_MS, 1e-4, 0,    0,    0,   0}},
+    {"ber_1e-4_fec",   RS|FEC,     0, 20, {115200,  5*SIM_MS, 1e-4, 0,    0,    0,   0}},
+    {"burst_arq",      RS|ARQ,     1, 20, {115200,  5*SIM_MS, 1e-6, 0.05, 1e-4, 0.1, 0}},
+    {"burst_arq_fec",  RS|ARQ|FEC, 1, 20, {115200,  5*SIM_MS, 1e-6, 0.05, 1e-4, 0.1, 0}},
+    {"radio_half_arq", RS|ARQ,     1, 200, {9600, 100*SIM_MS, 1e-5, 0,    0,    0,   1}},
+};
+
+static port_ctx Alice, Bob;
+static sim_link link;
+static uint8_t keys[] = TESTPASS_1;
+static const uint8_t boiler[] = {"\x07msim0<>"};
+
+static void AliceOut(uint8_t c) {
+    sim_send(&link, 0, c);
+}
+
+static void BobOut(uint8_t c) {
+    sim_send(&link, 1, c);
+}
+
+static void Boiler(const uint8_t *src) {
+}
+
+static uint8_t *KeySet(uint8_t *keyset) {
+    return NULL;
+}
+
+static uint64_t sentAt[MESSAGES];
+static uint64_t latency[MESSAGES];      // of delivered messages
+static uint8_t got[MESSAGES];
+static int delivered;
+static uint64_t lastDelivery;
+
+static void AlicePlain(const uint8_t *src, int length) {
+}
+
+static void BobPlain(const uint8_t *src, int length) {
+    if (length != MSG_BYTES) return;
+    uint32_t id = src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+    if ((id >= MESSAGES) || got[id]) return;    // replayed by a re-pair
+    got[id] = 1;
+    latency[delivered++] = link.now - sentAt[id];
+    lastDelivery = link.now;
+}
+
+static int arq;                         // scenario uses MOLE_CAP_ARQ
+static uint64_t tick, nextTick;
+static int unacked;                     // Alice's messages not yet acknowledged
+
+// Run the link up to time t, ticking the retransmit timers on the way
+static void Advance(uint64_t t) {
+    while (nextTick <= t) {
+        sim_run(&link, nextTick);
+        if (arq) {
+            unacked = moleArqTick(&Alice);
+            moleArqTick(&Bob);
+        }
+        nextTick += tick;
+    }
+    sim_run(&link, t);
+}
+
+// Pair if needed, return 0 if paired
+static int Paired(void) {
+    uint64_t asked = 0;
+    while (!moleAvail(&Alice) || !moleAvail(&Bob)) {
+        if (link.now >= GIVE_UP) return 1;
+        if (!asked || (link.now - asked) >= PAIR_WAIT) {
+            molePair(&Alice);
+            asked = link.now;
+        }
+        Advance(link.now + SIM_MS);
+    }
+    return 0;
+}
+
+static int Setup(const scenario *s) {
+    moleNoPorts();
+    int ior = moleAddPort(&Alice, boiler, 0, "ALICE", 4, Boiler, AlicePlain,
+                          AliceOut, KeySet);
+    if (!ior) ior = moleAddPort(&Bob, boiler, 0, "BOB", 4, Boiler, BobPlain,
+                                BobOut, KeySet);
+    if (!ior) ior = moleArqInit(&Alice, 8);
+    if (!ior) ior = moleArqInit(&Bob, 8);
+    if (!ior) ior = moleFecInit(&Alice, 64, 8);
+    if (!ior) ior = moleFecInit(&Bob, 64, 8);
+    if (!ior) ior = moleNewKeys(&Alice, keys);
+    if (!ior) ior = moleNewKeys(&Bob, keys);
+    moleSetCaps(&Alice, s->caps);
+    moleSetCaps(&Bob, s->caps);
+    return ior;
+}
+
+static int Compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Latency percentile in ms, nearest rank
+static double Percentile(int p) {
+    if (!delivered) return 0;
+    int i = (p * delivered + 99) / 100 - 1;
+    return latency[(i < 0) ? 0 : i] / (double)SIM_MS;
+}
+
+static int csv, results;
+
+static void Report(const scenario *s, uint64_t seconds_ns, int repairs) {
+    double seconds = seconds_ns * 1e-9;
+    double goodput = seconds > 0 ? delivered * (MSG_BYTES - 4) / seconds : 0;
+    double line = s->link.baud / 10.0;  // bytes/s
+    if (csv) {
+        if (!results) printf("scenario,caps,baud,delivered,messages,goodput,"
+                             "efficiency,p50_ms,p90_ms,p99_ms,repairs\n");
+        printf("%s,%d,%u,%d,%d,%.0f,%.3f,%.2f,%.2f,%.2f,%d\n", s->name,
+               s->caps, s->link.baud, delivered, MESSAGES, goodput,
+               goodput / line, Percentile(50), Percentile(90), Percentile(99),
+               repairs);
+    } else {
+        if (!results) printf("%-16s %4s %6s %9s %9s %6s %8s %8s %8s %7s\n",
+                             "scenario", "caps", "baud", "delivered",
+                             "bytes/s", "eff", "p50 ms", "p90 ms", "p99 ms",
+                             "repairs");
+        printf("%-16s %4d %6u %4d/%-4d %9.0f %5.1f%% %8.2f %8.2f %8.2f %7d\n",
+               s->name, s->caps, s->link.baud, delivered, MESSAGES, goodput,
+               100 * goodput / line, Percentile(50), Percentile(90),
+               Percentile(99), repairs);
+    }
+    results++;
+}
+
+// Returns 1 if the scenario fell short of its expectations
+static int Run(const scenario *s, uint64_t seed) {
+    sim_config cfg = s->link;
+    cfg.seed = seed;
+    srand((unsigned)seed);
+    sim_init(&link, &cfg, &Alice, &Bob);
+    memset(got, 0, sizeof(got));
+    delivered = 0;
+    lastDelivery = 0;
+    tick = s->tick * SIM_MS;
+    nextTick = tick;
+    unacked = 0;
+    arq = (s->caps & MOLE_CAP_ARQ) != 0;
+    int ior = Setup(s);
+    if (ior) {
+        printf("Error %d setting up the ports\n", ior);
+        return 1;
+    }
+    if (Paired()) {
+        printf("%s: pairing failed\n", s->name);
+        return 1;
+    }
+    mole_stats a0, b0, a1, b1;
+    moleStats(&Alice, &a0);
+    moleStats(&Bob, &b0);
+    uint64_t start = link.now;
+    uint8_t m[MSG_BYTES];
+    for (int i = 0; i < MSG_BYTES; i++) m[i] = 'a' + (i % 26);
+    int i = 0;
+    while ((i < MESSAGES) && !Paired()) {
+        Advance(sim_free(&link, 0));    // wait for the UART
+        m[0] = i;  m[1] = i >> 8;  m[2] = i >> 16;  m[3] = i >> 24;
+        sentAt[i] = link.now;
+        if (arq) {
+            if (moleArqSend(&Alice, m, MSG_BYTES)) {    // window is full
+                Advance(nextTick);
+                continue;
+            }
+        } else {
+            moleSend(&Alice, m, MSG_BYTES);
+        }
+        i++;
+    }
+    Advance(sim_idle(&link));
+    while (arq && (link.now < GIVE_UP) && !Paired()) {  // wait for the ACKs
+        Advance(nextTick);
+        if (!unacked) break;
+    }
+    Advance(sim_idle(&link));
+    moleStats(&Alice, &a1);
+    moleStats(&Bob, &b1);
+    qsort(latency, delivered, sizeof(latency[0]), Compare);
+    Report(s, lastDelivery - start, (a1.pairings - a0.pairings)
+                                  + (b1.pairings - b0.pairings));
+    return s->all && (delivered != MESSAGES);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-csv")) csv = 1;
+        else seed = strtoull(argv[i], NULL, 0);
+    }
+    int fails = 0;
+    for (int i = 0; i < (int)(sizeof(scenarios) / sizeof(scenarios[0])); i++) {
+        fails += Run(&scenarios[i], seed + i);
+    }
+    if (fails) printf("%d scenarios fell short\n", fails);
+    return fails != 0;
+}
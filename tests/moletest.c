@@ -2,8 +2,11 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 #include "../src/mole.h"
 #include "../src/moleconfig.h"
+#include "../src/moletrace.h"
+#include "molecap.h"
 
 // ---------------------------------------------------------------------------
 // Some default values for testing
@@ -12,18 +15,30 @@ port_ctx Alice;
 port_ctx Bob;
 int snoopy;
 
-#define MY_PROTOCOL 0
+#ifndef MY_PROTOCOL
+#define MY_PROTOCOL 0                   // see MOLE_PROTOCOL_?
+#endif
 
 // Connect Alice to Bob via a virtual null-modem cable
 
 int error_pacing = 720;
 int errorpos = 0;                      // inject error every error_pacing byte
+double ber;                            // or flip random bits at this rate
+int quiet;                             // suppress per-message output
+int wirebytes, repairs, prevbyte;      // link statistics
+cap_file cap;                          // Bob's ciphertext, when open
 
 static uint8_t snoop(uint8_t c, char t) {
     if (!(++errorpos % error_pacing)) {
         c++;
-        printf("\n<><><><><><> Error injected <><><><><><> ");
+        if (!quiet) printf("\n<><><><><><> Error injected <><><><><><> ");
     }
+    if (ber > 0) for (int i = 0; i < 8; i++) {
+        if (rand() < (ber * RAND_MAX)) c ^= 1 << i;
+    }
+    wirebytes++;
+    if ((prevbyte == MOLE_TAG_END) && (c == MOLE_TAG_RESET)) repairs++;
+    prevbyte = c;
     if (!snoopy) return c;
     printf("%02X", c);
     if (c == 0x12) printf("\n");
@@ -69,6 +84,14 @@ static char* errorCode(int e) {
         return "Built-in Self Test failed ";
     case MOLE_ERROR_UNKNOWN_MSG:
         return "Unknown message ";
+    case MOLE_ERROR_MSG_LOST:
+        return "Peer reported lost messages ";
+    case MOLE_ERROR_OUT_OF_SYNC:
+        return "Out of sync, re-pairing ";
+    case MOLE_ERROR_OVERRUN:
+        return "Frame dropped, no buffer or work pending ";
+    case MOLE_ERROR_TX_FULL:
+        return "TX FIFO is full ";
     default: return "unknown";
     }
 }
@@ -91,16 +114,43 @@ static char* errorCode(int e) {
 #define MOLE_ERROR_BAD_BIST           17
 #define MOLE_ERROR_UNKNOWN_MSG        18
 
+// WCET harness: the longest molePutc call, not counting the molePutc calls
+// of the far end that its replies make over the loopback
+
+static uint64_t putcMax, putcNested;    // ns
+static int putcDepth;                   // molePutc calls in progress
+
+static uint64_t Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int Putc(port_ctx *ctx, uint8_t c) {
+    uint64_t nested = putcNested;
+    uint64_t t = Now();
+    putcDepth++;
+    int r = molePutc(ctx, c);
+    putcDepth--;
+    t = Now() - t;
+    uint64_t own = t - (putcNested - nested);
+    putcNested = nested + t;
+    if (own > putcMax) putcMax = own;
+    return r;
+}
+
 static void AliceCiphertextOutput(uint8_t c) {
     c = snoop(c, '-');
-    int r = molePutc(&Bob, c);
-    if (r) printf("\n*** Bob returned %d: %s, ", r, errorCode(r));
+    cap_byte(&cap, 1, CAP_RX, c);
+    int r = Putc(&Bob, c);
+    if (r && !quiet) printf("\n*** Bob returned %d: %s, ", r, errorCode(r));
 }
 
 static void BobCiphertextOutput(uint8_t c) {
+    cap_byte(&cap, 1, CAP_TX, c);
     c = snoop(c, '~');
-    int r = molePutc(&Alice, c);
-    if (r) printf("\n*** Alice returned %d: %s, ", r, errorCode(r));
+    int r = Putc(&Alice, c);
+    if (r && !quiet) printf("\n*** Alice returned %d: %s, ", r, errorCode(r));
 }
 
 /*
@@ -108,16 +158,31 @@ Received-plaintest functions
 */
 
 static char LastReceived[4096];
+int delivered, deliveredBytes;
+int deliveredInPutc;                    // plainFn called from molePutc
+int inorder = -1;                       // expected AliceMessages index, if >= 0
+int misordered;
+static void CheckOrder(const uint8_t *src, int length);
+static int holding;                     // keep messages from Bob's ring
+static const uint8_t *lastSrc;
 
 static void PlaintextHandler(const uint8_t *src, int length) {
-    printf("\nPlaintext {");
-    for (int i = 0; i < length; i++) {
-        putc(src[i], stdout);
-        //printf("%02x/", src[i]);
+    delivered++;
+    deliveredBytes += length;
+    if (putcDepth) deliveredInPutc++;
+    if (inorder >= 0) CheckOrder(src, length);
+    if (!quiet) {
+        printf("\nPlaintext {");
+        for (int i = 0; i < length; i++) {
+            putc(src[i], stdout);
+            //printf("%02x/", src[i]);
+        }
+        printf("} ");
     }
-    printf("} ");
     memcpy(LastReceived, src, length);
     LastReceived[length] = 0;
+    lastSrc = src;
+    if (!holding) moleRelease(&Bob, src);
 }
 
 static int TestLast(const char* expected) {
@@ -171,6 +236,19 @@ const uint8_t BobMessages[][128] = {
 "17. Bob: \"... For he himself has said it, and it's clearly to his credit, that he is an Englishman.\"",
 "18.      \"He remai-hains ah-han Eh-heh-heh-heh-heh-hengLISHman!\""};
 
+// Selective repeat delivers in order, but a re-pairing may replay a few
+static void CheckOrder(const uint8_t *src, int length) {
+    int elements = sizeof(AliceMessages) / sizeof(AliceMessages[0]);
+    const char *s = (const char*)AliceMessages[inorder % elements];
+    int back = 0;
+    while ((length != (int)strlen(s)) || memcmp(src, s, length)) {
+        if ((++back > 8) || (back > inorder)) break;
+        s = (const char*)AliceMessages[(inorder - back) % elements];
+    }
+    if (back > 8) misordered++;
+    else inorder += 1 - back;
+}
+
 int SendAlice(int msgID) {
     int elements = sizeof(AliceMessages) / sizeof(AliceMessages[0]);
     if (msgID >= elements) msgID = elements - 1;
@@ -211,11 +289,171 @@ int PairAlice(void) {
     return (moleAvail(&Alice)) && (moleAvail(&Bob));
 }
 
+// Send Alice's messages to Bob over a line with an error every `pacing`
+// bytes. Goodput is the fraction of wire bytes that delivered plaintext.
+// Returns the number of messages delivered.
+
+#define BAUD_RATE 115200
+
+static int ErrorRun(uint8_t caps, int pacing, int messages) {
+    int elements = sizeof(AliceMessages) / sizeof(AliceMessages[0]);
+    moleSetCaps(&Alice, caps);
+    moleSetCaps(&Bob, caps);
+    quiet = 1;
+    molePair(&Alice);
+    delivered = deliveredBytes = wirebytes = repairs = 0;
+    error_pacing = pacing;
+    errorpos = 0;
+    for (int i = 0; i < messages; i++) {
+        if (!moleAvail(&Alice)) molePair(&Alice);
+        const uint8_t* s = AliceMessages[i % elements];
+        moleSend(&Alice, s, strlen((char*)s));
+    }
+    error_pacing = 100000000;
+    quiet = 0;
+    double seconds = wirebytes * 10.0 / BAUD_RATE;
+    if (ber > 0) printf("\ncaps=%d, bit error rate %.0e: ", caps, ber);
+    else printf("\ncaps=%d, error every %d bytes: ", caps, pacing);
+    printf("%d of %d delivered, "
+           "%d re-pairs, goodput %.1f%%, %.0f bytes/s at %d baud",
+           delivered, messages, repairs,
+           100.0 * deliveredBytes / wirebytes,
+           deliveredBytes / seconds, BAUD_RATE);
+    return delivered;
+}
+
+// Send Alice's messages to Bob with selective repeat. The retransmit timer
+// ticks once per message sent. Returns the number of messages delivered.
+
+static int ArqRun(uint8_t caps, int pacing, int messages) {
+    int elements = sizeof(AliceMessages) / sizeof(AliceMessages[0]);
+    moleSetCaps(&Alice, caps);
+    moleSetCaps(&Bob, caps);
+    quiet = 1;
+    molePair(&Alice);
+    delivered = deliveredBytes = wirebytes = repairs = 0;
+    misordered = 0;
+    Alice.arq->resent = 0;
+    inorder = 0;
+    error_pacing = pacing;
+    errorpos = 0;
+    int i;
+    for (i = 0; i < messages; i++) {
+        const uint8_t* s = AliceMessages[i % elements];
+        for (int t = 0; t < 1000; t++) {
+            if (!moleAvail(&Alice)) molePair(&Alice);
+            if (!moleArqSend(&Alice, s, strlen((char*)s))) break;
+            moleArqTick(&Alice);        // window is full
+            moleArqTick(&Bob);
+        }
+        moleArqTick(&Alice);
+        moleArqTick(&Bob);
+    }
+    for (int t = 0; t < 1000; t++) {    // wait for the last ACKs
+        if (!moleAvail(&Alice)) molePair(&Alice);
+        moleArqTick(&Bob);
+        if (!moleArqTick(&Alice)) break;
+    }
+    error_pacing = 100000000;
+    quiet = 0;
+    double seconds = wirebytes * 10.0 / BAUD_RATE;
+    printf("\ncaps=%d, error every %d bytes: %d of %d delivered in order, "
+           "%d replayed, %d resent, %d re-pairs, goodput %.1f%%, "
+           "%.0f bytes/s at %d baud", caps, pacing, inorder, messages,
+           delivered - inorder, Alice.arq->resent, repairs,
+           100.0 * deliveredBytes / wirebytes,
+           deliveredBytes / seconds, BAUD_RATE);
+    i = misordered ? 0 : inorder;
+    inorder = -1;
+    return i;
+}
+
+// Device console output: a few log lines per message
+
+static int LogLines(char *dest, int first, int lines) {
+    int len = 0;
+    for (int n = first; n < (first + lines); n++) {
+        len += sprintf(&dest[len], "[%5d.%03d] adc%d %4d mV, temp %2d.%d C\r\n",
+                       n / 4, (n * 250) % 1000, n & 3, 3300 - (n % 17),
+                       20 + (n % 5), n % 10);
+    }
+    return len;
+}
+
+// Send console output from Alice to Bob. Returns bytes per second over the
+// wire at BAUD_RATE, or 0 if a message was not delivered intact.
+
+static int LogRun(uint8_t caps, int messages) {
+    char s[256];
+    moleSetCaps(&Alice, caps);
+    moleSetCaps(&Bob, caps);
+    quiet = 1;
+    molePair(&Alice);
+    delivered = deliveredBytes = wirebytes = 0;
+    int bad = 0;
+    for (int i = 0; i < messages; i++) {
+        int len = LogLines(s, 3 * i, 3);
+        moleSend(&Alice, (uint8_t*)s, len);
+        if (TestLast(s)) bad++;
+    }
+    quiet = 0;
+    double seconds = wirebytes * 10.0 / BAUD_RATE;
+    int rate = (int)(deliveredBytes / seconds);
+    printf("\ncaps=%d, console output: %d of %d delivered, %d bytes "
+           "in %d wire bytes, %d bytes/s at %d baud", caps, delivered,
+           messages, deliveredBytes, wirebytes, rate, BAUD_RATE);
+    return bad ? 0 : rate;
+}
+
 // File encryption
 
 FILE *file;
 int tally;
 
+uint8_t logfile[0x2000];
+char logtext[0x1000];
+int logpos, checkpos;
+
+void CharToMem(uint8_t c) {
+    if (tally < (int)sizeof(logfile)) logfile[tally++] = c;
+}
+
+int CharFromMem(void) {
+    if (logpos == tally) return -1;
+    return logfile[logpos++];
+}
+
+void CharCheck(uint8_t c) {
+    if (logtext[checkpos++] != c) misordered++;
+}
+
+// Write logtext to a file in logfile[], read it back and compare.
+// Returns the file size, or 0 if it did not read back correctly.
+
+static int LogFile(uint8_t caps) {
+    int len = sizeof(logtext);
+    moleSetCaps(&Alice, caps);
+    Alice.ciphrFn = CharToMem;
+    tally = 0;
+    moleFileNew(&Alice);
+    for (int i = 0; i < len; i += 64) {
+        moleFileOut(&Alice, (uint8_t*)&logtext[i], 64);
+    }
+    moleFileFinal(&Alice);
+    Alice.ciphrFn = AliceCiphertextOutput;
+    int size = tally;
+    logpos = 0;
+    misordered = 0;
+    int ior = moleFileIn(&Bob, CharFromMem, NULL);  // authenticate
+    if (!ior) {
+        logpos = checkpos = 0;
+        ior = moleFileIn(&Bob, CharFromMem, CharCheck);
+    }
+    printf("\ncaps=%d, %d-byte log file: %d bytes, ior=%d", caps, len, size, ior);
+    if (ior || misordered || (checkpos != len)) return 0;
+    return size;
+}
+
 void CharToFile(uint8_t c) {
     tally++;
     fputc(c, file);
@@ -230,6 +468,9 @@ void CharEmit(uint8_t c) {
     fputc(c, stdout);
 }
 
+static void Discard(uint8_t c) {
+}
+
 
 // 32-byte token, 16-byte adminOK password, 16-byte hash
 uint8_t my_keys[] = TESTPASS_1;
@@ -245,21 +486,314 @@ uint8_t * UpdateKeySet(uint8_t* keyset) {
 	return my_keys;
 }
 
+int trngCalls;
+
 int moleTRNG(uint8_t *dest, int length) {
+	trngCalls++;
 	while (length--) *dest++ = rand() & 0xFF;   // DO NOT USE 'rand' in a real application
 	return 0;                                   // Use a TRNG instead
 }
 
-int main() {
-    int tests = 0x3FF;          // enable these tests...
-//    tests = 0x307;
-//    snoopy = 1;               // display the wire traffic
-    error_pacing = 100000000;   // no error injection
+#if (MOLE_TIMING)
+uint32_t moleClock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);  // ns
+}
+#endif
+
+// Pair, exchange messages and re-key, in cooperative mode if defer is set.
+// molePoll does the queued work after each message, as a main loop would.
+// Returns the number of messages delivered, -1 if the pairing failed.
+
+static uint64_t pollMax;                // longest molePoll, ns
+static uint64_t putcMode[2];            // longest molePutc, blocking and coop
+static uint32_t dropped;                // frames dropped behind queued work
+
+static void PollAll(void) {
+    while (Alice.work || Bob.work) {
+        port_ctx *ctx = Alice.work ? &Alice : &Bob;
+        uint64_t nested = putcNested;
+        uint64_t t = Now();
+        int r = molePoll(ctx);
+        t = Now() - t - (putcNested - nested);
+        if (t > pollMax) pollMax = t;
+        if (r && !quiet) printf("\n*** %s polled %d: %s, ", ctx->name, r,
+                                errorCode(r));
+    }
+}
+
+static int CoopRun(int defer, int messages) {
+    uint64_t worst = putcMax;
+    moleDefer(&Alice, defer);
+    moleDefer(&Bob, defer);
+    quiet = 1;
+    putcMax = pollMax = 0;
+    delivered = deliveredInPutc = 0;
+    molePair(&Alice);
+    PollAll();
+    if (!moleAvail(&Alice) || !moleAvail(&Bob)) return -1;
+    for (int i = 0; i < messages; i++) {
+        const uint8_t* s = AliceMessages[i % 4];
+        moleSend(&Alice, s, strlen((char*)s));
+        PollAll();
+        s = BobMessages[i % 4];
+        moleSend(&Bob, s, strlen((char*)s));
+        PollAll();
+    }
+    if (defer) {                        // no molePoll before the next frame:
+        int kept = delivered;           // Bob drops it rather than catch up
+        uint32_t overruns = Bob.stats.overruns;
+        moleSend(&Alice, AliceMessages[0], strlen((char*)AliceMessages[0]));
+        moleSend(&Alice, AliceMessages[1], strlen((char*)AliceMessages[1]));
+        dropped = Bob.stats.overruns - overruns;
+        PollAll();
+        molePair(&Alice);               // Bob's counter is behind
+        PollAll();
+        delivered = kept;
+    }
+    moleReKey(&Alice, my_keys);         // both ends derive the keys again
+    PollAll();
+    molePair(&Alice);
+    PollAll();
+    moleSend(&Alice, (uint8_t*)"Re-keyed", 8);
+    PollAll();
+    quiet = 0;
+    moleDefer(&Alice, 0);
+    moleDefer(&Bob, 0);
+    printf("\n%s: %d messages delivered (%d from molePutc), longest "
+           "molePutc %.1f us, molePoll %.1f us", defer ? "cooperative" :
+           "blocking", delivered, deliveredInPutc, putcMax * 1e-3,
+           pollMax * 1e-3);
+    putcMode[defer != 0] = putcMax;
+    if (putcMax < worst) putcMax = worst;
+    return delivered;
+}
+
+// Resumable send: Alice pumps a message in pieces while Bob sends to her.
+// Returns 0 if okay, otherwise which part failed.
+static int PumpRun(void) {
+    static char m[152];
+    const char *s = (const char *)AliceMessages[2];
+    int sent = 0, left;
+    quiet = 1;
+    delivered = 0;
+    if (moleSendBegin(&Alice, (const uint8_t *)s, strlen(s))
+     || (moleSendBegin(&Alice, (const uint8_t *)s, 1) != MOLE_ERROR_MSG_NOT_SENT)) {
+        return 1;
+    }
+    do {
+        uint32_t out = Alice.stats.bytesOut;
+        moleSend(&Bob, BobMessages[sent % 4], strlen((char*)BobMessages[sent % 4]));
+        sent++;
+        if (moleSendPump(&Alice, 16, &left)) return 1; // may go over by 72
+        if ((Alice.stats.bytesOut - out) > (16 + 72)) return 1;
+    } while (left);
+    if (TestLast(s) || (delivered != (sent + 1)) || (sent < 4)) return 1;
+    for (int i = 0; i < 150; i++) m[i] = "pump "[i % 5]; // compresses
+    delivered = 0;
+    moleSendBegin(&Alice, (uint8_t *)m, 150);
+    moleSendPump(&Alice, 1, NULL);
+    moleSendPump(&Alice, 1, NULL);      // mid-frame
+    molePair(&Alice);                   // cuts it off
+    moleSendPump(&Alice, 1, &left);
+    if (!moleAvail(&Alice) || delivered || !left) return 2;
+    moleSendPump(&Alice, 0, &left);
+    if (left || TestLast(m) || (delivered != 1)) return 2;
+    moleSendBegin(&Alice, (const uint8_t *)s, strlen(s));
+    moleSendPump(&Alice, 1, NULL);
+    moleSend(&Alice, (uint8_t *)"After", 5); // sends the queued one first
+    moleSendPump(&Alice, 0, &left);
+    if (TestLast("After") || (delivered != 3) || left) return 3;
+    quiet = 0;
+    printf("\n%d-byte message sent in %d pieces while Bob sent %d messages",
+           (int)strlen(s), sent, sent);
+    return 0;
+}
+
+// Bob's ring of 2 receive buffers: the app holds messages while more arrive.
+// Returns 0 if okay, otherwise which part failed.
+static int RingRun(void) {
+    const uint8_t *held[2];
+    int len[2];
+    uint32_t overruns = Bob.stats.overruns;
+    quiet = 1;
+    holding = 1;
+    for (int i = 0; i < 2; i++) {
+        len[i] = strlen((char*)AliceMessages[i]);
+        moleSend(&Alice, AliceMessages[i], len[i]);
+        held[i] = lastSrc;
+    }
+    if ((held[0] == held[1]) || memcmp(held[0], AliceMessages[0], len[0])
+     || memcmp(held[1], AliceMessages[1], len[1])) return 1;
+    lastSrc = NULL;
+    moleSend(&Alice, AliceMessages[2], strlen((char*)AliceMessages[2]));
+    if (lastSrc || (Bob.stats.overruns != (overruns + 1))) return 2;
+    if (moleRelease(&Bob, held[0]) || !moleRelease(&Bob, held[0])) return 3;
+    for (int i = 0; i < len[0]; i++) if (held[0][i]) return 3; // wiped
+    moleSend(&Alice, AliceMessages[3], strlen((char*)AliceMessages[3]));
+    if ((lastSrc == NULL) || TestLast((char*)AliceMessages[3])) return 3;
+    moleRelease(&Bob, lastSrc);
+    moleRelease(&Bob, held[1]);
+    holding = 0;
+    quiet = 0;
+    printf("\n2 messages held while the next was received, 1 overrun");
+    return 0;
+}
+
+// Alice receives into app buffers, her own rxbuf only holds 2 blocks.
+// Returns 0 if okay, otherwise which part failed.
+
+static uint8_t appBuf[2][3 << 6];
+static int appNext, appCalls, appRefuse;
+
+static uint8_t *AppBuffer(uint16_t size) {
+    if (appRefuse || (size != sizeof(appBuf[0]))) return NULL;
+    appCalls++;
+    appNext ^= 1;
+    return appBuf[appNext];
+}
+
+static int RxIntoRun(void) {
+    const uint8_t *m = BobMessages[8]; // too long for the 2-block rxbuf
+    int len = strlen((char*)m);
+    moleSetCaps(&Alice, 0);             // no compression
+    moleSetCaps(&Bob, 0);
+    quiet = 1;
+    molePair(&Alice);
+    int calls = appCalls;
+    moleSend(&Bob, m, len);
+    uint8_t *b = appBuf[appNext];
+    if ((lastSrc != &b[1]) || memcmp(&b[1], m, len)) return 1;
+    for (int i = len + 1; i < (int)sizeof(appBuf[0]); i++) {
+        if (b[i]) return 1;             // padding and HMAC wiped
+    }
+    moleSend(&Bob, BobMessages[0], strlen((char*)BobMessages[0]));
+    if ((lastSrc != &appBuf[appNext][1]) || (lastSrc == &b[1])
+     || memcmp(&b[1], m, len) || (appCalls != (calls + 2))) return 2;
+    appRefuse = 1;
+    moleSend(&Bob, (uint8_t*)"Staged", 6);
+    appRefuse = 0;
+    if (TestLast("Staged") || (lastSrc == &appBuf[0][1])
+     || (lastSrc == &appBuf[1][1])) return 3;
+    quiet = 0;
+    printf("\n%d-byte message received into an app buffer, "
+           "2-block rxbuf", len);
+    return 0;
+}
+
+// Alice sends a header, samples and a trailer as one message, split in
+// places that do and do not fall on block boundaries.
+// Returns 0 if okay, otherwise which part failed.
+static int SendvRun(void) {
+    static const int cuts[][2] = {{12, 60}, {15, 15}, {0, 47}, {31, 31}, {47, 0}};
+    const char *m = (const char *)AliceMessages[2];
+    int len = strlen(m);
+    quiet = 1;
+    for (int i = 0; i < 5; i++) {
+        int a = cuts[i][0];
+        int b = a + cuts[i][1];
+        struct mole_iov iov[3] = {{(const uint8_t *)m, a},
+            {(const uint8_t *)&m[a], b - a}, {(const uint8_t *)&m[b], len - b}};
+        delivered = 0;
+        if (moleSendv(&Alice, iov, 3) || (delivered != 1) || TestLast(m)) {
+            return 1;
+        }
+    }
+    struct mole_iov none = {NULL, 0}, bad = {(const uint8_t *)m, -1};
+    if (moleSendv(&Alice, &none, 1) || (delivered != 2) || TestLast("")) {
+        return 2;
+    }
+    if (moleSendv(&Alice, &bad, 1) != MOLE_ERROR_INVALID_LENGTH) return 3;
+    quiet = 0;
+    printf("\n%d-byte message sent in 3 pieces, split 5 ways", len);
+    return 0;
+}
+
+// Alice coalesces short readings, sent when the batch is full, by moleFlush,
+// by the timer and before a long message. Returns 0 if okay, otherwise
+// which part failed.
+
+static int Readings(int n, uint8_t caps) {
+    const char *m = "p=1013.2";
+    moleSetCaps(&Alice, caps);
+    moleSetCaps(&Bob, caps);
+    molePair(&Alice);
+    delivered = wirebytes = 0;
+    for (int i = 0; i < n; i++) moleSend(&Alice, (const uint8_t *)m, 8);
+    moleFlush(&Alice);
+    return (delivered == n) ? wirebytes : 0;
+}
+
+static int BatchRun(void) {
+    static const char *readings[] = {"t=21.5", "h=40", "p=1013.2", "", "v=3.31"};
+    quiet = 1;
+    int plain = Readings(100, 0);
+    int coalesced = Readings(100, MOLE_CAP_BATCH);
+    if (!plain || !coalesced || (coalesced >= plain)) return 1;
+    uint32_t frames = Alice.stats.framesOut;
+    int bytes = 0;
+    delivered = deliveredBytes = 0;
+    for (int i = 0; i < 5; i++) {
+        int len = strlen(readings[i]);
+        moleSend(&Alice, (const uint8_t *)readings[i], len);
+        bytes += len;
+    }
+    if (delivered || (Alice.stats.framesOut != frames)) return 1;
+    moleFlush(&Alice);
+    if ((delivered != 5) || (deliveredBytes != bytes) || TestLast("v=3.31")
+     || (Alice.stats.framesOut != (frames + 1))) return 1;
+    delivered = 0;
+    for (int i = 0; i < 30; i++) moleSend(&Alice, (const uint8_t *)"h=41", 4);
+    if (delivered != 24) return 2;      // 120-byte batches of 5-byte records
+    for (int i = 1; i < 4; i++) {
+        if (!moleBatchTick(&Alice) || (delivered != 24)) return 3;
+    }
+    if (moleBatchTick(&Alice) || (delivered != 30)) return 3;
+    moleSend(&Alice, (const uint8_t *)"h=42", 4);
+    moleSend(&Alice, AliceMessages[0], strlen((char *)AliceMessages[0]));
+    if ((delivered != 32) || TestLast((char *)AliceMessages[0])) return 4;
+    quiet = 0;
+    printf("\n100 8-byte readings: %d wire bytes one by one, %d coalesced",
+           plain, coalesced);
+    return 0;
+}
+
+// Add Alice and Bob with the features a run needs, keyed but not paired.
+// The main run uses plain ports, each feature test sets up its own.
+
+#define USE_ARQ     1
+#define USE_FEC     2
+#define USE_LZ      4
+#define USE_RING    8                   // Bob receives into a ring of 2
+#define USE_RXINTO 16                   // Alice receives into app buffers
+#define USE_BATCH  32
+
+static int Ports(int features) {
     moleNoPorts();
-    int ior = moleAddPort(&Alice, AliceBoiler, MY_PROTOCOL, "ALICE", 3,
+    int ior = moleAddPort(&Alice, AliceBoiler, MY_PROTOCOL, "ALICE",
+        (features & USE_RXINTO) ? 2 : 3,
         BoilerHandlerA, PlaintextHandler, AliceCiphertextOutput, UpdateKeySet);
     if (!ior) ior = moleAddPort(&Bob, BobBoiler, MY_PROTOCOL, "BOB", 3,
         BoilerHandlerB, PlaintextHandler, BobCiphertextOutput, UpdateKeySet);
+    if (features & USE_ARQ) {
+        if (!ior) ior = moleArqInit(&Alice, 8);
+        if (!ior) ior = moleArqInit(&Bob, 8);
+    }
+    if (features & USE_FEC) {
+        if (!ior) ior = moleFecInit(&Alice, 64, 8);
+        if (!ior) ior = moleFecInit(&Bob, 64, 8);
+    }
+    if (features & USE_LZ) {
+        if (!ior) ior = moleLzInit(&Alice);
+        if (!ior) ior = moleLzInit(&Bob);
+    }
+    if ((features & USE_RING) && !ior) ior = moleRxRing(&Bob, 2);
+    if ((features & USE_RXINTO) && !ior) ior = moleRxInto(&Alice, AppBuffer, 3);
+    if (features & USE_BATCH) {
+        if (!ior) ior = moleBatchInit(&Alice, 120, 4);
+        if (!ior) ior = moleBatchInit(&Bob, 0, 0); // only receives batches
+    }
     if (ior) {
         printf("\nError %d: %s, ", ior, errorCode(ior));
         if (ior == MOLE_ERROR_OUT_OF_MEMORY) {
@@ -267,12 +801,22 @@ int main() {
         }
         return ior;
     }
+    moleNewKeys(&Alice, my_keys);
+    moleNewKeys(&Bob, my_keys);
+    return 0;
+}
+
+int main() {
+    int tests = 0x3FFFFFF;         // enable these tests...
+//    tests = 0x307;
+//    snoopy = 1;               // display the wire traffic
+    error_pacing = 100000000;   // no error injection
+    int ior = Ports(0);
+    if (ior) return ior;
     printf("Static context RAM usage: %d bytes per port\n", moleRAMused(2)/2);
     printf("context_memory has %d unused bytes (%d unused longs)",
         moleRAMunused(), moleRAMunused()/4);
     printf(", see MOLE_ALLOC_MEM_UINT32S\n");
-    moleNewKeys(&Alice, my_keys);
-    moleNewKeys(&Bob, my_keys);
     Alice.hashCounterTX = 0x3412; // ensure that re-pair resets these
     Alice.hashCounterRX = 0x341200;
     Bob.hashCounterTX = 0x785600;
@@ -317,6 +861,124 @@ int main() {
         if (i) printf("\nError %d: %s, ", i, errorCode(i));
         if (0 == PairAlice()) return 0x1080;
     }
+    if (tests & 0x400) {
+        printf("\n\nResync under injected errors ===============");
+        for (int pacing = 4000; pacing >= 500; pacing /= 2) {
+            ErrorRun(0, pacing, 400);
+            int plainRepairs = repairs;
+            ErrorRun(MOLE_CAP_RESYNC, pacing, 400);
+            if (repairs >= plainRepairs) return 0x1401;
+        }
+        ErrorRun(0, 100000000, 400);    // leave the ports paired, no caps
+        if (0 == PairAlice()) return 0x1402;
+    }
+    if (tests & 0x800) {
+        printf("\n\nSelective repeat under injected errors =====");
+        if ((ior = Ports(USE_ARQ))) return ior;
+        for (int pacing = 12500; pacing >= 500; pacing /= 5) {
+            ErrorRun(MOLE_CAP_RESYNC, pacing, 400);
+            if (ArqRun(MOLE_CAP_RESYNC | MOLE_CAP_ARQ, pacing, 400) != 400) {
+                return 0x1801;
+            }
+        }
+        if ((ior = Ports(0))) return ior;
+        ErrorRun(0, 100000000, 400);
+        if (0 == PairAlice()) return 0x1802;
+    }
+    if (tests & 0x1000) {
+        printf("\n\nForward error correction under bit errors ====");
+        const double rates[] = {1e-4, 3e-4, 1e-3, 3e-3};
+        if ((ior = Ports(USE_FEC))) return ior;
+        for (i = 0; i < 4; i++) {
+            ber = rates[i];
+            int plain = ErrorRun(MOLE_CAP_RESYNC, 100000000, 400);
+            Bob.fec->corrected = Bob.fec->failed = 0;
+            int coded = ErrorRun(MOLE_CAP_RESYNC | MOLE_CAP_FEC, 100000000, 400);
+            printf(", %d bytes corrected, %d codewords failed",
+                   Bob.fec->corrected, Bob.fec->failed);
+            if (coded < plain) return 0x2001;
+        }
+        ber = 0;
+        if ((ior = Ports(0))) return ior;
+        ErrorRun(0, 100000000, 400);
+        if (0 == PairAlice()) return 0x2002;
+    }
+    if (tests & 0x2000) {
+        printf("\n\nCompression of console output ==============");
+        if ((ior = Ports(USE_LZ))) return ior;
+        int plain = LogRun(0, 400);
+        Alice.lz->plain = Alice.lz->packed = 0;
+        int packed = LogRun(MOLE_CAP_LZ, 400);
+        printf(", %d bytes compressed to %d", Alice.lz->plain,
+               Alice.lz->packed);
+        if ((plain == 0) || (packed <= plain)) return 0x4001;
+        int n = LogLines(logtext, 0, 1);    // fill logtext with whole lines
+        for (i = 1; (n + 64) < (int)sizeof(logtext); i++) {
+            n += LogLines(&logtext[n], i, 1);
+        }
+        memset(&logtext[n], ' ', sizeof(logtext) - n);
+        plain = LogFile(0);
+        packed = LogFile(MOLE_CAP_LZ);
+        if ((plain == 0) || (packed == 0) || (packed >= plain)) return 0x4002;
+        if ((ior = Ports(0))) return ior;
+        ErrorRun(0, 100000000, 400);
+        if (0 == PairAlice()) return 0x4003;
+    }
+    if (tests & 0x4000) {
+        printf("\n\nIV generation ==============================");
+        static uint64_t counters[1000];
+        int pairings = sizeof(counters) / sizeof(counters[0]);
+        trngCalls = 0;
+        for (i = 0; i < pairings; i++) {
+            molePair(&Alice);
+            if (!moleAvail(&Alice) || !moleAvail(&Bob)) return 0x5001;
+            counters[i] = Alice.hashCounterRX;  // from Alice's secret IV
+        }
+        printf("\n%d pairings (%d IVs) called moleTRNG %d times",
+               pairings, 2 * pairings, trngCalls);
+        if (trngCalls > (2 * pairings / MOLE_DRBG_RESEED + 1)) return 0x5002;
+        for (i = 0; i < pairings; i++) {
+            for (j = i + 1; j < pairings; j++) {
+                if (counters[i] == counters[j]) return 0x5003;
+            }
+        }
+        trngCalls = 0;
+        moleReseed();
+        molePair(&Alice);
+        if (trngCalls != 1) return 0x5004;
+    }
+    if (tests & 0x8000) {
+        printf("\n\nLink statistics ============================");
+        static char text[1024];
+        mole_stats a, b, before, beforeA;
+        moleStats(&Alice, &beforeA);    // counters include the file tests
+        moleStats(&Bob, &before);
+        molePair(&Alice);
+        moleSend(&Alice, (uint8_t*)"Hello World", 11);
+        moleStats(&Alice, &a);
+        moleStats(&Bob, &b);
+        if (((a.bytesOut - beforeA.bytesOut) != (b.bytesIn - before.bytesIn))
+         || ((b.bytesOut - before.bytesOut) != (a.bytesIn - beforeA.bytesIn))) {
+            return 0x8001;
+        }
+        if (b.framesIn != (before.framesIn + 2)) return 0x8002; // IV, message
+        before = b;
+        error_pacing = 20;              // corrupt the next message
+        errorpos = 0;
+        moleSend(&Alice, (uint8_t*)"Hello World", 11);
+        error_pacing = 100000000;
+        moleStats(&Bob, &b);
+        if ((b.badHMAC == before.badHMAC) || (b.pairings == before.pairings)) {
+            return 0x8002;
+        }
+        int n = moleStatsText(&b, Bob.name, text, sizeof(text));
+        printf("\n%s", text);
+        if (!n || (strstr(text, "mole_bad_hmac{port=\"BOB\"} ") == NULL)) {
+            return 0x8003;
+        }
+        n = moleStatsText(&b, Bob.name, text, 40);  // room for one line
+        if ((n == 0) || (n >= 40) || (text[n - 1] != '\n')) return 0x8003;
+    }
     printf("\nAlice sent %d bytes", Alice.counter);
     printf("\nBob sent %d bytes", Bob.counter);
     if (tests & 0x100) {
@@ -339,6 +1001,7 @@ int main() {
         }
         moleFileFinal(&Alice);
         fclose(file);
+        Alice.ciphrFn = AliceCiphertextOutput;
         printf("0x%x bytes written\n", tally);
     }
     if (tests & 0x200) {
@@ -354,5 +1017,164 @@ int main() {
         printf("\n0x%x bytes read, ior=%d\n", tally, ior);
         if (ior) return 0x1200;
     }
+#if (MOLE_TIMING)
+    if (tests & 0x10000) {
+        printf("\nStage latency in ns ========================");
+        static char text[16384];
+        quiet = 1;                      // the feature tests re-made the ports
+        moleSend(&Bob, BobMessages[0], strlen((char*)BobMessages[0]));
+        quiet = 0;
+        moleHistText(&Alice, text, sizeof(text));
+        printf("\n%s", text);
+        moleHistText(&Bob, text, sizeof(text));
+        printf("%s", text);
+        const int used[] = {MOLE_STAGE_FRAME, MOLE_STAGE_HMAC,
+            MOLE_STAGE_DELIVER, MOLE_STAGE_SEND, MOLE_STAGE_IV, MOLE_STAGE_KDF};
+        for (i = 0; i < (int)(sizeof(used) / sizeof(used[0])); i++) {
+            const uint32_t *h = moleHistogram(&Bob, used[i]);
+            uint32_t n = 0;
+            for (j = 0; j < MOLE_HIST_BUCKETS; j++) n += h[j];
+            if (n == 0) return 0x10001;
+        }
+        if (moleHistogram(&Bob, MOLE_STAGES) != NULL) return 0x10002;
+        if (!strstr(text, "stage=\"file_in\",le=\"+Inf\"} ")) return 0x10003;
+    }
+#endif
+#if (MOLE_TRACE)
+    if (tests & 0x20000) {
+        printf("\nTrace rings written to trace.bin, see tracedump");
+        uint32_t head = Alice.trace.head;
+        molePair(&Alice);
+        if (Alice.trace.rec[head % MOLE_TRACE_RECORDS].event != MOLE_TR_PAIR) {
+            return 0x20001;
+        }
+        int found = 0;
+        for (i = 0; i < MOLE_TRACE_RECORDS; i++) {
+            if (Bob.trace.rec[i].event == MOLE_TR_RX_IV) found++;
+        }
+        if (!found || (Bob.trace.rec[0].port != 1)) return 0x20002;
+        file = fopen("trace.bin", "wb");
+        if (file == NULL) return 0x20003;
+        tally = 0;
+        i = moleTraceDump(&Alice, CharToFile);
+        i += moleTraceDump(&Bob, CharToFile);
+        fclose(file);
+        if (i != 2 * MOLE_TRACE_RECORDS) return 0x20003;
+    }
+#endif
+    if (tests & 0x40000) {
+        printf("\nBob's ciphertext written to capture.bin, keys to capture.key, "
+               "see mreplay");
+        if (cap_open(&cap, "capture.bin")) return 0x40001;
+        cap_name(&cap, 1, Bob.name);
+        cap_setup setup = {MY_PROTOCOL, Bob.caps, Bob.rBlocks,
+            Bob.arq ? Bob.arq->slots : 0, Bob.fec ? Bob.fec->txData : 0,
+            Bob.fec ? Bob.fec->tx.nparity : 0, Bob.lz != NULL};
+        cap_port(&cap, 1, &setup);
+        molePair(&Alice);
+        delivered = 0;
+        for (i = 0; i < 8; i++) {
+            const uint8_t* s = AliceMessages[i % 4];
+            moleSend(&Alice, s, strlen((char*)s));
+        }
+        cap_close(&cap);
+        if (delivered != 8) return 0x40002;
+        file = fopen("capture.key", "wb");
+        if (file == NULL) return 0x40001;
+        i = fwrite(my_keys, 1, MOLE_PASSCODE_LENGTH, file);
+        fclose(file);
+        if (i != MOLE_PASSCODE_LENGTH) return 0x40001;
+    }
+    if (tests & 0x80000) {
+        printf("\n\nIdle-time precomputation ===================");
+        Alice.ciphrFn = Discard;        // a file keeps the HMACs busy
+        moleFileNew(&Alice);
+        for (i = 0; i < 20; i++) {
+            if (molePrecompute(&Alice, 100)) return 0x80003;
+            moleFileOut(&Alice, (uint8_t*)"ABCDEFGHIJKLMNOP", 16);
+        }
+        moleFileFinal(&Alice);
+        Alice.ciphrFn = AliceCiphertextOutput;
+        quiet = 1;
+        molePair(&Alice);
+        mole_stats before, b;
+        moleStats(&Bob, &before);
+        delivered = 0;
+        int steps = 0;
+        for (i = 0; i < 40; i++) {
+            steps += molePrecompute(&Alice, 100);
+            steps += molePrecompute(&Bob, i & 7);   // partly done
+            if (molePrecompute(&Alice, 100)) return 0x80001;
+            const uint8_t* s = AliceMessages[i % 4];
+            moleSend(&Alice, s, strlen((char*)s));
+            s = BobMessages[i % 4];
+            moleSend(&Bob, s, strlen((char*)s));
+            if (i == 20) moleNewKeys(&Alice, my_keys);  // drops the primes
+        }
+        quiet = 0;
+        moleStats(&Bob, &b);
+        printf("\n%d precomputation steps, %d messages delivered", steps,
+               delivered);
+        if ((delivered != 80) || (b.badHMAC != before.badHMAC)) return 0x80002;
+    }
+    if (tests & 0x100000) {
+        printf("\n\nCooperative mode ===========================");
+        mole_stats a, b;
+        moleStats(&Alice, &a);
+        moleStats(&Bob, &b);
+        if (CoopRun(0, 20) != 41) return 0x100001;
+        if ((CoopRun(1, 20) != 41) || deliveredInPutc) return 0x100002;
+        if (TestLast("Re-keyed") || (Alice.stats.rekeys != (a.rekeys + 2))
+         || (Bob.stats.rekeys != (b.rekeys + 2))) return 0x100003;
+        if (putcMode[1] >= putcMode[0]) return 0x100004;
+        if (dropped != 1) return 0x100005;
+    }
+    if (tests & 0x200000) {
+        printf("\n\nResumable send =============================");
+        int r = PumpRun();
+        quiet = 0;
+        if (r) return 0x200000 + r;
+    }
+    if (tests & 0x400000) {
+        printf("\n\nReceive buffer ring ========================");
+        if ((ior = Ports(USE_RING))) return ior;
+        molePair(&Alice);
+        int r = RingRun();
+        quiet = 0;
+        holding = 0;
+        if (r) return 0x400000 + r;
+        if ((ior = Ports(0))) return ior;
+        molePair(&Alice);
+    }
+    if (tests & 0x800000) {
+        printf("\n\nReceive into app buffers ===================");
+        if ((ior = Ports(USE_RXINTO))) return ior;
+        molePair(&Alice);
+        int r = RxIntoRun();
+        quiet = 0;
+        if (r) return 0x800000 + r;
+        if ((ior = Ports(0))) return ior;
+        molePair(&Alice);
+    }
+    if (tests & 0x1000000) {
+        printf("\n\nScatter-gather send =========================");
+        int r = SendvRun();
+        quiet = 0;
+        if (r) return 0x1000000 + r;
+    }
+    if (tests & 0x2000000) {
+        printf("\n\nCoalescing of small messages ===============");
+        if ((ior = Ports(USE_BATCH))) return ior;
+        molePair(&Alice);
+        int r = BatchRun();
+        quiet = 0;
+        if (r) return 0x2000000 + r;
+        if ((ior = Ports(0))) return ior;
+        molePair(&Alice);
+    }
+    printf("\nLongest molePutc call: %.1f us", putcMax * 1e-3);
+    if (tests & 0x100000) printf(", blocking %.1f us, cooperative %.1f us",
+                                 putcMode[0] * 1e-3, putcMode[1] * 1e-3);
+    printf("\n");
     return 0;
 }
@@ -0,0 +1,167 @@
+/*************************************************************************
+ * Poly1305 test vectors from RFC 8439, sections 2.5.2 and A.3, fed to
+ * the byte-wise and the block-wise API, and a check of the mole MAC slot
+ * (p1305_hmac_*) against its definition.
+ *************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/poly1305.h"
+#include "../src/xchacha.h"
+
+typedef struct {
+    const char *key;        // hex, r then s
+    const char *msg;        // hex
+    const char *tag;        // hex
+} vector;
+
+static const vector vectors[] = {
+    {   // 2.5.2
+        "85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b",
+        "43727970746f6772617068696320466f72756d2052657365617263682047726f7570",
+        "a8061dc1305136c6c22b8baf0c0127a9"},
+    {   // A.3 #1
+        "0000000000000000000000000000000000000000000000000000000000000000",
+        "0000000000000000000000000000000000000000000000000000000000000000"
+        "0000000000000000000000000000000000000000000000000000000000000000",
+        "00000000000000000000000000000000"},
+    {   // A.3 #5, h reaches p
+        "0200000000000000000000000000000000000000000000000000000000000000",
+        "ffffffffffffffffffffffffffffffff",
+        "03000000000000000000000000000000"},
+    {   // A.3 #6, s overflows
+        "02000000000000000000000000000000ffffffffffffffffffffffffffffffff",
+        "02000000000000000000000000000000",
+        "03000000000000000000000000000000"},
+    {   // A.3 #7
+        "0100000000000000000000000000000000000000000000000000000000000000",
+        "ffffffffffffffffffffffffffffffff"
+        "f0ffffffffffffffffffffffffffffff"
+        "11000000000000000000000000000000",
+        "05000000000000000000000000000000"},
+    {   // A.3 #8
+        "0100000000000000000000000000000000000000000000000000000000000000",
+        "ffffffffffffffffffffffffffffffff"
+        "fbfefefefefefefefefefefefefefefe"
+        "01010101010101010101010101010101",
+        "00000000000000000000000000000000"},
+    {   // A.3 #9
+        "0200000000000000000000000000000000000000000000000000000000000000",
+        "fdffffffffffffffffffffffffffffff",
+        "faffffffffffffffffffffffffffffff"},
+    {   // A.3 #10
+        "0100000000000000040000000000000000000000000000000000000000000000",
+        "e33594d7505e43b900000000000000003394d7505e4379cd0100000000000000"
+        "0000000000000000000000000000000001000000000000000000000000000000",
+        "14000000000000005500000000000000"},
+    {   // A.3 #11
+        "0100000000000000040000000000000000000000000000000000000000000000",
+        "e33594d7505e43b900000000000000003394d7505e4379cd0100000000000000"
+        "00000000000000000000000000000000",
+        "13000000000000000000000000000000"},
+};
+
+static int Hex(uint8_t *dest, const char *s) {
+    int n = 0;
+    unsigned x;
+    while (s[0] && s[1] && (sscanf(s, "%2x", &x) == 1)) {
+        dest[n++] = x;
+        s += 2;
+    }
+    return n;
+}
+
+static void Dump(const char *name, const uint8_t *p, int len) {
+    printf("%s ", name);
+    while (len--) printf("%02x", *p++);
+    printf("\n");
+}
+
+static int Check(int i) {
+    uint8_t key[POLY1305_KEYBYTES], msg[128], tag[POLY1305_TAGBYTES];
+    uint8_t out[POLY1305_TAGBYTES];
+    poly1305_ctx ctx;
+    Hex(key, vectors[i].key);
+    int len = Hex(msg, vectors[i].msg);
+    Hex(tag, vectors[i].tag);
+    poly1305_init(&ctx, key);           // byte by byte
+    for (int j = 0; j < len; j++) poly1305_putc(&ctx, msg[j]);
+    poly1305_final(&ctx, out);
+    if (memcmp(out, tag, sizeof(tag))) {
+        printf("Vector %d failed with poly1305_putc\n", i);
+        Dump("expected", tag, sizeof(tag));
+        Dump("got     ", out, sizeof(out));
+        return 1;
+    }
+    for (int split = 0; split <= len; split++) {
+        poly1305_init(&ctx, key);       // in two pieces
+        poly1305_puts(&ctx, msg, split);
+        poly1305_puts(&ctx, &msg[split], len - split);
+        poly1305_final(&ctx, out);
+        if (memcmp(out, tag, sizeof(tag))) {
+            printf("Vector %d failed with poly1305_puts split at %d\n", i, split);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The MAC slot's one-time key is HChaCha20(key, counter)
+static int CheckSlot(void) {
+    uint8_t key[32], in[16], otk[32], msg[100], expect[16], out[16];
+    poly1305_ctx ctx;
+    for (int i = 0; i < 32; i++) key[i] = i;
+    for (int i = 0; i < 100; i++) msg[i] = 3 * i;
+    uint64_t ctr = 0x0123456789ABCDEFULL;
+    memset(in, 0, sizeof(in));
+    for (int i = 0; i < 8; i++) in[i] = (uint8_t)(ctr >> (8 * i));
+    xchacha_hchacha20(otk, in, key);
+    poly1305_init(&ctx, otk);
+    poly1305_puts(&ctx, msg, sizeof(msg));
+    poly1305_final(&ctx, expect);
+    for (int hsize = 1; hsize <= 16; hsize++) {
+        if (p1305_hmac_init(&ctx, key, hsize, ctr) != hsize) return 1;
+        for (int i = 0; i < (int)sizeof(msg); i++) p1305_hmac_putc(&ctx, msg[i]);
+        if (p1305_hmac_final(&ctx, out) != hsize) return 1;
+        if (memcmp(out, expect, hsize)) return 1;
+    }
+    if (p1305_hmac_init(&ctx, key, 17, ctr)) return 1;      // too long
+    p1305_hmac_init(&ctx, key, 16, ctr + 1);                // new counter,
+    p1305_hmac_putc(&ctx, 0);                               // new key
+    p1305_hmac_final(&ctx, out);
+    p1305_hmac_init(&ctx, key, 16, ctr);
+    p1305_hmac_putc(&ctx, 0);
+    p1305_hmac_final(&ctx, expect);
+    if (!memcmp(out, expect, 16)) return 1;
+    in[15] = 1;                         // counter 0 keys from bytes 1 to 15
+    for (int i = 0; i < 15; i++) in[i] = msg[i + 1];
+    xchacha_hchacha20(otk, in, key);
+    poly1305_init(&ctx, otk);
+    poly1305_puts(&ctx, msg, sizeof(msg));
+    poly1305_final(&ctx, expect);
+    p1305_hmac_init(&ctx, key, 16, 0);
+    for (int i = 0; i < (int)sizeof(msg); i++) p1305_hmac_putc(&ctx, msg[i]);
+    p1305_hmac_final(&ctx, out);
+    if (memcmp(out, expect, 16)) return 1;
+    msg[15] ^= 1;                       // another IV, another key
+    p1305_hmac_init(&ctx, key, 16, 0);
+    for (int i = 0; i < (int)sizeof(msg); i++) p1305_hmac_putc(&ctx, msg[i]);
+    p1305_hmac_final(&ctx, out);
+    return !memcmp(out, expect, 16);
+}
+
+int main(void) {
+    int fails = 0;
+    int n = sizeof(vectors) / sizeof(vectors[0]);
+    for (int i = 0; i < n; i++) fails += Check(i);
+    if (CheckSlot()) {
+        printf("p1305_hmac_* does not match its definition\n");
+        fails++;
+    }
+    if (fails) {
+        printf("%d Poly1305 tests failed\n", fails);
+        return 1;
+    }
+    printf("%d Poly1305 vectors ok\n", n);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*************************************************************************
+ * This is a simple program to test the Reed-Solomon codec: a known
+ * encoding, then random codewords with up to t and then t+1 errors.
+ *************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/reedsolomon.h"
+
+/** Known answer from the Wikiversity article "Reed-Solomon codes for coders",
+ * which uses the same field (0x11D) and generator (fcr = 0).
+ * @returns 0 on success, -1 on failure
+ */
+int check_known(void) {
+    rs_ctx ctx;
+    const char *msg = "hello world";
+    const uint8_t expected[10] = {
+        0xED, 0x25, 0x54, 0xC4, 0xFD, 0xFD, 0x89, 0xF3, 0xA8, 0xAA};
+    rs_init(&ctx, 10);
+    for (int i = 0; i < (int)strlen(msg); i++) rs_putc(&ctx, msg[i]);
+    if (memcmp(ctx.reg, expected, 10)) {
+        printf("Known-answer parity failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/** Encode random data, corrupt `errors` random bytes and decode.
+ * @returns decoder result, or -2 if it claims success but the data is wrong
+ */
+int check_random(int nparity, int n, int errors) {
+    rs_ctx ctx;
+    uint8_t cw[255], copy[255];
+    rs_init(&ctx, nparity);
+    for (int i = 0; i < (n - nparity); i++) {
+        cw[i] = rand();
+        rs_putc(&ctx, cw[i]);
+    }
+    memcpy(&cw[n - nparity], ctx.reg, nparity);
+    memcpy(copy, cw, n);
+    for (int e = 0; e < errors; ) {
+        int p = rand() % n;
+        if (cw[p] != copy[p]) continue;     // distinct positions
+        cw[p] ^= 1 + (rand() % 255);
+        e++;
+    }
+    int r = rs_decode(&ctx, cw, n);
+    if ((r >= 0) && memcmp(cw, copy, n)) return -2;
+    return r;
+}
+
+int main(void) {
+    int fails = check_known();
+    int detected = 0, trials = 0;
+    srand(1);
+    for (int np = 2; np <= RS_MAX_PARITY; np += 2) {
+        for (int n = np + 1; n <= 255; n += 37) {
+            for (int e = 0; e <= (np / 2); e++) {
+                if (check_random(np, n, e) != e) {
+                    printf("Failed to correct %d errors, n=%d, parity=%d\n",
+                           e, n, np);
+                    fails++;
+                }
+            }
+            if ((np / 2 + 1) <= n) {        // beyond t: usually detected
+                trials++;
+                if (check_random(np, n, np / 2 + 1) == -1) detected++;
+            }
+        }
+    }
+    printf("%d of %d codewords with t+1 errors were flagged uncorrectable\n",
+           detected, trials);
+    if (fails) return 1;
+    printf("Reed-Solomon tests passed\n");
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*************************************************************************
+ * Decode trace rings written by moleTraceDump into the text that mole's
+ * printf tracing used to produce. Usage: tracedump file [-c]
+ * -c puts the port number and TX counter of each event in front of it.
+ *************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/moletrace.h"
+
+#define X(id, format) format,
+static const char *formats[] = {MOLE_TRACE_EVENTS(X)};
+#undef X
+
+static FILE *file;
+
+static uint32_t In(int bytes) {
+    uint32_t x = 0;
+    for (int i = 0; i < bytes; i++) {
+        int c = fgetc(file);
+        if (c == EOF) return 0;
+        x |= (uint32_t)c << (8 * i);
+    }
+    return x;
+}
+
+// Print a format string: %s is the port name, other conversions take args
+static void Format(const char *f, const char *name, const uint32_t *arg) {
+    int k = 0;
+    while (*f) {
+        if (*f != '%') {
+            putchar(*f++);
+            continue;
+        }
+        char spec[8];
+        int n = 0;
+        do spec[n++] = *f++; while (*f && !strchr("sdxX", *f) && (n < 6));
+        spec[n++] = *f++;
+        spec[n] = 0;
+        if (spec[n - 1] == 's') printf("%s", name);
+        else if (k < 2) printf(spec, arg[k++]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Usage: tracedump file [-c]\n");
+        return 1;
+    }
+    file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        printf("Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    int counters = (argc > 2) && !strcmp(argv[2], "-c");
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        char name[64];
+        int n = 0;
+        while ((c != EOF) && c) {
+            if (n < (int)sizeof(name) - 1) name[n++] = c;
+            c = fgetc(file);
+        }
+        name[n] = 0;
+        uint32_t head = In(4);
+        uint32_t count = In(2);
+        printf("==== %s: %u events, %u shown ====", name, head, count);
+        int data = 0;                   // bytes of the dump being printed
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t event = In(1);
+            uint8_t port = In(1);
+            uint16_t counter = In(2);
+            uint32_t arg[2];
+            arg[0] = In(4);
+            arg[1] = In(4);
+            if (event == MOLE_TR_DATA) {
+                for (int j = 0; j < 8; j++) {
+                    if ((data++ % 32) == 0) printf("\n___");
+                    printf("%02X ", (arg[j / 4] >> (8 * (j % 4))) & 0xFF);
+                }
+                continue;
+            }
+            if (data) printf("<- ");
+            data = 0;
+            if (counters) printf("[%d:%04X]", port, counter);
+            if (event < MOLE_TR_EVENTS) Format(formats[event], name, arg);
+            else printf("\n(unknown event %d)", event);
+        }
+        printf("\n");
+    }
+    fclose(file);
+    return 0;
+}
@@ -340,10 +340,41 @@ int check_cpp(void){
     return(0);
 }
 
+/** Keystream computed ahead by xc_crypt_fill, between blocks and across
+ * seeks, must be the same as keystream computed when it is needed.
+ * @returns 0 on success, -1 on failure
+ */
+int check_fill(void){
+    xChaCha_ctx ref, ctx;
+    uint8_t key[32], iv[16], a[16], b[16];
+    for (int i = 0; i < 32; i++) key[i] = (uint8_t)(i * 7);
+    for (int i = 0; i < 16; i++) iv[i] = (uint8_t)(i + 100);
+    xc_crypt_init(&ref, key, iv, 1);
+    xc_crypt_init(&ctx, key, iv, 1);
+    for (uint32_t n = 0; n < 200; n++) {
+        if ((n % 37) == 36) {           // seek away, the reserve is dropped
+            xc_crypt_fill(&ctx, 3);
+            xc_crypt_seek(&ref, n * 3);
+            xc_crypt_seek(&ctx, n * 3);
+        }
+        xc_crypt_fill(&ctx, n % 3);
+        memset(a, (int)n, 16);
+        memset(b, (int)n, 16);
+        xc_crypt_block(&ref, a, a, 1);
+        xc_crypt_block(&ctx, b, b, 1);
+        if (memcmp(a, b, 16)) {
+            printf("xc_crypt_fill changed the keystream at block %u\n", n);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int main(void){
     if((check_ietf()) == 0
     && (check_cpp()) == 0
-    && (check_second_ietf() == 0)){
+    && (check_second_ietf() == 0)
+    && (check_fill() == 0)){
         printf("Cryptographic tests passed\n");
     } else {
         printf("Cryptographic tests failed!\n");